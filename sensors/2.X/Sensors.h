@@ -31,6 +31,7 @@
 #include <thread>
 
 #include "DirectChannel.h"
+#include "EventCoalescer.h"
 #include "EventMessageQueueWrapper.h"
 #include "Sensor.h"
 #include "SensorList.h"
@@ -98,7 +99,6 @@ struct Sensors : public ISensorsInterface, public ISensorsEventCallback {
 
   Sensors()
     : mEventQueueFlag(nullptr),
-      mNextHandle(1),
       mOutstandingWakeUpEvents(0),
       mReadWakeLockQueueRun(false),
       mAutoReleaseWakeLockTime(0),
@@ -198,22 +198,9 @@ struct Sensors : public ISensorsInterface, public ISensorsEventCallback {
   }
 
   Return<Result> batch(int32_t sensorHandle, int64_t samplingPeriodNs, int64_t maxReportLatencyNs) override {
-    int64_t usedLatency = maxReportLatencyNs;
-    if (maxReportLatencyNs > 0) {
-      mReportLatencyNs[sensorHandle] = maxReportLatencyNs;
-      for (auto sensor : mSensors) {
-        if (sensor.second->isEnabled()) {
-          auto latency = mReportLatencyNs.find(sensorHandle);
-          if (latency != mReportLatencyNs.end()) {
-            usedLatency = std::min(usedLatency, latency->second);
-          }
-        }
-      }
-    }
-
     auto sensor = mSensors.find(sensorHandle);
     if (sensor != mSensors.end()) {
-      sensor->second->batch(samplingPeriodNs, usedLatency);
+      sensor->second->batch(samplingPeriodNs, maxReportLatencyNs);
       return Result::OK;
     }
     return Result::BAD_VALUE;
@@ -306,7 +293,7 @@ struct Sensors : public ISensorsInterface, public ISensorsEventCallback {
       for (auto sensor : channelIt->second->sensorHandles) {
         auto sensorIt = mSensors.find(sensor);
         if (sensorIt != mSensors.end()) {
-          channelIt->second->rateNs[sensor] = 0;
+          channelIt->second->setRate(sensor, 0);
           sensorIt->second->stopDirectChannel(channelHandle);
         }
       }
@@ -330,24 +317,24 @@ struct Sensors : public ISensorsInterface, public ISensorsEventCallback {
 
     switch (rate) {
       case RateLevel::STOP:
-        channelIt->second->rateNs[sensorHandle] = 0;
+        channelIt->second->setRate(sensorHandle, 0);
         break;
       case RateLevel::NORMAL:
-        channelIt->second->rateNs[sensorHandle] = 20000000;
+        channelIt->second->setRate(sensorHandle, 20000000);
         break;
       case RateLevel::FAST:
         if (maxRate < static_cast<int32_t>(RateLevel::FAST)) {
           _hidl_cb(Result::BAD_VALUE, -1);
           return Void();
         }
-        channelIt->second->rateNs[sensorHandle] = 5000000;
+        channelIt->second->setRate(sensorHandle, 5000000);
         break;
       case RateLevel::VERY_FAST:
         if (maxRate < static_cast<int32_t>(RateLevel::VERY_FAST)) {
           _hidl_cb(Result::BAD_VALUE, -1);
           return Void();
         }
-        channelIt->second->rateNs[sensorHandle] = 1250000;
+        channelIt->second->setRate(sensorHandle, 1250000);
         break;
       default:
         _hidl_cb(Result::BAD_VALUE, -1);
@@ -355,7 +342,7 @@ struct Sensors : public ISensorsInterface, public ISensorsEventCallback {
     }
 
     channelIt->second->sensorHandles.push_back(sensorHandle);
-    sensorIt->second->addDirectChannel(channelHandle, channelIt->second->rateNs[sensorHandle]);
+    sensorIt->second->addDirectChannel(channelHandle, channelIt->second->rateNs.get(sensorHandle));
 
     _hidl_cb(Result::OK, sensorHandle);
 
@@ -363,37 +350,19 @@ struct Sensors : public ISensorsInterface, public ISensorsEventCallback {
   }
 
   void postEvents(const std::vector<V2_1::Event>& events, bool wakeup) override {
-    std::lock_guard<std::mutex> lock(mWriteLock);
-    if (mEventQueue->write(events)) {
-      mEventQueueFlag->wake(static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS));
-
-      if (wakeup) {
-        // Keep track of the number of outstanding WAKE_UP events in order to
-        // properly hold a wake lock until the framework has secured a wake lock
-        updateWakeLock(events.size(), 0 /* eventsHandled */);
-      }
-    }
+    mEventCoalescer.post(events, wakeup);
   }
 
   void writeToDirectBuffer(const std::vector<V2_1::Event>& events, int64_t samplingPeriodNs) override {
     if (mChannelMutex.try_lock()) {
       for (const auto& event : events) {
         for (auto& [channelHandle, channel] : mDirectChannels) {
-          if (std::find(channel->sensorHandles.begin(), channel->sensorHandles.end(), event.sensorHandle) ==
-              channel->sensorHandles.end()) {
-            continue;  // Skip channels that sensorHandle not match
-          }
-          if (channel->rateNs[event.sensorHandle] == 0) {
-            continue;  // Skip channels that are not active
-          }
-          channel->sampleCount[event.sensorHandle]++;
-          if (samplingPeriodNs * channel->sampleCount[event.sensorHandle] < channel->rateNs[event.sensorHandle]) {
-            continue;  // Skip channels that have faster sampling period
+          if (!channel->isSampleDue(event.sensorHandle, samplingPeriodNs)) {
+            continue;  // Skip channels that are not active or have a slower rate
           }
           sensors_event_t ev;
           V2_1::implementation::convertToSensorEvent(event, &ev);
           channel->write(&ev);
-          channel->sampleCount[event.sensorHandle] = 0;
         }
       }
       mChannelMutex.unlock();
@@ -408,14 +377,14 @@ protected:
     for (const auto& sensor : mSensorList.getAvailableSensors()) {
       const auto& data = sensor->getSensorData();
       SensorInfo sensorInfo{};
-      sensorInfo.sensorHandle = mNextHandle++;
+      sensorInfo.sensorHandle = data.handle;
       sensorInfo.name = data.sensorName;
       sensorInfo.vendor = data.vendor;
       sensorInfo.type = static_cast<SensorType>(data.type);
       sensorInfo.typeAsString = "";
       sensorInfo.version = 1;
-      sensorInfo.fifoReservedEventCount = 0;
-      sensorInfo.fifoMaxEventCount = 0;
+      sensorInfo.fifoReservedEventCount = data.fifoReservedEventCount;
+      sensorInfo.fifoMaxEventCount = data.fifoMaxEventCount;
       sensorInfo.requiredPermission = "";
 
       switch (data.reportMode) {
@@ -455,6 +424,33 @@ protected:
     }
   }
 
+  /**
+   * Writes the events of all sensors collected by the coalescer at once, the
+   * coalescer only hands over as many as the queue has room for
+   */
+  void writeEvents(const std::vector<V2_1::Event>& events, size_t wakeUpEvents) {
+    std::lock_guard<std::mutex> lock(mWriteLock);
+    if (mEventQueue->write(events)) {
+      mEventQueueFlag->wake(static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS));
+
+      if (wakeUpEvents > 0) {
+        // Keep track of the number of outstanding WAKE_UP events in order to
+        // properly hold a wake lock until the framework has secured a wake lock
+        updateWakeLock(wakeUpEvents, 0 /* eventsHandled */);
+      }
+    } else {
+      ALOGE("Failed to write %zu events", events.size());
+    }
+  }
+
+  /**
+   * The number of events the Event FMQ has room for
+   */
+  size_t availableToWrite() {
+    std::lock_guard<std::mutex> lock(mWriteLock);
+    return mEventQueue->availableToWrite();
+  }
+
   /**
    * Utility function to delete the Event Flag
    */
@@ -546,21 +542,11 @@ protected:
    */
   sp<ISensorsCallback> mCallback;
 
-  /**
-   * A map of the report latency in nanoseconds
-   */
-  std::map<int32_t, int64_t> mReportLatencyNs;
-
   /**
    * A map of the available sensors
    */
   std::map<int32_t, std::shared_ptr<Sensor>> mSensors;
 
-  /**
-   * The next available sensor handle
-   */
-  int32_t mNextHandle;
-
   /**
    * A list of the available sensors
    */
@@ -571,6 +557,13 @@ protected:
    */
   std::mutex mWriteLock;
 
+  /**
+   * Collects the events of all sensors into one FMQ write
+   */
+  bosch::sensors::EventCoalescer<V2_1::Event> mEventCoalescer{
+    [this](const std::vector<V2_1::Event>& events, size_t wakeUpEvents) { writeEvents(events, wakeUpEvents); },
+    [this]() { return availableToWrite(); }};
+
   /**
    * Lock to protect acquiring and releasing the wake lock
    */
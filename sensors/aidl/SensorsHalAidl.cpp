@@ -18,6 +18,9 @@
 
 #include <aidl/android/hardware/common/fmq/SynchronizedReadWrite.h>
 #include <aidlcommonsupport/NativeHandle.h>
+#include <utils/SystemClock.h>
+
+#include <algorithm>
 
 using ::aidl::android::hardware::common::fmq::MQDescriptor;
 using ::aidl::android::hardware::common::fmq::SynchronizedReadWrite;
@@ -67,9 +70,15 @@ static std::optional<std::vector<::bosch::sensor::hal::configuration::V1_0::Sens
 }
 
 ScopedAStatus SensorsHalAidl::activate(int32_t in_sensorHandle, bool in_enabled) {
-  auto sensor = mSensors.find(in_sensorHandle);
-  if (sensor != mSensors.end()) {
-    sensor->second->activate(in_enabled);
+  // The meta sensor only reports connections, it has nothing to switch on
+  if (in_sensorHandle == ::bosch::sensors::SensorList::DYNAMIC_SENSOR_META_HANDLE) {
+    mDynamicSensorMetaEnabled = in_enabled;
+    return ScopedAStatus::ok();
+  }
+
+  auto sensor = getSensor(in_sensorHandle);
+  if (sensor) {
+    sensor->activate(in_enabled);
     return ScopedAStatus::ok();
   }
 
@@ -78,77 +87,174 @@ ScopedAStatus SensorsHalAidl::activate(int32_t in_sensorHandle, bool in_enabled)
 
 ScopedAStatus SensorsHalAidl::batch(int32_t in_sensorHandle, int64_t in_samplingPeriodNs,
                                     int64_t in_maxReportLatencyNs) {
-  int64_t usedLatency = in_maxReportLatencyNs;
-  if (in_maxReportLatencyNs > 0) {
-    mReportLatencyNs[in_sensorHandle] = in_maxReportLatencyNs;
-    for (auto sensor : mSensors) {
-      if (sensor.second->isEnabled()) {
-        auto latency = mReportLatencyNs.find(in_sensorHandle);
-        if (latency != mReportLatencyNs.end()) {
-          usedLatency = std::min(usedLatency, latency->second);
-        }
-      }
-    }
+  if (in_sensorHandle == ::bosch::sensors::SensorList::DYNAMIC_SENSOR_META_HANDLE) {
+    return ScopedAStatus::ok();
   }
 
-  auto sensor = mSensors.find(in_sensorHandle);
-  if (sensor != mSensors.end()) {
-    sensor->second->batch(in_samplingPeriodNs, usedLatency);
+  auto sensor = getSensor(in_sensorHandle);
+  if (sensor) {
+    sensor->batch(in_samplingPeriodNs, in_maxReportLatencyNs);
     return ScopedAStatus::ok();
   }
 
   return ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
 }
 
+static SensorInfo createSensorInfo(const ::bosch::sensors::SensorData& data) {
+  SensorInfo sensorInfo{};
+  sensorInfo.sensorHandle = data.handle;
+  sensorInfo.name = data.sensorName;
+  sensorInfo.vendor = data.vendor;
+  sensorInfo.type = static_cast<SensorType>(data.type);
+  sensorInfo.typeAsString = "";
+  sensorInfo.version = 1;
+  sensorInfo.fifoReservedEventCount = data.fifoReservedEventCount;
+  sensorInfo.fifoMaxEventCount = data.fifoMaxEventCount;
+  sensorInfo.requiredPermission = "";
+
+  switch (data.reportMode) {
+    case bosch::sensors::SensorReportingMode::CONTINUOUS:
+      sensorInfo.flags |= SensorInfo::SENSOR_FLAG_BITS_CONTINUOUS_MODE;
+      sensorInfo.flags |= SensorInfo::SENSOR_FLAG_BITS_ADDITIONAL_INFO;
+      sensorInfo.flags |= SensorInfo::SENSOR_FLAG_BITS_DIRECT_CHANNEL_ASHMEM;
+      sensorInfo.flags |=
+        (static_cast<int32_t>(ISensors::RateLevel::NORMAL) << SensorInfo::SENSOR_FLAG_SHIFT_DIRECT_REPORT);
+      break;
+    case bosch::sensors::SensorReportingMode::ON_CHANGE:
+      sensorInfo.flags |= SensorInfo::SENSOR_FLAG_BITS_ON_CHANGE_MODE;
+      break;
+    case bosch::sensors::SensorReportingMode::ONE_SHOT:
+      sensorInfo.flags |= SensorInfo::SENSOR_FLAG_BITS_ONE_SHOT_MODE;
+      break;
+    case bosch::sensors::SensorReportingMode::SPECIAL_REPORTING:
+      sensorInfo.flags |= SensorInfo::SENSOR_FLAG_BITS_SPECIAL_REPORTING_MODE;
+      break;
+    default:
+      ALOGW("Unknown sensor reporting mode: %d", data.reportMode);
+      break;
+  }
+  sensorInfo.minDelayUs = data.minDelayUs;
+  sensorInfo.maxDelayUs = data.maxDelayUs;
+  sensorInfo.power = data.power;
+  sensorInfo.maxRange = data.range;
+  sensorInfo.resolution = data.resolution;
+  return sensorInfo;
+}
+
+static Event createDynamicSensorMetaEvent(int32_t sensorHandle, bool connected) {
+  Event::EventPayload::DynamicSensorInfo info{};
+  info.connected = connected;
+  info.sensorHandle = sensorHandle;
+  const auto uuid = ::bosch::sensors::SensorList::getDynamicSensorUuid(sensorHandle);
+  std::copy(uuid.begin(), uuid.end(), info.uuid.values.begin());
+
+  Event event{};
+  event.timestamp = ::android::elapsedRealtimeNano();
+  event.sensorHandle = ::bosch::sensors::SensorList::DYNAMIC_SENSOR_META_HANDLE;
+  event.sensorType = SensorType::DYNAMIC_SENSOR_META;
+  event.payload.set<Event::EventPayload::dynamic>(info);
+  return event;
+}
+
 void SensorsHalAidl::AddSensors() {
   for (const auto& sensor : mSensorList.getAvailableSensors()) {
-    const auto& data = sensor->getSensorData();
-    SensorInfo sensorInfo{};
-    sensorInfo.sensorHandle = mNextHandle++;
-    sensorInfo.name = data.sensorName;
-    sensorInfo.vendor = data.vendor;
-    sensorInfo.type = static_cast<SensorType>(data.type);
-    sensorInfo.typeAsString = "";
-    sensorInfo.version = 1;
-    sensorInfo.fifoReservedEventCount = 0;
-    sensorInfo.fifoMaxEventCount = 0;
-    sensorInfo.requiredPermission = "";
-
-    switch (data.reportMode) {
-      case bosch::sensors::SensorReportingMode::CONTINUOUS:
-        sensorInfo.flags |= SensorInfo::SENSOR_FLAG_BITS_CONTINUOUS_MODE;
-        sensorInfo.flags |= SensorInfo::SENSOR_FLAG_BITS_ADDITIONAL_INFO;
-        sensorInfo.flags |= SensorInfo::SENSOR_FLAG_BITS_DIRECT_CHANNEL_ASHMEM;
-        sensorInfo.flags |=
-          (static_cast<int32_t>(ISensors::RateLevel::NORMAL) << SensorInfo::SENSOR_FLAG_SHIFT_DIRECT_REPORT);
-        break;
-      case bosch::sensors::SensorReportingMode::ON_CHANGE:
-        sensorInfo.flags |= SensorInfo::SENSOR_FLAG_BITS_ON_CHANGE_MODE;
-        break;
-      case bosch::sensors::SensorReportingMode::ONE_SHOT:
-        sensorInfo.flags |= SensorInfo::SENSOR_FLAG_BITS_ONE_SHOT_MODE;
-        break;
-      case bosch::sensors::SensorReportingMode::SPECIAL_REPORTING:
-        sensorInfo.flags |= SensorInfo::SENSOR_FLAG_BITS_SPECIAL_REPORTING_MODE;
-        break;
-      default:
-        ALOGW("Unknown sensor reporting mode: %d", data.reportMode);
-        break;
+    addSensor(sensor, false /* isDynamic */);
+  }
+
+  mDynamicSensorMetaInfo = createSensorInfo(::bosch::sensors::SensorList::getDynamicSensorMetaData());
+  mSensorList.startHotplugMonitor(
+    [this](const auto& addedSensors, const auto& removedHandles) { onSensorsChanged(addedSensors, removedHandles); });
+}
+
+SensorInfo SensorsHalAidl::addSensor(const std::shared_ptr<::bosch::sensors::ISensorHal>& sensor, bool isDynamic) {
+  SensorInfo sensorInfo = createSensorInfo(sensor->getSensorData());
+  if (isDynamic) {
+    sensorInfo.flags |= SensorInfo::SENSOR_FLAG_BITS_DYNAMIC_SENSOR;
+  }
+
+  const auto sensors_config_list = readSensorsConfigFromXml();
+  const auto& sensorconfig = getSensorConfiguration(*sensors_config_list, sensorInfo.name, sensorInfo.type);
+  std::shared_ptr<Sensor> halSensor = std::make_shared<Sensor>(this /* callback */, sensorInfo, sensor, sensorconfig);
+  ALOGD("AddSensor[%d] %s", sensorInfo.sensorHandle, sensorInfo.name.c_str());
+
+  std::lock_guard<std::mutex> lock(mSensorsMutex);
+  mSensors.set(sensorInfo.sensorHandle, halSensor);
+  return sensorInfo;
+}
+
+/*
+ * Runs on the hotplug monitor thread. Removed sensors are handled first, an
+ * added sensor may take over the handle of a removed one.
+ */
+void SensorsHalAidl::onSensorsChanged(const std::vector<std::shared_ptr<::bosch::sensors::ISensorHal>>& addedSensors,
+                                      const std::vector<int32_t>& removedHandles) {
+  std::vector<int32_t> disconnected{};
+  for (const int32_t sensorHandle : removedHandles) {
+    std::shared_ptr<Sensor> sensor{};
+    {
+      std::lock_guard<std::mutex> lock(mSensorsMutex);
+      sensor = mSensors.get(sensorHandle);
+      if (!sensor) continue;
+      mSensors.set(sensorHandle, nullptr);
     }
-    sensorInfo.minDelayUs = data.minDelayUs;
-    sensorInfo.maxDelayUs = data.maxDelayUs;
-    sensorInfo.power = data.power;
-    sensorInfo.maxRange = data.range;
-    sensorInfo.resolution = data.resolution;
-
-    const auto sensors_config_list = readSensorsConfigFromXml();
-    const auto& sensorconfig = getSensorConfiguration(*sensors_config_list, sensorInfo.name, sensorInfo.type);
-    std::shared_ptr<Sensor> halSensor = std::make_shared<Sensor>(this /* callback */, sensorInfo, sensor, sensorconfig);
-    mSensors[halSensor->getSensorInfo().sensorHandle] = halSensor;
-    ALOGD("AddSensor[%d] %s", halSensor->getSensorInfo().sensorHandle, halSensor->getSensorInfo().name.c_str());
+    sensor->activate(false);
+    disconnected.push_back(sensorHandle);
+  }
+
+  std::vector<SensorInfo> connected{};
+  for (const auto& sensor : addedSensors) {
+    connected.push_back(addSensor(sensor, true /* isDynamic */));
+  }
+
+  announceDynamicSensors(connected, disconnected);
+}
+
+/*
+ * The framework only takes a dynamic sensor into use with the meta event that
+ * follows the callback.
+ */
+void SensorsHalAidl::announceDynamicSensors(const std::vector<SensorInfo>& connected,
+                                            const std::vector<int32_t>& disconnected) {
+  std::shared_ptr<ISensorsCallback> callback{};
+  {
+    std::lock_guard<std::mutex> lock(mSensorsMutex);
+    callback = mCallback;
+  }
+  if (!callback) {
+    return;
+  }
+
+  std::vector<Event> events{};
+  if (!disconnected.empty()) {
+    callback->onDynamicSensorsDisconnected(disconnected);
+    for (const int32_t sensorHandle : disconnected) {
+      events.push_back(createDynamicSensorMetaEvent(sensorHandle, false /* connected */));
+    }
+  }
+  if (!connected.empty()) {
+    callback->onDynamicSensorsConnected(connected);
+    for (const auto& sensorInfo : connected) {
+      events.push_back(createDynamicSensorMetaEvent(sensorInfo.sensorHandle, true /* connected */));
+    }
+  }
+  if (!events.empty()) {
+    postEvents(events, false /* wakeup */);
   }
 }
 
+std::shared_ptr<Sensor> SensorsHalAidl::getSensor(int32_t sensorHandle) {
+  std::lock_guard<std::mutex> lock(mSensorsMutex);
+  return mSensors.get(sensorHandle);
+}
+
+std::vector<std::shared_ptr<Sensor>> SensorsHalAidl::getSensors() {
+  std::lock_guard<std::mutex> lock(mSensorsMutex);
+  std::vector<std::shared_ptr<Sensor>> sensors{};
+  mSensors.forEach(
+    [&](int32_t /* sensorHandle */, const std::shared_ptr<Sensor>& sensor) { sensors.push_back(sensor); });
+  return sensors;
+}
+
 ScopedAStatus SensorsHalAidl::configDirectReport(int32_t in_sensorHandle, int32_t in_channelHandle,
                                                  ISensors::RateLevel in_rate, int32_t* _aidl_return) {
   std::lock_guard<std::mutex> lock(mChannelMutex);
@@ -160,70 +266,93 @@ ScopedAStatus SensorsHalAidl::configDirectReport(int32_t in_sensorHandle, int32_
 
   if (in_sensorHandle == -1 && in_rate == ISensors::RateLevel::STOP) {
     for (auto sensor : channelIt->second->sensorHandles) {
-      auto sensorIt = mSensors.find(sensor);
-      if (sensorIt != mSensors.end()) {
-        channelIt->second->rateNs[sensor] = 0;
-        sensorIt->second->stopDirectChannel(in_channelHandle);
+      auto halSensor = getSensor(sensor);
+      if (halSensor) {
+        channelIt->second->setRate(sensor, 0);
+        halSensor->stopDirectChannel(in_channelHandle);
       }
     }
     return ndk::ScopedAStatus::ok();
   }
 
-  auto sensorIt = mSensors.find(in_sensorHandle);
-  if (sensorIt == mSensors.end()) {
+  auto sensor = getSensor(in_sensorHandle);
+  if (!sensor) {
     return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
   }
 
-  if (!(sensorIt->second->getSensorInfo().flags & SensorInfo::SENSOR_FLAG_BITS_DIRECT_CHANNEL_ASHMEM)) {
+  if (!(sensor->getSensorInfo().flags & SensorInfo::SENSOR_FLAG_BITS_DIRECT_CHANNEL_ASHMEM)) {
     return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
   }
 
-  const int32_t maxRate = (sensorIt->second->getSensorInfo().flags & SENSOR_FLAG_MASK_DIRECT_REPORT) >>
+  const int32_t maxRate = (sensor->getSensorInfo().flags & SENSOR_FLAG_MASK_DIRECT_REPORT) >>
                           SensorInfo::SENSOR_FLAG_SHIFT_DIRECT_REPORT;
 
   switch (in_rate) {
     case ISensors::RateLevel::STOP:
-      channelIt->second->rateNs[in_sensorHandle] = 0;
+      channelIt->second->setRate(in_sensorHandle, 0);
       break;
     case ISensors::RateLevel::NORMAL:
-      channelIt->second->rateNs[in_sensorHandle] = 20000000;
+      channelIt->second->setRate(in_sensorHandle, 20000000);
       break;
     case ISensors::RateLevel::FAST:
       if (maxRate < static_cast<int32_t>(ISensors::RateLevel::FAST)) {
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
       }
-      channelIt->second->rateNs[in_sensorHandle] = 5000000;
+      channelIt->second->setRate(in_sensorHandle, 5000000);
       break;
     case ISensors::RateLevel::VERY_FAST:
       if (maxRate < static_cast<int32_t>(ISensors::RateLevel::VERY_FAST)) {
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
       }
-      channelIt->second->rateNs[in_sensorHandle] = 1250000;
+      channelIt->second->setRate(in_sensorHandle, 1250000);
       break;
     default:
       return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
   }
 
   channelIt->second->sensorHandles.push_back(in_sensorHandle);
-  sensorIt->second->addDirectChannel(in_channelHandle, channelIt->second->rateNs[in_sensorHandle]);
+  sensor->addDirectChannel(in_channelHandle, channelIt->second->rateNs.get(in_sensorHandle));
 
   *_aidl_return = in_sensorHandle;
   return ndk::ScopedAStatus::ok();
 }
 
+/*
+ * The meta sensor has no batched events, a flush of it completes at once as
+ * long as it is activated, like for any other sensor.
+ */
 ScopedAStatus SensorsHalAidl::flush(int32_t in_sensorHandle) {
-  auto sensor = mSensors.find(in_sensorHandle);
-  if (sensor != mSensors.end()) {
-    return sensor->second->flush();
+  if (in_sensorHandle == ::bosch::sensors::SensorList::DYNAMIC_SENSOR_META_HANDLE) {
+    if (!mDynamicSensorMetaEnabled) {
+      return ScopedAStatus::fromServiceSpecificError(static_cast<int32_t>(ERROR_BAD_VALUE));
+    }
+    Event event{};
+    event.sensorHandle = in_sensorHandle;
+    event.sensorType = SensorType::META_DATA;
+    Event::EventPayload::MetaData meta = {
+      .what = Event::EventPayload::MetaData::MetaDataEventType::META_DATA_FLUSH_COMPLETE,
+    };
+    event.payload.set<Event::EventPayload::Tag::meta>(meta);
+    postEvents({event}, false /* wakeup */);
+    return ScopedAStatus::ok();
+  }
+
+  auto sensor = getSensor(in_sensorHandle);
+  if (sensor) {
+    return sensor->flush();
   }
 
   return ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
 }
 
 ScopedAStatus SensorsHalAidl::getSensorsList(std::vector<SensorInfo>* _aidl_return) {
-  for (const auto& sensor : mSensors) {
-    _aidl_return->push_back(sensor.second->getSensorInfo());
+  // Dynamic sensors are only announced through the callback
+  for (const auto& sensor : getSensors()) {
+    if (!(sensor->getSensorInfo().flags & SensorInfo::SENSOR_FLAG_BITS_DYNAMIC_SENSOR)) {
+      _aidl_return->push_back(sensor->getSensorInfo());
+    }
   }
+  _aidl_return->push_back(mDynamicSensorMetaInfo);
   return ScopedAStatus::ok();
 }
 
@@ -234,9 +363,10 @@ ScopedAStatus SensorsHalAidl::initialize(
   ScopedAStatus result = ScopedAStatus::ok();
 
   // Ensure that all sensors are disabled.
-  for (auto sensor : mSensors) {
-    sensor.second->activate(false);
+  for (const auto& sensor : getSensors()) {
+    sensor->activate(false);
   }
+  mDynamicSensorMetaEnabled = false;
 
   // Stop the Wake Lock thread if it is currently running
   if (mReadWakeLockQueueRun.load()) {
@@ -248,14 +378,17 @@ ScopedAStatus SensorsHalAidl::initialize(
     std::make_unique<AidlMessageQueue<Event, SynchronizedReadWrite>>(in_eventQueueDescriptor, true /* resetPointers */);
 
   // Save a reference to the callback
-  mCallback = in_sensorsCallback;
+  {
+    std::lock_guard<std::mutex> lock(mSensorsMutex);
+    mCallback = in_sensorsCallback;
+  }
 
   // Reset direct channels
   for (auto& [channelHandle, channel] : mDirectChannels) {
     for (auto sensorHandle : channel->sensorHandles) {
-      auto sensor = mSensors.find(sensorHandle);
-      if (sensor != mSensors.end()) {
-        sensor->second->removeDirectChannel(channelHandle);
+      auto sensor = getSensor(sensorHandle);
+      if (sensor) {
+        sensor->removeDirectChannel(channelHandle);
       }
     }
   }
@@ -283,13 +416,22 @@ ScopedAStatus SensorsHalAidl::initialize(
   // Start the thread to read events from the Wake Lock FMQ
   mReadWakeLockQueueRun = true;
   mWakeLockThread = std::thread(startReadWakeLockThread, this);
+
+  // The framework forgets dynamic sensors when it reconnects
+  std::vector<SensorInfo> dynamicSensors{};
+  for (const auto& sensor : getSensors()) {
+    if (sensor->getSensorInfo().flags & SensorInfo::SENSOR_FLAG_BITS_DYNAMIC_SENSOR) {
+      dynamicSensors.push_back(sensor->getSensorInfo());
+    }
+  }
+  announceDynamicSensors(dynamicSensors, {});
   return result;
 }
 
 ScopedAStatus SensorsHalAidl::injectSensorData(const Event& in_event) {
-  auto sensor = mSensors.find(in_event.sensorHandle);
-  if (sensor != mSensors.end()) {
-    return sensor->second->injectEvent(in_event);
+  auto sensor = getSensor(in_event.sensorHandle);
+  if (sensor) {
+    return sensor->injectEvent(in_event);
   }
   return ScopedAStatus::fromServiceSpecificError(static_cast<int32_t>(ERROR_BAD_VALUE));
 }
@@ -320,8 +462,8 @@ ScopedAStatus SensorsHalAidl::registerDirectChannel(const ISensors::SharedMemInf
 
 ScopedAStatus SensorsHalAidl::setOperationMode(OperationMode in_mode) {
   auto res = ScopedAStatus::ok();
-  for (auto sensor : mSensors) {
-    res = sensor.second->setOperationMode(in_mode);
+  for (const auto& sensor : getSensors()) {
+    res = sensor->setOperationMode(in_mode);
   }
   return res;
 }
@@ -332,9 +474,9 @@ ScopedAStatus SensorsHalAidl::unregisterDirectChannel(int32_t in_channelHandle)
   auto channelIt = mDirectChannels.find(in_channelHandle);
   if (channelIt != mDirectChannels.end()) {
     for (auto sensorHandle : channelIt->second->sensorHandles) {
-      auto sensorIt = mSensors.find(sensorHandle);
-      if (sensorIt != mSensors.end()) {
-        sensorIt->second->removeDirectChannel(in_channelHandle);
+      auto sensor = getSensor(sensorHandle);
+      if (sensor) {
+        sensor->removeDirectChannel(in_channelHandle);
       }
     }
   }
@@ -19,11 +19,16 @@
 
 #include <aidl/android/hardware/sensors/BnSensors.h>
 
+#include <condition_variable>
 #include <map>
+#include <mutex>
 #include <string>
-#include <thread>
 
+#include "Arena.h"
 #include "ISensorHal.h"
+#include "SamplingClock.h"
+#include "SensorScheduler.h"
+#include "SeqLock.h"
 #include "bosch_sensor_hal_configuration_V1_0.h"
 
 namespace aidl {
@@ -72,26 +77,61 @@ public:
   void stopDirectChannel(int32_t channelHandle);
   void removeDirectChannel(int32_t channelHandle);
   void updateDirectChannel();
+  bosch::sensors::SamplingStats getSamplingStats();
 
 private:
-  void run();
-  std::vector<Event> readEvents();
-  static void startThread(Sensor* sensor);
+  int64_t onTimer(int64_t nowNs);
+  void publishConfig();
+  void applyConfig(const bosch::sensors::SamplingConfig& config);
+  void waitForReportGeneration(uint32_t generation);
+  void postFlushComplete();
+  void logSamplingStats();
+  uint64_t getArenaRegrowths() const;
+  void readEvents();
   ndk::ScopedAStatus getSensorPlacement(std::vector<AdditionalInfo>& additionalInfoFrames);
-  ndk::ScopedAStatus getSensorTemperature(std::vector<AdditionalInfo>& additionalInfoFrames);
+  ndk::ScopedAStatus getSensorTemperature(bosch::sensors::Arena<AdditionalInfo>& additionalInfoFrames);
   std::optional<std::vector<Location>> getLocation();
   std::optional<std::vector<Orientation>> getOrientation();
   ndk::ScopedAStatus setSensorPlacementData(AdditionalInfo* sensorPlacement, int index, float value);
   void sendAdditionalInfoReport();
+  void postPendingEvents(int64_t nowNs, bool isFlush);
 
   bool isWakeUpSensor();
 
-  bool mIsEnabled;
+  std::atomic_bool mIsEnabled;
   bool mDirectChannelEnabled;
   int64_t mSamplingPeriodNs;
-  int64_t mNextSampleTimeNs;
+  int64_t mReportLatencyNs;
   int64_t mDirectChannelRateNs;
-  int64_t mNextDirectChannelNs;
+  uint32_t mReportGeneration{0};
+  uint32_t mDirectChannelGeneration{0};
+
+  // Owned by the data path
+  bosch::sensors::SamplingClock mReportClock{};
+  bosch::sensors::SamplingClock mDirectChannelClock{};
+  bosch::sensors::SamplingConfig mAppliedConfig{};
+  // Reused across ticks, see readEvents()
+  std::vector<bosch::sensors::SensorValues> mValues{};
+  bosch::sensors::Arena<Event> mEvents{bosch::sensors::MAX_READ_VALUES};
+  bosch::sensors::Arena<Event> mPendingEvents{bosch::sensors::MAX_READ_VALUES};
+  // Flush complete and additional info events, with the placement frame that
+  // is built once from the configuration
+  bosch::sensors::Arena<Event> mControlEvents{ADDITIONAL_INFO_FRAMES};
+  bosch::sensors::Arena<AdditionalInfo> mAdditionalInfoFrames{ADDITIONAL_INFO_FRAMES};
+  std::vector<AdditionalInfo> mPlacementFrames{};
+  float mGyroUncalibratedOffset{0};
+  // Latest time the software batch of a polled sensor is posted at
+  int64_t mBatchDeadlineNs{0};
+
+  // Shared between control and data path
+  bosch::sensors::SeqLock<bosch::sensors::SamplingConfig> mSamplingConfig{};
+  bosch::sensors::SeqLock<bosch::sensors::SamplingStats> mSamplingStats{};
+  std::atomic<uint32_t> mFlushRequests{0};
+  // Last report generation the data path applied, see waitForReportGeneration()
+  std::mutex mAppliedMutex;
+  std::condition_variable mAppliedCondition;
+  uint32_t mAppliedReportGeneration{0};
+
   SensorInfo mSensorInfo;
 
   struct DirectChannel {
@@ -106,13 +146,14 @@ private:
   static constexpr uint8_t ROTATION_X_IDX = 0;
   static constexpr uint8_t ROTATION_Y_IDX = 1;
   static constexpr uint8_t ROTATION_Z_IDX = 2;
+  // Begin, placement, temperature and end
+  static constexpr size_t ADDITIONAL_INFO_FRAMES = 4;
 
   AdditionalInfo::AdditionalInfoPayload::FloatValues mAdditionalInfoValues;
 
-  std::atomic_bool mStopThread;
-  std::condition_variable mWaitCV;
-  std::mutex mRunMutex;
-  std::thread mRunThread;
+  std::mutex mControlMutex;
+  int mTaskId;
+  bool mIsDataDriven{false};
 
   ISensorsEventCallback* mCallback;
 
@@ -22,9 +22,12 @@
 #include <fmq/AidlMessageQueue.h>
 #include <hardware_legacy/power.h>
 
+#include <limits>
 #include <map>
 
 #include "DirectChannel.h"
+#include "EventCoalescer.h"
+#include "HandleTable.h"
 #include "Sensor.h"
 #include "SensorList.h"
 
@@ -45,7 +48,6 @@ class SensorsHalAidl : public BnSensors, public ISensorsEventCallback {
 public:
   SensorsHalAidl()
     : mEventQueueFlag(nullptr),
-      mNextHandle(1),
       mOutstandingWakeUpEvents(0),
       mReadWakeLockQueueRun(false),
       mAutoReleaseWakeLockTime(0),
@@ -54,6 +56,7 @@ public:
   }
 
   virtual ~SensorsHalAidl() {
+    mSensorList.stopHotplugMonitor();
     deleteEventFlag();
     mReadWakeLockQueueRun = false;
     mWakeLockThread.join();
@@ -81,36 +84,14 @@ public:
   ::ndk::ScopedAStatus setOperationMode(::aidl::android::hardware::sensors::ISensors::OperationMode in_mode) override;
   ::ndk::ScopedAStatus unregisterDirectChannel(int32_t in_channelHandle) override;
 
-  void postEvents(const std::vector<Event>& events, bool wakeup) override {
-    std::lock_guard<std::mutex> lock(mWriteLock);
-    if (mEventQueue == nullptr) {
-      return;
-    }
-    if (mEventQueue->write(&events.front(), events.size())) {
-      mEventQueueFlag->wake(static_cast<uint32_t>(BnSensors::EVENT_QUEUE_FLAG_BITS_READ_AND_PROCESS));
-
-      if (wakeup) {
-        // Keep track of the number of outstanding WAKE_UP events in order to
-        // properly hold a wake lock until the framework has secured a wake lock
-        updateWakeLock(events.size(), 0 /* eventsHandled */);
-      }
-    }
-  }
+  void postEvents(const std::vector<Event>& events, bool wakeup) override { mEventCoalescer.post(events, wakeup); }
 
   void writeToDirectBuffer(const std::vector<Event>& events, int64_t samplingPeriodNs) override {
     if (mChannelMutex.try_lock()) {
       for (const auto& event : events) {
         for (auto& [channelHandle, channel] : mDirectChannels) {
-          if (std::find(channel->sensorHandles.begin(), channel->sensorHandles.end(), event.sensorHandle) ==
-              channel->sensorHandles.end()) {
-            continue;  // Skip channels that sensorHandle not match
-          }
-          if (channel->rateNs[event.sensorHandle] == 0) {
-            continue;  // Skip channels that are not active
-          }
-          channel->sampleCount[event.sensorHandle]++;
-          if (samplingPeriodNs * channel->sampleCount[event.sensorHandle] < channel->rateNs[event.sensorHandle]) {
-            continue;  // Skip channels that have faster sampling period
+          if (!channel->isSampleDue(event.sensorHandle, samplingPeriodNs)) {
+            continue;  // Skip channels that are not active or have a slower rate
           }
           sensors_event_t ev = {.version = sizeof(sensors_event_t),
                                 .sensor = event.sensorHandle,
@@ -132,7 +113,6 @@ public:
             ev.acceleration.status = (int32_t)event.payload.get<Event::EventPayload::vec3>().status;
           }
           channel->write(&ev);
-          channel->sampleCount[event.sensorHandle] = 0;
         }
       }
       mChannelMutex.unlock();
@@ -142,6 +122,42 @@ public:
 protected:
   // Add new sensors
   void AddSensors();
+  SensorInfo addSensor(const std::shared_ptr<::bosch::sensors::ISensorHal>& sensor, bool isDynamic);
+
+  // Connect and disconnect dynamic sensors of devices that are hotplugged
+  void onSensorsChanged(const std::vector<std::shared_ptr<::bosch::sensors::ISensorHal>>& addedSensors,
+                        const std::vector<int32_t>& removedHandles);
+  void announceDynamicSensors(const std::vector<SensorInfo>& connected, const std::vector<int32_t>& disconnected);
+
+  std::shared_ptr<Sensor> getSensor(int32_t sensorHandle);
+  std::vector<std::shared_ptr<Sensor>> getSensors();
+
+  // Writes the events of all sensors collected by the coalescer at once, the
+  // coalescer only hands over as many as the queue has room for
+  void writeEvents(const std::vector<Event>& events, size_t wakeUpEvents) {
+    std::lock_guard<std::mutex> lock(mWriteLock);
+    if (mEventQueue == nullptr) {
+      return;
+    }
+    if (mEventQueue->write(&events.front(), events.size())) {
+      mEventQueueFlag->wake(static_cast<uint32_t>(BnSensors::EVENT_QUEUE_FLAG_BITS_READ_AND_PROCESS));
+
+      if (wakeUpEvents > 0) {
+        // Keep track of the number of outstanding WAKE_UP events in order to
+        // properly hold a wake lock until the framework has secured a wake lock
+        updateWakeLock(wakeUpEvents, 0 /* eventsHandled */);
+      }
+    } else {
+      ALOGE("Failed to write %zu events", events.size());
+    }
+  }
+
+  // The number of events the Event FMQ has room for
+  size_t availableToWrite() {
+    std::lock_guard<std::mutex> lock(mWriteLock);
+    // Without a queue the writer discards the events anyway
+    return (mEventQueue == nullptr) ? std::numeric_limits<size_t>::max() : mEventQueue->availableToWrite();
+  }
 
   // Utility function to delete the Event Flag
   void deleteEventFlag() {
@@ -220,16 +236,22 @@ private:
   EventFlag* mEventQueueFlag;
   // Callback for asynchronous events, such as dynamic sensor connections.
   std::shared_ptr<::aidl::android::hardware::sensors::ISensorsCallback> mCallback;
-  // A map of the report latency in nanoseconds
-  std::map<int32_t, int64_t> mReportLatencyNs;
-  // A map of the available sensors.
-  std::map<int32_t, std::shared_ptr<Sensor>> mSensors;
-  // The next available sensor handle
-  int32_t mNextHandle;
+  // The available sensors indexed by their handle, including the dynamic ones.
+  bosch::sensors::HandleTable<std::shared_ptr<Sensor>> mSensors;
+  // Lock to protect the sensor table and the callback, which change on hotplug
+  std::mutex mSensorsMutex;
+  // The sensor that reports dynamic sensor connections
+  SensorInfo mDynamicSensorMetaInfo;
+  // Whether the framework has activated the meta sensor, it can only be flushed then
+  std::atomic_bool mDynamicSensorMetaEnabled{false};
   // A list of the available sensors
   bosch::sensors::SensorList mSensorList;
   // Lock to protect writes to the FMQs.
   std::mutex mWriteLock;
+  // Collects the events of all sensors into one FMQ write
+  bosch::sensors::EventCoalescer<Event> mEventCoalescer{
+    [this](const std::vector<Event>& events, size_t wakeUpEvents) { writeEvents(events, wakeUpEvents); },
+    [this]() { return availableToWrite(); }};
   // Lock to protect acquiring and releasing the wake lock
   std::mutex mWakeLockLock;
   // Track the number of WAKE_UP events that have not been handled by the
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_BOSCH_ARENA_H
+#define ANDROID_HARDWARE_BOSCH_ARENA_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace bosch {
+namespace sensors {
+
+/*
+ * Storage of the data path that is reused across ticks. It is sized up front
+ * and clearing it keeps the memory, it only regrows if a tick needs more than
+ * ever before. The regrowths are counted so that the dump shows whether the
+ * steady state fits into the arenas. Heap allocations outside of the arenas,
+ * e.g. in the HAL framework or the drivers, are not counted.
+ *
+ * Only the data path touches the content, the counter can be read from any
+ * thread.
+ */
+template <typename T>
+class Arena {
+public:
+  explicit Arena(size_t capacity) { mItems.reserve(capacity); }
+
+  void clear() { mItems.clear(); }
+  bool empty() const { return mItems.empty(); }
+  size_t size() const { return mItems.size(); }
+  const std::vector<T>& get() const { return mItems; }
+
+  void push_back(const T& item) {
+    reserve(mItems.size() + 1);
+    mItems.push_back(item);
+  }
+
+  void append(const std::vector<T>& items) {
+    reserve(mItems.size() + items.size());
+    mItems.insert(mItems.end(), items.begin(), items.end());
+  }
+
+  void append(size_t count, const T& item) {
+    reserve(mItems.size() + count);
+    mItems.insert(mItems.end(), count, item);
+  }
+
+  T& operator[](size_t index) { return mItems[index]; }
+
+  void truncate(size_t size) { mItems.erase(mItems.begin() + std::min(size, mItems.size()), mItems.end()); }
+
+  uint64_t getRegrowths() const { return mRegrowths.load(std::memory_order_relaxed); }
+
+private:
+  void reserve(size_t size) {
+    if (size <= mItems.capacity()) return;
+    mItems.reserve(std::max(size, 2 * mItems.capacity()));
+    mRegrowths.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  std::vector<T> mItems{};
+  std::atomic<uint64_t> mRegrowths{0};
+};
+
+}  // namespace sensors
+}  // namespace bosch
+
+#endif  // ANDROID_HARDWARE_BOSCH_ARENA_H
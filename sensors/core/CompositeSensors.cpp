@@ -18,6 +18,8 @@
 
 #include <log/log.h>
 
+#include <algorithm>
+
 using namespace bosch::sensors;
 
 static constexpr float NOMINAL_GRAVITY = 9.80665f;
@@ -30,11 +32,99 @@ static constexpr float DEFAULT_MAG_STDEV = 0.1f;       // uT    (measured 0.7  /
 static constexpr float DEFAULT_GYRO_VAR = 1e-6;        // (rad/s)^2 / s
 static constexpr float DEFAULT_GYRO_BIAS_VAR = 1e-12;  // (rad/s)^2 / s (guessed)
 
+/*
+ * The consumers are only created on activation, the task is handed to them
+ * then. The composite sensor is data driven if all its dependencies are.
+ */
+bool CompositeSensorCore::setDataReadyTask(int taskId) {
+  const bool isDataDriven = std::all_of(mDependencyList.begin(), mDependencyList.end(),
+                                        [](const auto& sensor) { return sensor->isBuffered(); });
+  if (isDataDriven) mDataReadyTask = taskId;
+  return isDataDriven;
+}
+
 void CompositeSensorCore::activate(bool enable) {
+  // Every dependency is read through a consumer of its own, otherwise the
+  // composite sensor would take the samples of the underlying sensor
+  if (mConsumers.empty()) {
+    for (const auto& sensor : mDependencyList) {
+      mConsumers.push_back(sensor->addConsumer(mSensorData.type));
+      if (mDataReadyTask >= 0) sensor->setConsumerDataReadyTask(mConsumers.back(), mDataReadyTask);
+    }
+  }
   for (const auto& sensor : mDependencyList) {
     sensor->activateByType(mSensorData.type, enable);
   }
   mJustStarted = true;
+  mDropUnpaired = true;
+}
+
+// The accelerometer paces the fusion
+float CompositeSensorCore::getHardwareRateHz() const {
+  return mDependencyList.empty() ? 0.0f : mDependencyList.front()->getHardwareRateHz();
+}
+
+float CompositeSensorCore::getClockSkewPpm() const {
+  return mDependencyList.empty() ? 0.0f : mDependencyList.front()->getClockSkewPpm();
+}
+
+/*
+ * Reads the samples of every dependency and pairs each accel sample with the
+ * gyro sample nearest in time, into mAccPairs and mGyroPairs. Accel and gyro
+ * can run at different rates and deliver different counts per read, samples
+ * that can not be paired yet are kept for the next read. An accel sample is
+ * paired once a gyro sample at or after it has arrived, so that the nearest
+ * one is known. Returns the number of pairs.
+ */
+size_t CompositeSensorCore::readDependencies(size_t capacity) {
+  if (mDropUnpaired.exchange(false)) {
+    mAccCount = 0;
+    mGyroCount = 0;
+  }
+
+  for (size_t i = 0; i < mDependencyList.size(); i++) {
+    const auto& sensor = mDependencyList[i];
+    const int consumer = (i < mConsumers.size()) ? mConsumers[i] : -1;
+    if (sensor->getSensorData().type == BoschSensorType::ACCEL) {
+      mAccCount += sensor->readSensorValues(consumer, mAccValues.data() + mAccCount, mAccValues.size() - mAccCount);
+    } else if (sensor->getSensorData().type == BoschSensorType::GYRO) {
+      mGyroCount +=
+        sensor->readSensorValues(consumer, mGyroValues.data() + mGyroCount, mGyroValues.size() - mGyroCount);
+    }
+  }
+
+  capacity = std::min(capacity, mAccPairs.size());
+  size_t count = 0;
+  size_t acc = 0;
+  size_t gyro = 0;
+  for (; (acc < mAccCount) && (count < capacity); acc++) {
+    const int64_t timestamp = mAccValues[acc].timestamp;
+    while ((gyro < mGyroCount) && (mGyroValues[gyro].timestamp < timestamp)) gyro++;
+    if (gyro == mGyroCount) break;
+
+    size_t nearest = gyro;
+    if ((gyro > 0) && (timestamp - mGyroValues[gyro - 1].timestamp < mGyroValues[gyro].timestamp - timestamp)) {
+      nearest = gyro - 1;
+    }
+    mAccPairs[count] = mAccValues[acc];
+    mGyroPairs[count] = mGyroValues[nearest];
+    count++;
+  }
+
+  // The gyro sample before the next accel sample may still be the nearest one
+  keepUnpaired(mAccValues, mAccCount, acc);
+  keepUnpaired(mGyroValues, mGyroCount, (gyro > 0) ? gyro - 1 : 0);
+  return count;
+}
+
+/*
+ * Moves the samples from first on to the front. If one dependency stops
+ * delivering, the other one drops its oldest samples instead of filling up.
+ */
+void CompositeSensorCore::keepUnpaired(std::vector<SensorValues>& values, size_t& count, size_t first) {
+  first = std::max(first, (count > values.size() / 2) ? count - values.size() / 2 : 0);
+  std::copy(values.begin() + first, values.begin() + count, values.begin());
+  count -= first;
 }
 
 bool CompositeSensorCore::readSensorTemperature(float* temperature) {
@@ -305,17 +395,16 @@ void CompositeSensorCore::initRodrParams(const android::vec3_t& acc) {
   CompositeSensorCore::initFusion(android::matrixToQuat(R));
 }
 
-SensorValues CompositeSensorCore::calculateGravity(std::vector<SensorValues> accValues,
-                                                   std::vector<SensorValues> gyroValues) {
+SensorValues CompositeSensorCore::calculateGravity(const SensorValues& accValue, const SensorValues& gyroValue) {
   android::vec3_t pulse;
   android::vec3_t accel;
   android::vec3_t g;
   float deltaTime;
-  SensorValues result;
+  SensorValues result{};
 
-  accel.x = accValues[0].data[0];
-  accel.y = accValues[0].data[1];
-  accel.z = accValues[0].data[2];
+  accel.x = accValue.data[0];
+  accel.y = accValue.data[1];
+  accel.z = accValue.data[2];
 
   if (mJustStarted) {
     CompositeSensorCore::initRodrParams(accel);
@@ -336,66 +425,43 @@ SensorValues CompositeSensorCore::calculateGravity(std::vector<SensorValues> acc
     update(unityA, mBa, p);
   }
 
-  pulse.x = gyroValues[0].data[0];
-  pulse.y = gyroValues[0].data[1];
-  pulse.z = gyroValues[0].data[2];
-  deltaTime = gyroValues[0].timestamp - mLastTimestamp;
-  mLastTimestamp = gyroValues[0].timestamp;
+  pulse.x = gyroValue.data[0];
+  pulse.y = gyroValue.data[1];
+  pulse.z = gyroValue.data[2];
+  deltaTime = gyroValue.timestamp - mLastTimestamp;
+  mLastTimestamp = gyroValue.timestamp;
 
   predict(pulse, deltaTime / 1e9f);
 
   const android::mat33_t R(android::quatToMatrix(mX0));
 
   g = R[2] * NOMINAL_GRAVITY;
-  result.data.push_back(g.x);
-  result.data.push_back(g.y);
-  result.data.push_back(g.z);
+  result.data = {g.x, g.y, g.z};
+  result.size = result.data.size();
   result.timestamp = mLastTimestamp;
 
   return result;
 }
 
 // TODO: use proper sensor fusion algorithm
-std::vector<SensorValues> LinearAcceleration::readSensorValues() {
-  std::vector<SensorValues> accValues{};
-  std::vector<SensorValues> gyroValues{};
-  SensorValues result;
-  std::vector<SensorValues> sensorValues{};
-  for (const auto& sensor : mDependencyList) {
-    if (sensor->getSensorData().type == BoschSensorType::ACCEL) {
-      accValues = sensor->readSensorValues();
-    } else if (sensor->getSensorData().type == BoschSensorType::GYRO) {
-      gyroValues = sensor->readSensorValues();
-    }
+size_t LinearAcceleration::readSensorValues(SensorValues* values, size_t capacity) {
+  // Buffered sensors may deliver several samples per read, pair them up
+  const size_t count = readDependencies(capacity);
+  for (size_t i = 0; i < count; i++) {
+    const SensorValues result = calculateGravity(mAccPairs[i], mGyroPairs[i]);
+    values[i] = mAccPairs[i];
+    values[i].data[0] -= result.data[0];
+    values[i].data[1] -= result.data[1];
+    values[i].data[2] -= result.data[2];
   }
 
-  result = calculateGravity(accValues, gyroValues);
-  accValues[0].data[0] -= result.data[0];
-  accValues[0].data[1] -= result.data[1];
-  accValues[0].data[2] -= result.data[2];
-
-  sensorValues.push_back(accValues[0]);
-
-  return sensorValues;
+  return count;
 }
 
 // TODO: use proper sensor fusion algorithm
-std::vector<SensorValues> Gravity::readSensorValues() {
-  std::vector<SensorValues> accValues{};
-  std::vector<SensorValues> gyroValues{};
-  SensorValues result;
-  std::vector<SensorValues> sensorValues{};
-  for (const auto& sensor : mDependencyList) {
-    if (sensor->getSensorData().type == BoschSensorType::ACCEL) {
-      accValues = sensor->readSensorValues();
-    } else if (sensor->getSensorData().type == BoschSensorType::GYRO) {
-      gyroValues = sensor->readSensorValues();
-    }
-  }
-
-  result = calculateGravity(accValues, gyroValues);
-
-  sensorValues.push_back(result);
+size_t Gravity::readSensorValues(SensorValues* values, size_t capacity) {
+  const size_t count = readDependencies(capacity);
+  for (size_t i = 0; i < count; i++) values[i] = calculateGravity(mAccPairs[i], mGyroPairs[i]);
 
-  return sensorValues;
+  return count;
 }
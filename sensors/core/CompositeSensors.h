@@ -17,6 +17,7 @@
 #ifndef ANDROID_HARDWARE_BOSCH_COMPOSITE_SENSORS_H
 #define ANDROID_HARDWARE_BOSCH_COMPOSITE_SENSORS_H
 
+#include <atomic>
 #include <memory>
 
 #include "SensorCore.h"
@@ -29,14 +30,22 @@ namespace sensors {
 
 class CompositeSensorCore : public ISensorHal {
 public:
-  CompositeSensorCore() = default;
+  CompositeSensorCore()
+    : mAccValues(MAX_READ_VALUES),
+      mGyroValues(MAX_READ_VALUES),
+      mAccPairs(MAX_READ_VALUES),
+      mGyroPairs(MAX_READ_VALUES) {}
   ~CompositeSensorCore() override = default;
 
   void activate(bool enable) override;
   void batch(int64_t samplingPeriodNs, int64_t maxReportLatencyNs) override;
   bool readSensorTemperature(float* temperature) override;
   const SensorData& getSensorData() const override { return mSensorData; }
+  float getHardwareRateHz() const override;
+  float getClockSkewPpm() const override;
+  bool setDataReadyTask(int taskId) override;
 
+  void setInstance(uint32_t instance, int32_t handle) { setSensorInstance(mSensorData, instance, handle); }
   const std::vector<std::shared_ptr<SensorCore>>& getDependencyList() const { return mDependencyList; }
 
   float mGyroVar = 0;
@@ -44,9 +53,23 @@ public:
 protected:
   SensorData mSensorData{};
   std::vector<std::shared_ptr<SensorCore>> mDependencyList{};
-  SensorValues calculateGravity(std::vector<SensorValues> accValues, std::vector<SensorValues> gyroValues);
+  std::vector<int> mConsumers{};
+  int mDataReadyTask{-1};
+  SensorValues calculateGravity(const SensorValues& accValue, const SensorValues& gyroValue);
+  size_t readDependencies(size_t capacity);
+
+  // Samples read from the dependencies that are not paired up yet, followed
+  // by the pairs of the last read. All are reused across reads.
+  std::vector<SensorValues> mAccValues;
+  std::vector<SensorValues> mGyroValues;
+  size_t mAccCount{0};
+  size_t mGyroCount{0};
+  std::vector<SensorValues> mAccPairs;
+  std::vector<SensorValues> mGyroPairs;
 
 private:
+  void keepUnpaired(std::vector<SensorValues>& values, size_t& count, size_t first);
+
   void initRodrParams(const android::vec3_t& acc);
   void predict(const android::vec3_t& w, float dT);
   void update(const android::vec3_t& z, const android::vec3_t& Bi, float sigma);
@@ -60,8 +83,10 @@ private:
   android::mat<android::mat33_t, 2, 2> mP;
   android::mat<android::mat33_t, 2, 2> mGQGt;
   int64_t mLastTimestamp{0};
-  bool mJustStarted;
-  int64_t mSamplingPeriodNs;
+  // Written by binder calls, read by the data path
+  std::atomic_bool mJustStarted{false};
+  std::atomic_bool mDropUnpaired{false};
+  std::atomic<int64_t> mSamplingPeriodNs{0};
 };
 
 class LinearAcceleration : public CompositeSensorCore {
@@ -69,7 +94,7 @@ public:
   LinearAcceleration() = default;
   ~LinearAcceleration() override = default;
 
-  std::vector<SensorValues> readSensorValues() override;
+  size_t readSensorValues(SensorValues* values, size_t capacity) override;
 };
 
 class Gravity : public CompositeSensorCore {
@@ -77,7 +102,7 @@ public:
   Gravity() = default;
   ~Gravity() override = default;
 
-  std::vector<SensorValues> readSensorValues() override;
+  size_t readSensorValues(SensorValues* values, size_t capacity) override;
 };
 
 }  // namespace sensors
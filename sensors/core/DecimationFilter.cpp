@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DecimationFilter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace bosch::sensors;
+
+namespace {
+
+using float4 = float __attribute__((vector_size(16)));
+
+/*
+ * The window is padded to whole vectors, so the loop maps onto NEON or SSE
+ * multiply-adds without a scalar tail. The loads may be unaligned as the
+ * window slides by one sample per input.
+ */
+float dotProduct(const float* samples, const float* coefficients, size_t length) {
+  float4 sum{};
+  for (size_t i = 0; i < length; i += 4) {
+    float4 x;
+    float4 h;
+    std::memcpy(&x, samples + i, sizeof(x));
+    std::memcpy(&h, coefficients + i, sizeof(h));
+    sum += x * h;
+  }
+  return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+
+}  // namespace
+
+size_t DecimationFilter::getCicFactor(DecimationFilterType type, size_t factor) {
+  if (type == DECIMATION_CIC) return factor;
+  if ((type != DECIMATION_FIR) || (factor <= MAX_FIR_FACTOR)) return 1;
+  return (factor + MAX_FIR_FACTOR - 1) / MAX_FIR_FACTOR;
+}
+
+size_t DecimationFilter::getSupportedFactor(DecimationFilterType type, size_t factor) {
+  factor = std::max<size_t>(factor, 1);
+  const size_t cicFactor = getCicFactor(type, factor);
+  return cicFactor * (factor / cicFactor);
+}
+
+void DecimationFilter::configure(DecimationFilterType type, size_t factor, size_t channels) {
+  mFactor = getSupportedFactor(type, factor);
+  mType = (mFactor > 1) ? type : DECIMATION_NONE;
+  mChannels = std::min(channels, MAX_CHANNELS);
+  mCicFactor = getCicFactor(mType, mFactor);
+  mFirFactor = (mType == DECIMATION_FIR) ? mFactor / mCicFactor : 1;
+  mDelay = 0.0;
+
+  if (mCicFactor > 1) {
+    mCicGain = 1.0 / std::pow(static_cast<double>(mCicFactor), CIC_STAGES);
+    mDelay += CIC_STAGES * (mCicFactor - 1) / 2.0;
+  }
+  if (mFirFactor > 1) designFir();
+  reset();
+}
+
+void DecimationFilter::reset() {
+  mPhase = 0;
+  mIsPrimed = false;
+  mLastOutputTimestamp = 0;
+}
+
+/*
+ * Hamming windowed sinc with the cutoff at the output Nyquist rate. The taps
+ * grow with the factor of the FIR stage to keep the transition band narrow.
+ */
+void DecimationFilter::designFir() {
+  const size_t taps = FIR_TAPS_PER_FACTOR * mFirFactor + 1;
+  const double cutoff = 0.5 / mFirFactor;
+  const double center = (taps - 1) / 2.0;
+
+  std::vector<double> response(taps);
+  double sum = 0.0;
+  for (size_t n = 0; n < taps; n++) {
+    const double x = n - center;
+    const double sinc = (x == 0.0) ? 2.0 * cutoff : std::sin(2.0 * M_PI * cutoff * x) / (M_PI * x);
+    const double window = 0.54 - 0.46 * std::cos(2.0 * M_PI * n / (taps - 1));
+    response[n] = sinc * window;
+    sum += response[n];
+  }
+
+  // Zero taps at the oldest end pad the window to whole vectors
+  mFirLength = (taps + 3) / 4 * 4;
+  mFirCoefficients.assign(mFirLength, 0.0f);
+  for (size_t n = 0; n < taps; n++) mFirCoefficients[mFirLength - taps + n] = response[n] / sum;
+  mFirHistory.assign(mChannels * 2 * mFirLength, 0.0f);
+  // The FIR runs on the outputs of the CIC, its delay counts in those
+  mDelay += center * mCicFactor;
+}
+
+/*
+ * Sets up the state as if the input had been constant so far: the FIR window
+ * is filled with it and the CIC is run through the length of its impulse
+ * response. The gain of both stages is one, so the CIC hands the same value
+ * on to the FIR.
+ */
+void DecimationFilter::prime(const int64_t* input, int64_t timestamp) {
+  if (mCicFactor > 1) {
+    mCicIntegrators = {};
+    mCicCombs = {};
+    std::array<float, MAX_CHANNELS> output{};
+    for (size_t i = 1; i <= CIC_STAGES * mCicFactor; i++) {
+      integrateCic(input);
+      if (i % mCicFactor == 0) filterCic(output.data());
+    }
+  }
+  if (mFirFactor > 1) {
+    for (size_t channel = 0; channel < mChannels; channel++) {
+      std::fill_n(&mFirHistory[channel * 2 * mFirLength], 2 * mFirLength, static_cast<float>(input[channel]));
+    }
+    mFirPosition = 0;
+  }
+
+  mReferenceTimestamp = timestamp;
+  mReferenceInputs = 0;
+  mIsPrimed = true;
+}
+
+bool DecimationFilter::process(const int64_t* input, int64_t timestamp, float* output, int64_t* outputTimestamp) {
+  if (mIsPrimed) {
+    mReferenceInputs++;
+  } else {
+    prime(input, timestamp);
+  }
+
+  mPhase++;
+  std::array<float, MAX_CHANNELS> stage{};
+  if (mCicFactor > 1) {
+    integrateCic(input);
+    if (mPhase % mCicFactor != 0) return false;
+    filterCic(stage.data());
+  } else {
+    for (size_t channel = 0; channel < mChannels; channel++) stage[channel] = static_cast<float>(input[channel]);
+  }
+  // Inputs that leave the window before the next output are not needed
+  if ((mFirFactor > 1) && ((mFactor - mPhase) / mCicFactor < mFirLength)) pushFir(stage.data());
+  if (mPhase < mFactor) return false;
+  mPhase = 0;
+
+  if (mFirFactor > 1) {
+    filterFir(output);
+  } else {
+    std::copy_n(stage.begin(), mChannels, output);
+  }
+  *outputTimestamp = getOutputTimestamp(timestamp);
+  return true;
+}
+
+void DecimationFilter::pushFir(const float* input) {
+  for (size_t channel = 0; channel < mChannels; channel++) {
+    float* history = &mFirHistory[channel * 2 * mFirLength];
+    history[mFirPosition] = input[channel];
+    history[mFirPosition + mFirLength] = history[mFirPosition];
+  }
+  mFirPosition = (mFirPosition + 1) % mFirLength;
+}
+
+void DecimationFilter::integrateCic(const int64_t* input) {
+  for (size_t channel = 0; channel < mChannels; channel++) {
+    uint64_t value = static_cast<uint64_t>(input[channel]);
+    for (auto& integrator : mCicIntegrators[channel]) {
+      integrator += value;
+      value = integrator;
+    }
+  }
+}
+
+void DecimationFilter::filterFir(float* output) const {
+  for (size_t channel = 0; channel < mChannels; channel++) {
+    const float* window = &mFirHistory[channel * 2 * mFirLength + mFirPosition];
+    output[channel] = dotProduct(window, mFirCoefficients.data(), mFirLength);
+  }
+}
+
+void DecimationFilter::filterCic(float* output) {
+  for (size_t channel = 0; channel < mChannels; channel++) {
+    uint64_t value = mCicIntegrators[channel].back();
+    for (auto& comb : mCicCombs[channel]) {
+      const uint64_t delayed = comb;
+      comb = value;
+      value -= delayed;
+    }
+    output[channel] = static_cast<float>(static_cast<int64_t>(value) * mCicGain);
+  }
+}
+
+/*
+ * The input period is measured over the inputs since the previous output,
+ * which keeps the group delay correct when the device runs faster than
+ * requested.
+ */
+int64_t DecimationFilter::getOutputTimestamp(int64_t timestamp) {
+  int64_t outputTimestamp = timestamp;
+  if ((mDelay > 0.0) && (mReferenceInputs > 0)) {
+    const double periodNs = static_cast<double>(timestamp - mReferenceTimestamp) / mReferenceInputs;
+    outputTimestamp -= static_cast<int64_t>(mDelay * periodNs);
+  }
+  mReferenceTimestamp = timestamp;
+  mReferenceInputs = 0;
+
+  // Jitter of the measured period must not reorder the outputs
+  outputTimestamp = std::max(outputTimestamp, mLastOutputTimestamp + 1);
+  mLastOutputTimestamp = outputTimestamp;
+  return outputTimestamp;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_BOSCH_DECIMATION_FILTER_H
+#define ANDROID_HARDWARE_BOSCH_DECIMATION_FILTER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ISensorHal.h"
+
+namespace bosch {
+namespace sensors {
+
+/*
+ * Reduces the samples of a device running at a high rate to the rate of one
+ * consumer. Every factor-th input completes an output sample, low pass
+ * filtered at the output Nyquist rate so that vibration above it does not
+ * alias into the decimated stream.
+ *
+ * The filter works on the raw integer values. The FIR only keeps the inputs
+ * that fall into its window and evaluates its taps for the samples that are
+ * handed out. The CIC integrates every input with wrapping integer adds, which
+ * is exact as long as the output fits into 64 bits.
+ *
+ * The FIR needs more taps the larger the factor is. Beyond MAX_FIR_FACTOR a
+ * CIC first decimates by a small factor, its nulls fall onto the bands that
+ * would alias, and the FIR takes the rest. The overall factor is then the
+ * largest one below the requested factor that splits into the two stages.
+ *
+ * The state is primed with the first input, so there is no start-up
+ * transient. Output timestamps are moved back by the group delay of the filter
+ * so that they match the signal.
+ */
+class DecimationFilter {
+public:
+  static constexpr size_t MAX_CHANNELS = 3;
+
+  // The factor the filter runs at for a requested factor, at most that
+  static size_t getSupportedFactor(DecimationFilterType type, size_t factor);
+
+  void configure(DecimationFilterType type, size_t factor, size_t channels);
+  void reset();
+
+  size_t getFactor() const { return mFactor; }
+  // Number of further inputs until the next output
+  size_t getPendingInputs() const { return mFactor - mPhase; }
+
+  // Returns true if the input completed an output sample
+  bool process(const int64_t* input, int64_t timestamp, float* output, int64_t* outputTimestamp);
+
+private:
+  static constexpr size_t FIR_TAPS_PER_FACTOR = 4;
+  static constexpr size_t MAX_FIR_TAPS = 128;
+  // Largest factor whose FIR, padded to whole vectors, fits into MAX_FIR_TAPS
+  static constexpr size_t MAX_FIR_FACTOR = (MAX_FIR_TAPS - 2) / FIR_TAPS_PER_FACTOR;
+  static constexpr size_t CIC_STAGES = 3;
+
+  static size_t getCicFactor(DecimationFilterType type, size_t factor);
+
+  void designFir();
+  void prime(const int64_t* input, int64_t timestamp);
+  void pushFir(const float* input);
+  void integrateCic(const int64_t* input);
+  void filterFir(float* output) const;
+  void filterCic(float* output);
+  int64_t getOutputTimestamp(int64_t timestamp);
+
+  DecimationFilterType mType{DECIMATION_NONE};
+  size_t mFactor{1};
+  // Factors of the CIC and the FIR stage, 1 for a stage that is not used
+  size_t mCicFactor{1};
+  size_t mFirFactor{1};
+  size_t mChannels{0};
+  size_t mPhase{0};
+  bool mIsPrimed{false};
+
+  // Window of the last inputs per channel, written twice so that it can be
+  // read as one contiguous block starting at mFirPosition
+  std::vector<float> mFirCoefficients{};
+  std::vector<float> mFirHistory{};
+  size_t mFirLength{0};
+  size_t mFirPosition{0};
+
+  std::array<std::array<uint64_t, CIC_STAGES>, MAX_CHANNELS> mCicIntegrators{};
+  std::array<std::array<uint64_t, CIC_STAGES>, MAX_CHANNELS> mCicCombs{};
+  double mCicGain{1.0};
+
+  // Group delay in inputs and the inputs the period is measured over
+  double mDelay{0.0};
+  int64_t mReferenceTimestamp{0};
+  size_t mReferenceInputs{0};
+  int64_t mLastOutputTimestamp{0};
+};
+
+}  // namespace sensors
+}  // namespace bosch
+
+#endif  // ANDROID_HARDWARE_BOSCH_DECIMATION_FILTER_H
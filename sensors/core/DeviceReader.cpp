@@ -0,0 +1,523 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DeviceReader.h"
+
+#include <errno.h>
+#include <log/log.h>
+#include <unistd.h>
+#include <utils/SystemClock.h>
+
+#include <algorithm>
+#include <limits>
+
+#include "SensorScheduler.h"
+
+using namespace bosch::sensors;
+
+/*
+ * Consumers polling at the same rate are not woken up in phase. A frame that
+ * is at most this fraction of a sampling period old is handed out again
+ * instead of reading the device twice.
+ */
+static constexpr int64_t POLL_TOLERANCE_DIVISOR = 8;
+
+namespace {
+
+struct PollGroup {
+  std::mutex mutex;
+  std::vector<DeviceReader*> readers;
+  // The readers of one poll, kept so that a poll does not allocate
+  std::vector<DeviceReader*> dueReaders;
+  bosch::hwctl::SysfsBatchReader batchReader;
+  std::vector<bosch::hwctl::SysfsRead> reads;
+};
+
+PollGroup& getPollGroup() {
+  static PollGroup group;
+  return group;
+}
+
+}  // namespace
+
+std::shared_ptr<DeviceReader> DeviceReader::getInstance(const std::string& device) {
+  static std::mutex instancesMutex;
+  static std::map<std::string, std::weak_ptr<DeviceReader>> instances;
+
+  std::lock_guard<std::mutex> lock(instancesMutex);
+  auto reader = instances[device].lock();
+  if (!reader) {
+    reader = std::make_shared<DeviceReader>(device, bosch::hwctl::getCharDevice(device));
+    instances[device] = reader;
+  }
+  return reader;
+}
+
+DeviceReader::DeviceReader(const std::string& device, const std::string& chardev)
+  : mDevice(device),
+    mBuffer(device, chardev),
+    mTrigger(device),
+    mBuffered(mBuffer.isAvailable()),
+    mTimestampEstimator(std::make_shared<TimestampEstimator>()),
+    mTimestampStream(mTimestampEstimator->addStream()),
+    mRing(BUFFER_LENGTH) {
+  if (mBuffered && (mBuffer.addTimestamp() != 0)) {
+    ALOGI("DeviceReader %s has no boottime timestamp channel, estimating timestamps", device.c_str());
+  }
+
+  if (mBuffered) {
+    mTaskId = SensorScheduler::getInstance().add([this](int64_t /* nowNs */) {
+      onDataReady();
+      return NO_DEADLINE;
+    });
+  } else {
+    auto& group = getPollGroup();
+    std::lock_guard<std::mutex> lock(group.mutex);
+    group.readers.push_back(this);
+    group.dueReaders.reserve(group.readers.size());
+  }
+}
+
+DeviceReader::~DeviceReader() {
+  if (mBuffered) {
+    if (mBuffer.isEnabled()) SensorScheduler::getInstance().unwatch(mBuffer.getFd());
+    SensorScheduler::getInstance().remove(mTaskId);
+    mBuffer.disable();
+    mTrigger.detach();
+  } else {
+    auto& group = getPollGroup();
+    std::lock_guard<std::mutex> lock(group.mutex);
+    group.readers.erase(std::remove(group.readers.begin(), group.readers.end(), this), group.readers.end());
+  }
+  mTimestampEstimator->removeStream(mTimestampStream);
+}
+
+int DeviceReader::subscribe(const std::array<std::string, 3>& sysfsRaw, float resolution,
+                            DecimationFilterType decimationFilter) {
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  Consumer consumer{};
+  consumer.resolution = resolution;
+  consumer.decimationFilterType = decimationFilter;
+  consumer.samplingPeriodNs = std::numeric_limits<int64_t>::max();
+  consumer.watermark = 1;
+  consumer.cursor = mHead;
+  consumer.dataReadyTask = -1;
+  for (const auto& file : sysfsRaw) {
+    if (file.empty()) break;
+
+    const int slot = addChannel(file);
+    if (slot < 0) {
+      ALOGW("DeviceReader no channel for %s", file.c_str());
+      return -1;
+    }
+    consumer.slots[consumer.channels++] = slot;
+  }
+  consumer.decimationFilter.configure(decimationFilter, 1, consumer.channels);
+
+  const int id = mNextConsumer++;
+  mConsumers[id] = consumer;
+  return id;
+}
+
+void DeviceReader::setEnabled(int consumer, bool enable) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  auto it = mConsumers.find(consumer);
+  if (it == mConsumers.end()) return;
+
+  it->second.enabled = enable;
+  it->second.cursor = mHead;
+  it->second.decimationFilter.reset();
+  updateDecimation();
+  if (mBuffered) {
+    updateWatermark();
+    updateBuffer();
+  } else {
+    // A newly enabled consumer must not wait for the next regular poll
+    updatePolledSlots();
+    mLastPollNs = 0;
+  }
+  mTimestampEstimator->setSamplingPeriod(mTimestampStream, getFramePeriod());
+  updateTrigger();
+}
+
+void DeviceReader::setSamplingPeriod(int consumer, int64_t samplingPeriodNs) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  auto it = mConsumers.find(consumer);
+  if (it != mConsumers.end()) it->second.samplingPeriodNs = samplingPeriodNs;
+  updateDecimation();
+  if (mBuffered) updateWatermark();
+  mTimestampEstimator->setSamplingPeriod(mTimestampStream, getFramePeriod());
+  updateTrigger();
+}
+
+void DeviceReader::setWatermark(int consumer, size_t watermark) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  auto it = mConsumers.find(consumer);
+  if (it == mConsumers.end()) return;
+
+  it->second.watermark = std::max<size_t>(watermark, 1);
+  if (mBuffered) updateWatermark();
+}
+
+/*
+ * The task is woken up once the consumer has reached its watermark, only
+ * buffered devices can do that.
+ */
+void DeviceReader::setDataReadyTask(int consumer, int taskId) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  auto it = mConsumers.find(consumer);
+  if (it != mConsumers.end()) it->second.dataReadyTask = taskId;
+}
+
+/*
+ * Buffered frames come at the rate the chip actually runs at, which can be
+ * faster than requested when it only supports discrete rates.
+ */
+void DeviceReader::setHardwarePeriod(int64_t hardwarePeriodNs) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (mHardwarePeriodNs == hardwarePeriodNs) return;
+
+  mHardwarePeriodNs = hardwarePeriodNs;
+  updateDecimation();
+  if (mBuffered) updateWatermark();
+  mTimestampEstimator->setSamplingPeriod(mTimestampStream, getFramePeriod());
+  updateTrigger();
+}
+
+/*
+ * Devices of one chip driven by the same oscillator can share an estimator,
+ * a stream that starts then locks with the clock skew already known.
+ */
+void DeviceReader::setTimestampEstimator(const std::shared_ptr<TimestampEstimator>& timestampEstimator) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (mTimestampEstimator == timestampEstimator) return;
+
+  mTimestampEstimator->removeStream(mTimestampStream);
+  mTimestampEstimator = timestampEstimator;
+  mTimestampStream = mTimestampEstimator->addStream();
+  mTimestampEstimator->setSamplingPeriod(mTimestampStream, getFramePeriod());
+}
+
+float DeviceReader::getClockSkewPpm() {
+  if (!mBuffered) return 0.0f;
+
+  // The estimator can be replaced by setTimestampEstimator()
+  std::shared_ptr<TimestampEstimator> timestampEstimator{};
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    timestampEstimator = mTimestampEstimator;
+  }
+  return timestampEstimator->getSkewPpm();
+}
+
+// Fastest period of all enabled consumers, 0 if none is enabled
+int64_t DeviceReader::getSamplingPeriod() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return getSamplingPeriodLocked();
+}
+
+size_t DeviceReader::getFifoLength() const {
+  if (!mBuffered) return 0;
+
+  const int hwFifoLength = mBuffer.getHwFifoLength();
+  return (hwFifoLength > 0) ? std::min<size_t>(hwFifoLength, BUFFER_LENGTH) : BUFFER_LENGTH;
+}
+
+/*
+ * Frames that do not fit into the values are left in the ring for the next
+ * read.
+ */
+int DeviceReader::read(int consumer, SensorValues* values, size_t capacity, size_t& count) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  count = 0;
+  auto it = mConsumers.find(consumer);
+  if ((it == mConsumers.end()) || !it->second.enabled) return -1;
+
+  acquire();
+
+  // A consumer that fell behind by more than the ring loses the oldest frames
+  auto& state = it->second;
+  if (mHead - state.cursor > BUFFER_LENGTH) state.cursor = mHead - BUFFER_LENGTH;
+
+  std::array<int64_t, DecimationFilter::MAX_CHANNELS> input{};
+  std::array<float, DecimationFilter::MAX_CHANNELS> output{};
+  for (; (state.cursor < mHead) && (count < capacity); state.cursor++) {
+    const auto& frame = mRing[state.cursor % BUFFER_LENGTH];
+    for (size_t channel = 0; channel < state.channels; channel++) input[channel] = frame.values[state.slots[channel]];
+
+    SensorValues& value = values[count];
+    if (!state.decimationFilter.process(input.data(), frame.timestamp, output.data(), &value.timestamp)) continue;
+    for (size_t channel = 0; channel < state.channels; channel++) {
+      value.data[channel] = output[channel] * state.resolution;
+    }
+    value.size = state.channels;
+    count++;
+  }
+  return 0;
+}
+
+int DeviceReader::addChannel(const std::string& sysfsRaw) {
+  // Scan elements are named like the raw attribute without the suffix. A new
+  // channel restarts an enabled buffer like a new watermark does.
+  if (mBuffered) {
+    const bool wasEnabled = mBuffer.isEnabled();
+    const int slot = mBuffer.addChannel(sysfsRaw.substr(0, sysfsRaw.rfind("_raw")));
+    if (wasEnabled) mTimestampEstimator->reset(mTimestampStream);
+    return slot;
+  }
+
+  for (size_t slot = 0; slot < mSysfsChannels.size(); slot++) {
+    if (mSysfsChannels[slot] == sysfsRaw) return slot;
+  }
+  if (mSysfsChannels.size() >= bosch::hwctl::IIO_MAX_CHANNELS) return -1;
+  if (access((mDevice + sysfsRaw).c_str(), R_OK) != 0) return -1;
+
+  mSysfsChannels.push_back(sysfsRaw);
+  return mSysfs.addFile(mDevice, sysfsRaw);
+}
+
+void DeviceReader::updateBuffer() {
+  const bool enable =
+    std::any_of(mConsumers.begin(), mConsumers.end(), [](const auto& consumer) { return consumer.second.enabled; });
+
+  if (enable && !mBuffer.isEnabled()) {
+    // The trigger can only be selected while the buffer is disabled
+    if (mTrigger.isAvailable() && (mTrigger.attach() != 0)) ALOGW("DeviceReader no trigger for %s", mDevice.c_str());
+    updateTrigger();
+    if (mBuffer.enable(BUFFER_LENGTH) != 0) {
+      ALOGE("DeviceReader enable buffer failed");
+      return;
+    }
+    mTimestampEstimator->reset(mTimestampStream);
+    SensorScheduler::getInstance().watch(mTaskId, mBuffer.getFd());
+  } else if (!enable && mBuffer.isEnabled()) {
+    stopBuffer();
+  }
+}
+
+void DeviceReader::stopBuffer() {
+  SensorScheduler::getInstance().unwatch(mBuffer.getFd());
+  mBuffer.disable();
+  mTrigger.detach();
+}
+
+/*
+ * The device must wake up the reader in time for the consumer with the
+ * shortest report latency, so the smallest watermark of all enabled consumers
+ * is used. A decimated consumer needs at least a full output sample.
+ */
+void DeviceReader::updateWatermark() {
+  size_t watermark = BUFFER_LENGTH;
+  bool enabled = false;
+  for (const auto& [_, consumer] : mConsumers) {
+    if (!consumer.enabled) continue;
+    watermark = std::min(watermark, std::max(consumer.watermark, consumer.decimationFilter.getFactor()));
+    enabled = true;
+  }
+  if (!enabled || (std::max<size_t>(watermark, 1) == mBuffer.getWatermark())) return;
+
+  // An enabled buffer is restarted and loses the queued scans, the sample
+  // clock is tracked anew from the next scan
+  if (mBuffer.setWatermark(watermark) != 0) {
+    ALOGD("DeviceReader watermark not supported");
+  } else if (mBuffer.isEnabled()) {
+    mTimestampEstimator->reset(mTimestampStream);
+  }
+}
+
+/*
+ * Each consumer takes every Nth frame of the device, with N the integer ratio
+ * of its period to the device period, rounded down to a factor its filter
+ * supports. A consumer whose factor changes starts its filter over.
+ */
+void DeviceReader::updateDecimation() {
+  const int64_t samplingPeriodNs = getFramePeriod();
+  for (auto& [_, consumer] : mConsumers) {
+    if (!consumer.enabled) continue;
+
+    size_t factor = 1;
+    if (samplingPeriodNs > 0) {
+      factor = std::clamp<int64_t>(consumer.samplingPeriodNs / samplingPeriodNs, 1, BUFFER_LENGTH);
+    }
+    factor = DecimationFilter::getSupportedFactor(consumer.decimationFilterType, factor);
+    if (factor != consumer.decimationFilter.getFactor()) {
+      consumer.decimationFilter.configure(consumer.decimationFilterType, factor, consumer.channels);
+    }
+  }
+}
+
+void DeviceReader::updateTrigger() {
+  if (mTrigger.isAttached() && (mTrigger.setSamplingPeriod(getFramePeriod()) != 0)) {
+    ALOGE("DeviceReader set trigger %s frequency failed", mTrigger.getName().c_str());
+  }
+}
+
+void DeviceReader::updatePolledSlots() {
+  mPolledSlots.clear();
+  for (const auto& [_, consumer] : mConsumers) {
+    if (!consumer.enabled) continue;
+    for (size_t channel = 0; channel < consumer.channels; channel++) {
+      const size_t slot = consumer.slots[channel];
+      if (std::find(mPolledSlots.begin(), mPolledSlots.end(), slot) == mPolledSlots.end()) {
+        mPolledSlots.push_back(slot);
+      }
+    }
+  }
+}
+
+void DeviceReader::acquire() {
+  if (mBuffered) {
+    drainBuffer();
+  } else {
+    pollDevice();
+  }
+}
+
+void DeviceReader::drainBuffer() {
+  if (!mBuffer.isEnabled()) return;
+
+  mScans.clear();
+  if (mBuffer.read(mScans) != 0) {
+    // The descriptor stays readable after an error, e.g. of a removed device,
+    // and would wake the scheduler again at once. The buffer is stopped until
+    // a consumer enables it again.
+    ALOGE("DeviceReader read buffer of %s failed: %d, buffer stopped", mDevice.c_str(), errno);
+    stopBuffer();
+    return;
+  }
+  if (mScans.empty()) return;
+
+  updateTimestamps();
+
+  for (size_t i = 0; i < mScans.size(); i++) {
+    mScans[i].timestamp = mTimestamps[i];
+    publish(mScans[i]);
+  }
+}
+
+void DeviceReader::onDataReady() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  drainBuffer();
+
+  // A decimated consumer is only woken up once its next output is complete
+  for (const auto& [_, consumer] : mConsumers) {
+    if (!consumer.enabled || (consumer.dataReadyTask < 0)) continue;
+    if (mHead - consumer.cursor >= std::max(consumer.watermark, consumer.decimationFilter.getPendingInputs())) {
+      SensorScheduler::getInstance().schedule(consumer.dataReadyTask, 0);
+    }
+  }
+}
+
+/*
+ * Reads this device together with all other polled devices that are due, so
+ * that their channels are fetched in one batch. The other readers are only
+ * included if they are not busy, the caller already holds its own lock.
+ */
+void DeviceReader::pollDevice() {
+  const int64_t now = ::android::elapsedRealtimeNano();
+  if (!isPollDue(now)) return;
+
+  auto& group = getPollGroup();
+  std::lock_guard<std::mutex> groupLock(group.mutex);
+
+  auto& readers = group.dueReaders;
+  readers.clear();
+  readers.push_back(this);
+  for (DeviceReader* reader : group.readers) {
+    if ((reader == this) || !reader->mMutex.try_lock()) continue;
+    if (reader->isPollDue(now)) {
+      readers.push_back(reader);
+    } else {
+      reader->mMutex.unlock();
+    }
+  }
+
+  group.reads.clear();
+  for (const DeviceReader* reader : readers) reader->addPolledReads(group.reads);
+  group.batchReader.read(group.reads);
+
+  const bosch::hwctl::SysfsRead* reads = group.reads.data();
+  for (DeviceReader* reader : readers) {
+    reader->publishPolledReads(reads, now);
+    reads += reader->mPolledSlots.size();
+    if (reader != this) reader->mMutex.unlock();
+  }
+}
+
+bool DeviceReader::isPollDue(int64_t nowNs) const {
+  if (mPolledSlots.empty()) return false;
+
+  const int64_t samplingPeriodNs = getSamplingPeriodLocked();
+  return (mLastPollNs == 0) || (nowNs - mLastPollNs >= samplingPeriodNs - samplingPeriodNs / POLL_TOLERANCE_DIVISOR);
+}
+
+void DeviceReader::addPolledReads(std::vector<bosch::hwctl::SysfsRead>& reads) const {
+  for (const size_t slot : mPolledSlots) reads.push_back({mSysfs.getFd(slot), 0, -1});
+}
+
+void DeviceReader::publishPolledReads(const bosch::hwctl::SysfsRead* reads, int64_t nowNs) {
+  bosch::hwctl::IioScan frame{};
+  frame.timestamp = nowNs;
+  for (size_t i = 0; i < mPolledSlots.size(); i++) {
+    if (reads[i].status != 0) {
+      ALOGE("DeviceReader read %s failed", mSysfsChannels[mPolledSlots[i]].c_str());
+      return;
+    }
+    frame.values[mPolledSlots[i]] = reads[i].value;
+  }
+
+  mLastPollNs = nowNs;
+  publish(frame);
+}
+
+void DeviceReader::publish(const bosch::hwctl::IioScan& frame) {
+  mRing[mHead % BUFFER_LENGTH] = frame;
+  mHead++;
+}
+
+/*
+ * The kernel timestamps are taken in the interrupt handler and jitter with
+ * its latency, they are smoothed like the read times of devices without a
+ * timestamp channel.
+ */
+void DeviceReader::updateTimestamps() {
+  mTimestamps.resize(mScans.size());
+
+  const bool hardwareTimestamps =
+    std::all_of(mScans.begin(), mScans.end(), [](const auto& scan) { return scan.timestamp > 0; });
+  if (hardwareTimestamps) {
+    for (size_t i = 0; i < mScans.size(); i++) mTimestamps[i] = mScans[i].timestamp;
+  } else {
+    // Scans are queued in the kernel at the device rate, the newest one was
+    // captured at the latest just now
+    std::fill(mTimestamps.begin(), mTimestamps.end(), 0);
+    mTimestamps.back() = ::android::elapsedRealtimeNano();
+  }
+  mTimestampEstimator->update(mTimestampStream, mTimestamps);
+}
+
+int64_t DeviceReader::getSamplingPeriodLocked() const {
+  int64_t samplingPeriodNs = std::numeric_limits<int64_t>::max();
+  for (const auto& [_, consumer] : mConsumers) {
+    if (consumer.enabled) samplingPeriodNs = std::min(samplingPeriodNs, consumer.samplingPeriodNs);
+  }
+  return (samplingPeriodNs == std::numeric_limits<int64_t>::max()) ? 0 : samplingPeriodNs;
+}
+
+int64_t DeviceReader::getFramePeriod() const {
+  return (mBuffered && (mHardwarePeriodNs > 0)) ? mHardwarePeriodNs : getSamplingPeriodLocked();
+}
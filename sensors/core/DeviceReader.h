@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_BOSCH_DEVICE_READER_H
+#define ANDROID_HARDWARE_BOSCH_DEVICE_READER_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "DecimationFilter.h"
+#include "FileHandler.h"
+#include "IioBuffer.h"
+#include "IioTrigger.h"
+#include "ISensorHal.h"
+#include "SysfsBatchReader.h"
+#include "TimestampEstimator.h"
+
+namespace bosch {
+namespace sensors {
+
+/*
+ * Acquisition engine of one physical device, shared by all logical sensors
+ * using it. Every channel is read once per hardware sample, either from the
+ * IIO buffer or by polling sysfs, and the frames are published to a ring.
+ * Each consumer has its own cursor into the ring, independent of the rate at
+ * which the other consumers read.
+ *
+ * The device runs at the fastest rate of all consumers. A slower consumer
+ * gets the frames decimated to its own rate through its anti-alias filter
+ * instead of every frame.
+ *
+ * Buffered frames are stamped on the sample clock of the chip, which is
+ * tracked from the kernel capture times if the device has a timestamp
+ * channel and from the read times otherwise.
+ *
+ * Polled devices that are due at the same time are read together in one
+ * batch, through io_uring where available.
+ *
+ * Buffered capture is paced by the data-ready trigger of the device, or by an
+ * hrtimer trigger at the fastest rate of all consumers if it has none.
+ *
+ * The character device of a buffered device is watched by the scheduler. When
+ * the kernel buffer reaches its watermark the scans are drained and the tasks
+ * of all consumers that have reached their own watermark are woken up.
+ */
+class DeviceReader {
+public:
+  static std::shared_ptr<DeviceReader> getInstance(const std::string& device);
+
+  DeviceReader(const std::string& device, const std::string& chardev);
+  ~DeviceReader();
+
+  bool isBuffered() const { return mBuffered; }
+  bool hasTimestamp() const { return mBuffer.hasTimestamp(); }
+
+  int subscribe(const std::array<std::string, 3>& sysfsRaw, float resolution, DecimationFilterType decimationFilter);
+  void setEnabled(int consumer, bool enable);
+  void setSamplingPeriod(int consumer, int64_t samplingPeriodNs);
+  void setWatermark(int consumer, size_t watermark);
+  void setDataReadyTask(int consumer, int taskId);
+  void setHardwarePeriod(int64_t hardwarePeriodNs);
+  void setTimestampEstimator(const std::shared_ptr<TimestampEstimator>& timestampEstimator);
+  float getClockSkewPpm();
+  int64_t getSamplingPeriod();
+  size_t getFifoLength() const;
+  int read(int consumer, SensorValues* values, size_t capacity, size_t& count);
+
+private:
+  static constexpr size_t BUFFER_LENGTH = 512;
+
+  struct Consumer {
+    std::array<int, 3> slots;
+    size_t channels;
+    float resolution;
+    bool enabled;
+    int64_t samplingPeriodNs;
+    size_t watermark;
+    uint64_t cursor;
+    int dataReadyTask;
+    DecimationFilterType decimationFilterType;
+    DecimationFilter decimationFilter;
+  };
+
+  int addChannel(const std::string& sysfsRaw);
+  void updateBuffer();
+  void stopBuffer();
+  void updateWatermark();
+  void updateDecimation();
+  void updateTrigger();
+  void updatePolledSlots();
+  void acquire();
+  void drainBuffer();
+  void onDataReady();
+  void pollDevice();
+  bool isPollDue(int64_t nowNs) const;
+  void addPolledReads(std::vector<bosch::hwctl::SysfsRead>& reads) const;
+  void publishPolledReads(const bosch::hwctl::SysfsRead* reads, int64_t nowNs);
+  void publish(const bosch::hwctl::IioScan& frame);
+  void updateTimestamps();
+  int64_t getSamplingPeriodLocked() const;
+  int64_t getFramePeriod() const;
+
+  const std::string mDevice;
+  bosch::hwctl::IioBuffer mBuffer;
+  bosch::hwctl::IioTrigger mTrigger;
+  bool mBuffered;
+  std::vector<bosch::hwctl::IioScan> mScans{};
+  std::vector<int64_t> mTimestamps{};
+  std::shared_ptr<TimestampEstimator> mTimestampEstimator;
+  int mTimestampStream;
+  int mTaskId{-1};
+  int64_t mHardwarePeriodNs{0};
+
+  bosch::hwctl::RawSysfsHandler mSysfs{};
+  std::vector<std::string> mSysfsChannels{};
+  std::vector<size_t> mPolledSlots{};
+  int64_t mLastPollNs{0};
+
+  std::vector<bosch::hwctl::IioScan> mRing;
+  uint64_t mHead{0};
+
+  std::map<int, Consumer> mConsumers{};
+  int mNextConsumer{0};
+  std::mutex mMutex;
+};
+
+}  // namespace sensors
+}  // namespace bosch
+
+#endif  // ANDROID_HARDWARE_BOSCH_DEVICE_READER_H
@@ -60,6 +60,21 @@ bool DirectChannelBase::isValid() { return mBuffer != nullptr; }
 
 int DirectChannelBase::getError() { return mError; }
 
+void DirectChannelBase::setRate(int32_t sensorHandle, int64_t periodNs) {
+  rateNs.set(sensorHandle, periodNs);
+  sampleCount.set(sensorHandle, 0);
+}
+
+bool DirectChannelBase::isSampleDue(int32_t sensorHandle, int64_t samplingPeriodNs) {
+  const int64_t periodNs = rateNs.get(sensorHandle);
+  if (periodNs == 0) return false;  // Not configured for this channel or stopped
+
+  int32_t& count = sampleCount[sensorHandle];
+  if (samplingPeriodNs * ++count < periodNs) return false;  // Sensor samples faster than the channel rate
+  count = 0;
+  return true;
+}
+
 void DirectChannelBase::write(const sensors_event_t* ev) {
   if (isValid()) {
     mBuffer->write(ev, 1);
@@ -21,10 +21,11 @@
 #include <hardware/sensors.h>
 #include <utils/threads.h>
 
-#include <map>
 #include <memory>
 #include <vector>
 
+#include "HandleTable.h"
+
 namespace android {
 
 struct LockfreeBuffer {
@@ -53,9 +54,16 @@ public:
   int getError();
   void write(const sensors_event_t* ev);
 
+  // Sets the report period of a sensor, zero stops it
+  void setRate(int32_t sensorHandle, int64_t periodNs);
+  // Counts a sample of the sensor and tells whether the channel reports it
+  bool isSampleDue(int32_t sensorHandle, int64_t samplingPeriodNs);
+
   std::vector<int32_t> sensorHandles;
-  std::map<int32_t, int64_t> rateNs;
-  std::map<int32_t, int32_t> sampleCount;
+  // Indexed by the sensor handle, a sensor that was never configured has a
+  // zero rate
+  ::bosch::sensors::HandleTable<int64_t> rateNs;
+  ::bosch::sensors::HandleTable<int32_t> sampleCount;
 
 protected:
   int mError = NO_INIT;
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_BOSCH_EVENT_COALESCER_H
+#define ANDROID_HARDWARE_BOSCH_EVENT_COALESCER_H
+
+#include <log/log.h>
+#include <utils/SystemClock.h>
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "Arena.h"
+#include "ISensorHal.h"
+#include "SensorScheduler.h"
+
+namespace bosch {
+namespace sensors {
+
+/*
+ * Collects the events all sensors post within the coalescing window and hands
+ * them to the writer at once, so that the framework gets one queue write and
+ * one wake up per window instead of one per sensor. The events of a sensor
+ * keep their order, the writer gets the number of wake up events in the batch.
+ *
+ * The window starts with the first event of a batch. A zero window still
+ * merges the sensors that are due in the same scheduler pass.
+ *
+ * If the writer has a capacity, a batch only gets written as far as it fits.
+ * Of the rest, flush completes, dynamic sensor connections and wake up events
+ * are kept and written again after EVENT_RETRY_PERIOD_NS, the other events
+ * are dropped. The framework would otherwise wait forever for a flush or
+ * sleep through a wake up event.
+ */
+template <typename Event>
+class EventCoalescer {
+public:
+  using Writer = std::function<void(const std::vector<Event>& events, size_t wakeUpEvents)>;
+  using Capacity = std::function<size_t()>;
+
+  explicit EventCoalescer(Writer writer, Capacity capacity = nullptr, int64_t windowNs = EVENT_COALESCING_WINDOW_NS)
+    : mWriter(std::move(writer)), mCapacity(std::move(capacity)), mWindowNs(windowNs) {
+    mTaskId = SensorScheduler::getInstance().add([this](int64_t nowNs) {
+      return flush() ? nowNs + EVENT_RETRY_PERIOD_NS : NO_DEADLINE;
+    });
+  }
+
+  ~EventCoalescer() { SensorScheduler::getInstance().remove(mTaskId); }
+
+  EventCoalescer(const EventCoalescer&) = delete;
+  EventCoalescer& operator=(const EventCoalescer&) = delete;
+
+  void post(const std::vector<Event>& events, bool wakeup) {
+    if (events.empty()) return;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    const bool isFirst = mEvents.empty();
+    mEvents.append(events);
+    mWakeUp.append(events.size(), wakeup);
+    if (isFirst) SensorScheduler::getInstance().schedule(mTaskId, ::android::elapsedRealtimeNano() + mWindowNs);
+  }
+
+  /*
+   * Writes the collected events, returns whether events are kept for a retry
+   */
+  bool flush() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mEvents.empty()) return false;
+
+    const size_t count = mEvents.size();
+    const size_t available = mCapacity ? std::min(mCapacity(), count) : count;
+    if (available == count) {
+      mWriter(mEvents.get(), countWakeUps(count));
+      mEvents.clear();
+      mWakeUp.clear();
+      return false;
+    }
+
+    if (available > 0) {
+      mBatch.clear();
+      for (size_t i = 0; i < available; i++) mBatch.push_back(mEvents[i]);
+      mWriter(mBatch.get(), countWakeUps(available));
+    }
+
+    // Moves the events that must be delivered to the front, in order
+    size_t kept = 0;
+    for (size_t i = available; i < count; i++) {
+      if (!mustDeliver(mEvents[i], mWakeUp[i]) || ((kept >= MAX_READ_VALUES) && !isFlushComplete(mEvents[i]))) {
+        continue;
+      }
+      mEvents[kept] = mEvents[i];
+      mWakeUp[kept] = mWakeUp[i];
+      kept++;
+    }
+    mEvents.truncate(kept);
+    mWakeUp.truncate(kept);
+    ALOGW("Event queue full, wrote %zu of %zu events, dropped %zu, retrying %zu", available, count,
+          count - available - kept, kept);
+    return kept > 0;
+  }
+
+  // Regrowths of the batch arenas, stays constant in the steady state
+  uint64_t getArenaRegrowths() const {
+    return mEvents.getRegrowths() + mWakeUp.getRegrowths() + mBatch.getRegrowths();
+  }
+
+private:
+  static bool isFlushComplete(const Event& event) { return event.sensorType == decltype(event.sensorType)::META_DATA; }
+
+  static bool mustDeliver(const Event& event, bool wakeup) {
+    return wakeup || isFlushComplete(event) || (event.sensorType == decltype(event.sensorType)::DYNAMIC_SENSOR_META);
+  }
+
+  // Counts the wake up events among the first count events
+  size_t countWakeUps(size_t count) {
+    size_t wakeUps = 0;
+    for (size_t i = 0; i < count; i++) wakeUps += mWakeUp[i];
+    return wakeUps;
+  }
+
+  Writer mWriter;
+  Capacity mCapacity;
+  const int64_t mWindowNs;
+  int mTaskId{-1};
+
+  std::mutex mMutex;
+  Arena<Event> mEvents{MAX_READ_VALUES};
+  // Whether the event at the same index comes from a wake up sensor
+  Arena<uint8_t> mWakeUp{MAX_READ_VALUES};
+  // The part of a batch that fits into a full queue
+  Arena<Event> mBatch{MAX_READ_VALUES};
+};
+
+}  // namespace sensors
+}  // namespace bosch
+
+#endif  // ANDROID_HARDWARE_BOSCH_EVENT_COALESCER_H
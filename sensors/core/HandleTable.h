@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_BOSCH_HANDLE_TABLE_H
+#define ANDROID_HARDWARE_BOSCH_HANDLE_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace bosch {
+namespace sensors {
+
+/*
+ * One column of per sensor state, indexed by the sensor handle. The handles
+ * of a HAL are small and dense, so a lookup is a bounds check and a load
+ * instead of a tree walk, and the tables of several columns form a structure
+ * of arrays that the data path walks with few cache misses.
+ *
+ * The table only grows in set(), which is meant for the configuration path.
+ * get() returns the default value for a handle that was never set.
+ */
+template <typename T>
+class HandleTable {
+public:
+  explicit HandleTable(T defaultValue = T{}) : mDefault(defaultValue) {}
+
+  T get(int32_t handle) const { return contains(handle) ? mValues[handle] : mDefault; }
+  bool contains(int32_t handle) const { return (handle >= 0) && (static_cast<size_t>(handle) < mValues.size()); }
+
+  void set(int32_t handle, T value) {
+    if (handle < 0) return;
+    if (!contains(handle)) mValues.resize(handle + 1, mDefault);
+    mValues[handle] = std::move(value);
+  }
+
+  // Only for handles that were set before, for the data path
+  T& operator[](int32_t handle) { return mValues[handle]; }
+
+  void clear() { mValues.clear(); }
+
+  // Visits the handles with a value other than the default in handle order
+  template <typename Visitor>
+  void forEach(Visitor visitor) const {
+    for (size_t handle = 0; handle < mValues.size(); handle++) {
+      if (!(mValues[handle] == mDefault)) visitor(static_cast<int32_t>(handle), mValues[handle]);
+    }
+  }
+
+private:
+  T mDefault;
+  std::vector<T> mValues;
+};
+
+}  // namespace sensors
+}  // namespace bosch
+
+#endif  // ANDROID_HARDWARE_BOSCH_HANDLE_TABLE_H
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "HotplugMonitor.h"
+
+#include <errno.h>
+#include <log/log.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "IioBuffer.h"
+#include "IioDeviceIndex.h"
+
+using namespace bosch::sensors;
+
+HotplugMonitor::HotplugMonitor(Callback callback) : mCallback(std::move(callback)) {
+  if (!mUevents.isOpen()) return;
+
+  mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+  mEventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if ((mEpollFd < 0) || (mEventFd < 0)) {
+    ALOGE("HotplugMonitor creating file descriptors failed: %d", errno);
+    return;
+  }
+
+  for (const int fd : {mUevents.getFd(), mEventFd}) {
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &event) != 0) ALOGE("HotplugMonitor epoll_ctl failed: %d", errno);
+  }
+
+  mThread = std::thread(&HotplugMonitor::run, this);
+}
+
+HotplugMonitor::~HotplugMonitor() {
+  if (mThread.joinable()) {
+    const uint64_t value = 1;
+    (void)::write(mEventFd, &value, sizeof(value));
+    mThread.join();
+  }
+
+  for (const int fd : {mEpollFd, mEventFd}) {
+    if (fd >= 0) close(fd);
+  }
+}
+
+void HotplugMonitor::run() {
+  while (true) {
+    epoll_event events[2];
+    const int count = epoll_wait(mEpollFd, events, 2, mPending.empty() ? -1 : CHARDEV_RETRY_PERIOD_MS);
+    if (count < 0) {
+      if (errno == EINTR) continue;
+      ALOGE("HotplugMonitor epoll_wait failed: %d", errno);
+      return;
+    }
+
+    for (int i = 0; i < count; i++) {
+      if (events[i].data.fd == mEventFd) return;
+    }
+    if (count == 0) {
+      retryPending();
+      continue;
+    }
+
+    std::vector<bosch::hwctl::Uevent> uevents{};
+    bool isLost = false;
+    if (mUevents.read(uevents) != 0) {
+      isLost = (errno == ENOBUFS);
+      if (!isLost) ALOGW("HotplugMonitor reading uevents failed: %d", errno);
+    }
+    for (const auto& uevent : uevents) dispatch(uevent);
+    if (isLost) resynchronize();
+  }
+}
+
+/*
+ * The socket overflowed and some uevents are lost. The bus is compared with
+ * the index and each difference is handed on as the event that was lost.
+ */
+void HotplugMonitor::resynchronize() {
+  ALOGW("HotplugMonitor lost uevents, rescanning the IIO bus");
+  std::vector<std::string> added{};
+  std::vector<std::string> removed{};
+  bosch::hwctl::IioDeviceIndex::getInstance().findChanges(added, removed);
+
+  for (const auto& device : removed) dispatch({bosch::hwctl::Uevent::REMOVE, device});
+  for (const auto& device : added) dispatch({bosch::hwctl::Uevent::ADD, device});
+}
+
+void HotplugMonitor::dispatch(const bosch::hwctl::Uevent& event) {
+  const auto pending = std::find_if(mPending.begin(), mPending.end(),
+                                    [&](const auto& entry) { return entry.device == event.device; });
+  if (event.action == bosch::hwctl::Uevent::REMOVE) {
+    // A device removed before it was ready was never handed on
+    if (pending != mPending.end()) {
+      mPending.erase(pending);
+      return;
+    }
+  } else if (pending != mPending.end()) {
+    return;
+  } else {
+    const std::string path = bosch::hwctl::IioDeviceIndex::getInstance().getDevicePath(event.device);
+    if (!bosch::hwctl::isCharDeviceReady(path)) {
+      mPending.push_back({event.device, 0});
+      return;
+    }
+  }
+  mCallback(event);
+}
+
+/*
+ * A device whose character device does not become ready in time is handed on
+ * anyway and is then polled through sysfs.
+ */
+void HotplugMonitor::retryPending() {
+  auto& index = bosch::hwctl::IioDeviceIndex::getInstance();
+  for (auto it = mPending.begin(); it != mPending.end();) {
+    const bool isReady = bosch::hwctl::isCharDeviceReady(index.getDevicePath(it->device));
+    if (!isReady && (++it->retries < CHARDEV_RETRIES)) {
+      ++it;
+      continue;
+    }
+
+    if (!isReady) ALOGW("HotplugMonitor %s has no readable character device, polling it", it->device.c_str());
+    const std::string device = it->device;
+    it = mPending.erase(it);
+    mCallback({bosch::hwctl::Uevent::ADD, device});
+  }
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_BOSCH_HOTPLUG_MONITOR_H
+#define ANDROID_HARDWARE_BOSCH_HOTPLUG_MONITOR_H
+
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "UeventMonitor.h"
+
+namespace bosch {
+namespace sensors {
+
+/*
+ * Waits for IIO devices to be added or removed on a thread of its own. The
+ * callback may take its time to set up or tear down sensors, the scheduler
+ * thread that runs the data path is not involved.
+ *
+ * The kernel announces a device before ueventd has created its character
+ * device. An added device with a buffer is held back until the node is
+ * readable, so that it is not bound for sysfs polling for good.
+ */
+class HotplugMonitor {
+public:
+  using Callback = std::function<void(const bosch::hwctl::Uevent& event)>;
+
+  explicit HotplugMonitor(Callback callback);
+  ~HotplugMonitor();
+
+  HotplugMonitor(const HotplugMonitor&) = delete;
+  HotplugMonitor& operator=(const HotplugMonitor&) = delete;
+
+private:
+  static constexpr int CHARDEV_RETRY_PERIOD_MS = 50;
+  static constexpr int CHARDEV_RETRIES = 40;
+
+  struct PendingDevice {
+    std::string device;
+    int retries;
+  };
+
+  void run();
+  void resynchronize();
+  void dispatch(const bosch::hwctl::Uevent& event);
+  void retryPending();
+
+  bosch::hwctl::UeventMonitor mUevents{};
+  // Added devices whose character device is not ready yet
+  std::vector<PendingDevice> mPending{};
+  Callback mCallback;
+  int mEpollFd{-1};
+  int mEventFd{-1};
+  std::thread mThread;
+};
+
+}  // namespace sensors
+}  // namespace bosch
+
+#endif  // ANDROID_HARDWARE_BOSCH_HOTPLUG_MONITOR_H
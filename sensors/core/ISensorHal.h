@@ -31,13 +31,26 @@ namespace sensors {
  */
 constexpr float POLL_TIME_REDUCTION_FACTOR = 1.0f;
 
+/*
+ * Events of all sensors that are posted within this window are written to the
+ * framework together. Bounds the latency added to an event.
+ */
+constexpr int64_t EVENT_COALESCING_WINDOW_NS = 1000000;
+
+/*
+ * Events that did not fit into a full framework queue and must not get lost,
+ * flush completes and wake up events, are written again after this period.
+ */
+constexpr int64_t EVENT_RETRY_PERIOD_NS = 10000000;
+
 enum BoschSensorType {
-  ACCEL = 1,                // SensorType::ACCELEROMETER
-  GYRO = 4,                 // SensorType::GYROSCOPE
-  GRAVITY = 9,              // SensorType::GRAVITY
-  LINEAR_ACCEL = 10,        // SensorType::LINEAR_ACCELERATION
-  GYRO_UNCALIBRATED = 16,   // SensorType::GYROSCOPE_UNCALIBRATED
-  ACCEL_UNCALIBRATED = 35,  // SensorType::ACCELEROMETER_UNCALIBRATED
+  ACCEL = 1,                 // SensorType::ACCELEROMETER
+  GYRO = 4,                  // SensorType::GYROSCOPE
+  GRAVITY = 9,               // SensorType::GRAVITY
+  LINEAR_ACCEL = 10,         // SensorType::LINEAR_ACCELERATION
+  GYRO_UNCALIBRATED = 16,    // SensorType::GYROSCOPE_UNCALIBRATED
+  DYNAMIC_SENSOR_META = 32,  // SensorType::DYNAMIC_SENSOR_META
+  ACCEL_UNCALIBRATED = 35,   // SensorType::ACCELEROMETER_UNCALIBRATED
 };
 
 enum SensorReportingMode {
@@ -47,6 +60,30 @@ enum SensorReportingMode {
   SPECIAL_REPORTING = 3,
 };
 
+/*
+ * How the sampling deadlines of a sensor advance. FREE_RUNNING restarts the
+ * period after every read, so read latency lowers the delivered rate, and
+ * serves as timeout for sensors woken up by their device. PHASE_LOCKED_SKIP
+ * keeps a fixed grid of absolute deadlines for polled sensors and skips ticks
+ * that were missed, reading the raw attributes late can not recover them.
+ */
+enum SamplingMode {
+  FREE_RUNNING = 0,
+  PHASE_LOCKED_SKIP = 1,
+};
+
+/*
+ * Anti-alias filter of a consumer that is decimated from the faster rate the
+ * device runs at for another consumer. DECIMATION_NONE hands out every Nth
+ * sample unfiltered, DECIMATION_CIC is a cheap 3 stage CIC with passband
+ * droop and DECIMATION_FIR a flat windowed-sinc low pass.
+ */
+enum DecimationFilterType {
+  DECIMATION_NONE = 0,
+  DECIMATION_CIC = 1,
+  DECIMATION_FIR = 2,
+};
+
 struct SensorData {
   std::string vendor{"Robert Bosch GmbH"};
   std::string driverName;
@@ -62,23 +99,67 @@ struct SensorData {
   float temperatureScale;
   float temperatureOffset;
   SensorReportingMode reportMode;
+  DecimationFilterType decimationFilter{DECIMATION_FIR};
+  uint32_t fifoReservedEventCount{0};
+  uint32_t fifoMaxEventCount{0};
+  // Chip of the same type the sensor belongs to and its stable handle, both
+  // assigned by the sensor list
+  uint32_t instance{0};
+  int32_t handle{0};
 };
 
+/*
+ * Sensors of further chips of the same type get a numbered name so that they
+ * can be told apart in the sensor list.
+ */
+inline void setSensorInstance(SensorData& data, uint32_t instance, int32_t handle) {
+  data.instance = instance;
+  data.handle = handle;
+  if (instance > 0) data.sensorName += " " + std::to_string(instance + 1);
+}
+
+/*
+ * Fixed-capacity sample, so that reading a sensor does not allocate. size is
+ * the number of valid entries in data.
+ */
 struct SensorValues {
   int64_t timestamp;
-  std::vector<float> data;
+  std::array<float, 3> data;
+  size_t size;
 };
 
+// Most samples a sensor hands out per read, any further ones stay for the next
+constexpr size_t MAX_READ_VALUES = 512;
+
+/*
+ * Events a polled sensor batches in software, the sensor has the whole FIFO
+ * for itself.
+ */
+constexpr uint32_t SOFTWARE_FIFO_LENGTH = 256;
+
 class ISensorHal {
 public:
   ISensorHal() = default;
   virtual ~ISensorHal() = default;
 
-  virtual std::vector<SensorValues> readSensorValues() = 0;
+  // Fills at most capacity values and returns how many were read
+  virtual size_t readSensorValues(SensorValues* values, size_t capacity) = 0;
   virtual bool readSensorTemperature(float* temperature) = 0;
   virtual void activate(bool enable) = 0;
   virtual void batch(int64_t samplingPeriodNs, int64_t maxReportLatencyNs) = 0;
   virtual const SensorData& getSensorData() const = 0;
+
+  // Rate the chip runs at while enabled, 0 if unknown
+  virtual float getHardwareRateHz() const { return 0.0f; }
+  // Estimated deviation of the chip clock from its nominal rate
+  virtual float getClockSkewPpm() const { return 0.0f; }
+
+  // Asks the sensor to wake the scheduler task up when new samples are ready.
+  // Returns false if the sensor has to be polled.
+  virtual bool setDataReadyTask(int taskId) {
+    (void)taskId;
+    return false;
+  }
 };
 
 }  // namespace sensors
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_BOSCH_ODR_TABLE_H
+#define ANDROID_HARDWARE_BOSCH_ODR_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace bosch {
+namespace sensors {
+
+/*
+ * One output data rate of a chip and the sysfs value that selects it. Where the
+ * chip couples the filter bandwidth to the rate, the value selects both.
+ */
+struct OdrSetting {
+  int64_t periodNs;
+  const char* value;
+};
+
+/*
+ * Returns the index of the slowest setting that is at least as fast as
+ * requested, or of the fastest one if no setting is. The table must be sorted
+ * from the slowest to the fastest rate.
+ */
+template <typename Table>
+size_t selectOdr(const Table& table, int64_t samplingPeriodNs) {
+  for (size_t i = 0; i < table.size(); i++) {
+    if (table[i].periodNs <= samplingPeriodNs) return i;
+  }
+  return table.size() - 1;
+}
+
+}  // namespace sensors
+}  // namespace bosch
+
+#endif  // ANDROID_HARDWARE_BOSCH_ODR_TABLE_H
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PowerStateMachine.h"
+
+#include <utils/SystemClock.h>
+
+using namespace bosch::sensors;
+
+PowerStateMachine::PowerStateMachine(const std::array<int64_t, MAX_UNITS>& settleTimesNs,
+                                     WritePowerMode writePowerMode)
+  : mSettleTimesNs(settleTimesNs), mWritePowerMode(std::move(writePowerMode)) {
+  for (auto& settledNs : mSettledNs) settledNs = NO_DEADLINE;
+  mTaskId = SensorScheduler::getInstance().add([this](int64_t nowNs) { return onTimer(nowNs); });
+}
+
+PowerStateMachine::~PowerStateMachine() { SensorScheduler::getInstance().remove(mTaskId); }
+
+void PowerStateMachine::request(size_t unit, bool enable) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  mRequested[unit] = enable;
+
+  // Further requests within the window are applied together with this one
+  if (!mIsPending) {
+    mIsPending = true;
+    SensorScheduler::getInstance().schedule(mTaskId, ::android::elapsedRealtimeNano() + COALESCE_WINDOW_NS);
+  }
+}
+
+PowerStateMachine::State PowerStateMachine::getState(size_t unit, int64_t nowNs) const {
+  const int64_t settledNs = mSettledNs[unit].load();
+  if (settledNs == NO_DEADLINE) return OFF;
+  return (nowNs < settledNs) ? STARTING : SETTLED;
+}
+
+int64_t PowerStateMachine::onTimer(int64_t /* nowNs */) {
+  std::array<bool, MAX_UNITS> requested{};
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    requested = mRequested;
+    mIsPending = false;
+  }
+
+  for (size_t unit = 0; unit < MAX_UNITS; unit++) {
+    if (requested[unit] == mApplied[unit]) continue;
+
+    // Samples are invalid from the moment the write starts
+    mSettledNs[unit] = NO_DEADLINE;
+    mWritePowerMode(unit, requested[unit]);
+    mApplied[unit] = requested[unit];
+    if (requested[unit]) mSettledNs[unit] = ::android::elapsedRealtimeNano() + mSettleTimesNs[unit];
+  }
+
+  return NO_DEADLINE;
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_BOSCH_POWER_STATE_MACHINE_H
+#define ANDROID_HARDWARE_BOSCH_POWER_STATE_MACHINE_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+#include "SensorScheduler.h"
+
+namespace bosch {
+namespace sensors {
+
+/*
+ * Power state of the sensing units of one chip. Requests return immediately,
+ * the power mode is written from the scheduler thread a short time later so
+ * that back to back enables of several units end up in one transition.
+ *
+ * A unit is STARTING from the write until its settle time has elapsed and its
+ * output is not valid yet. Samples taken before that are to be dropped.
+ */
+class PowerStateMachine {
+public:
+  enum State { OFF, STARTING, SETTLED };
+
+  static constexpr size_t MAX_UNITS = 2;
+
+  // Writes the power mode of one unit, called without holding any lock
+  using WritePowerMode = std::function<void(size_t unit, bool enable)>;
+
+  PowerStateMachine(const std::array<int64_t, MAX_UNITS>& settleTimesNs, WritePowerMode writePowerMode);
+  ~PowerStateMachine();
+
+  PowerStateMachine(const PowerStateMachine&) = delete;
+  PowerStateMachine& operator=(const PowerStateMachine&) = delete;
+
+  void request(size_t unit, bool enable);
+
+  State getState(size_t unit, int64_t nowNs) const;
+  bool isSettled(size_t unit, int64_t timestampNs) const { return timestampNs >= mSettledNs[unit].load(); }
+
+private:
+  static constexpr int64_t COALESCE_WINDOW_NS = 2000000;
+
+  int64_t onTimer(int64_t nowNs);
+
+  const std::array<int64_t, MAX_UNITS> mSettleTimesNs;
+  const WritePowerMode mWritePowerMode;
+
+  std::mutex mMutex;
+  std::array<bool, MAX_UNITS> mRequested{};
+  std::array<bool, MAX_UNITS> mApplied{};
+  bool mIsPending{false};
+
+  // Time from which the output of a unit is valid, NO_DEADLINE while it is off
+  std::array<std::atomic<int64_t>, MAX_UNITS> mSettledNs;
+
+  int mTaskId{-1};
+};
+
+}  // namespace sensors
+}  // namespace bosch
+
+#endif  // ANDROID_HARDWARE_BOSCH_POWER_STATE_MACHINE_H
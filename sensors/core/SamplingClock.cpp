@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SamplingClock.h"
+
+using namespace bosch::sensors;
+
+void SamplingClock::setPeriod(int64_t periodNs) {
+  // The running deadline is kept, the new period applies from the next tick
+  mPeriodNs = periodNs;
+}
+
+void SamplingClock::start() {
+  mDeadlineNs = 0;
+  mTicks = 0;
+  mSkippedTicks = 0;
+  mFirstTickNs = 0;
+  mLastTickNs = 0;
+}
+
+void SamplingClock::stop() { mDeadlineNs = NO_DEADLINE; }
+
+void SamplingClock::advance(int64_t nowNs) {
+  if (!isRunning()) return;
+
+  if (mTicks++ == 0) mFirstTickNs = nowNs;
+  mLastTickNs = nowNs;
+
+  if (mMode == FREE_RUNNING) {
+    mDeadlineNs = nowNs + mPeriodNs * mTimeoutPeriods;
+    return;
+  }
+  if ((mDeadlineNs == 0) || (mPeriodNs <= 0)) {
+    mDeadlineNs = nowNs + mPeriodNs;
+    return;
+  }
+
+  mDeadlineNs += mPeriodNs;
+  if (mDeadlineNs > nowNs) return;
+
+  // Ticks were missed, the grid is moved forward past them
+  const uint64_t missedTicks = (nowNs - mDeadlineNs) / mPeriodNs + 1;
+  mDeadlineNs += missedTicks * mPeriodNs;
+  mSkippedTicks += missedTicks;
+}
+
+SamplingStats SamplingClock::getStats() const {
+  SamplingStats stats{};
+  stats.requestedRateHz = (mPeriodNs > 0) ? 1e9f / mPeriodNs : 0.0f;
+  stats.ticks = mTicks;
+  stats.skippedTicks = mSkippedTicks;
+  if ((mTicks > 1) && (mLastTickNs > mFirstTickNs)) {
+    stats.achievedRateHz = (mTicks - 1) * 1e9f / (mLastTickNs - mFirstTickNs);
+  }
+  return stats;
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_BOSCH_SAMPLING_CLOCK_H
+#define ANDROID_HARDWARE_BOSCH_SAMPLING_CLOCK_H
+
+#include <cstdint>
+
+#include "ISensorHal.h"
+#include "SensorScheduler.h"
+
+namespace bosch {
+namespace sensors {
+
+/*
+ * Sampling configuration of a sensor as set by the framework. The binder
+ * threads publish it through a SeqLock and the data path applies it on its
+ * next run. A changed generation restarts the corresponding clock.
+ */
+struct SamplingConfig {
+  int64_t reportPeriodNs;
+  // Report latency a polled sensor batches its events for in software
+  int64_t reportLatencyNs;
+  int64_t directChannelRateNs;
+  uint32_t reportGeneration;
+  uint32_t directChannelGeneration;
+  bool isEnabled;
+  bool directChannelEnabled;
+};
+
+/*
+ * Number of report periods a sensor that is woken up by its device waits for
+ * data before it reads the device anyway.
+ */
+constexpr int64_t DATA_READY_TIMEOUT_PERIODS = 4;
+
+/*
+ * Time a control call waits for the data path to apply a new configuration.
+ */
+constexpr int64_t CONFIG_APPLY_TIMEOUT_NS = 100000000;
+
+struct SamplingStats {
+  float requestedRateHz;
+  float achievedRateHz;
+  // Filled in by the sensor, the clock does not know the chip
+  float hardwareRateHz;
+  float clockSkewPpm;
+  uint64_t ticks;
+  uint64_t skippedTicks;
+  // Regrowths of the arenas of the data path, see Arena. Stays constant in the
+  // steady state. Only the multihal dump shows it, the AIDL and 2.X HALs have
+  // no dump and log it when the sensor is deactivated.
+  uint64_t arenaRegrowths;
+};
+
+/*
+ * Periodic deadline of a sensor in CLOCK_BOOTTIME. The clock is due
+ * immediately after start() and the first tick sets the phase of all
+ * following deadlines.
+ *
+ * A free running clock can be used as a timeout that is restarted by every
+ * tick, it is then due after the given number of periods without a tick.
+ */
+class SamplingClock {
+public:
+  explicit SamplingClock(SamplingMode mode = PHASE_LOCKED_SKIP) : mMode(mode) {}
+
+  void setMode(SamplingMode mode) { mMode = mode; }
+  void setPeriod(int64_t periodNs);
+  void setTimeoutPeriods(int64_t periods) { mTimeoutPeriods = periods; }
+  void start();
+  void stop();
+
+  bool isRunning() const { return mDeadlineNs != NO_DEADLINE; }
+  bool isDue(int64_t nowNs) const { return nowNs >= mDeadlineNs; }
+  int64_t getDeadline() const { return mDeadlineNs; }
+  void advance(int64_t nowNs);
+
+  SamplingStats getStats() const;
+
+private:
+  SamplingMode mMode;
+  int64_t mPeriodNs{0};
+  int64_t mTimeoutPeriods{1};
+  int64_t mDeadlineNs{NO_DEADLINE};
+
+  uint64_t mTicks{0};
+  uint64_t mSkippedTicks{0};
+  int64_t mFirstTickNs{0};
+  int64_t mLastTickNs{0};
+};
+
+}  // namespace sensors
+}  // namespace bosch
+
+#endif  // ANDROID_HARDWARE_BOSCH_SAMPLING_CLOCK_H
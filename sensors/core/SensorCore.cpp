@@ -18,15 +18,69 @@
 
 #include <fcntl.h>
 #include <log/log.h>
-#include <utils/SystemClock.h>
 
 #include <algorithm>
 
 using namespace bosch::sensors;
 
+SensorCore::~SensorCore() {
+  if (mIsEnabled && mTemperatureSampler) mTemperatureSampler->setEnabled(false);
+}
+
 void SensorCore::setDevice(const std::string& device) {
   mDevice = device;
-  mFileHandler.init(mDevice, mSensorData.sysfsRaw);
+
+  // All logical sensors of the device share one reader, which prefers the
+  // IIO buffer and falls back to sysfs polling if it is not exposed
+  mReader = DeviceReader::getInstance(mDevice);
+  mConsumer = mReader->subscribe(mSensorData.sysfsRaw, mSensorData.resolution, mSensorData.decimationFilter);
+  if (mConsumer < 0) {
+    ALOGE("%s has no readable channels", mSensorData.sensorName.c_str());
+  } else {
+    mConsumers[mSensorData.type] = mConsumer;
+  }
+  ALOGD("%s uses %s", mSensorData.sensorName.c_str(), mReader->isBuffered() ? "iio buffer" : "sysfs polling");
+  if (mTimestampEstimator) mReader->setTimestampEstimator(mTimestampEstimator);
+
+  if (!mSensorData.temperatureSysfsRaw.empty()) {
+    mTemperatureSampler = TemperatureSampler::getInstance(mDevice, mSensorData.temperatureSysfsRaw);
+  }
+
+  // Samples collected by the device are batched in its FIFO, those of a
+  // polled device in a software FIFO of the sensor
+  if (mReader->isBuffered()) {
+    mSensorData.fifoMaxEventCount = std::min<uint32_t>(mSensorData.fifoMaxEventCount, mReader->getFifoLength());
+    mSensorData.fifoReservedEventCount = std::min(mSensorData.fifoReservedEventCount, mSensorData.fifoMaxEventCount);
+  } else {
+    mSensorData.fifoMaxEventCount = SOFTWARE_FIFO_LENGTH;
+    mSensorData.fifoReservedEventCount = SOFTWARE_FIFO_LENGTH;
+  }
+}
+
+/*
+ * The estimator can be set before or after the device, it is shared by all
+ * sensors of a chip.
+ */
+void SensorCore::setTimestampEstimator(const std::shared_ptr<TimestampEstimator>& timestampEstimator) {
+  mTimestampEstimator = timestampEstimator;
+  if (mReader) mReader->setTimestampEstimator(mTimestampEstimator);
+}
+
+int SensorCore::addConsumer(BoschSensorType type) {
+  if (mConsumer < 0) return -1;
+  const int consumer = mReader->subscribe(mSensorData.sysfsRaw, mSensorData.resolution, mSensorData.decimationFilter);
+  if (consumer >= 0) mConsumers[type] = consumer;
+  return consumer;
+}
+
+void SensorCore::setConsumerEnabled(int consumer, bool enable) {
+  if (consumer >= 0) mReader->setEnabled(consumer, enable);
+}
+
+bool SensorCore::setConsumerDataReadyTask(int consumer, int taskId) {
+  if ((consumer < 0) || !mReader->isBuffered()) return false;
+  mReader->setDataReadyTask(consumer, taskId);
+  return true;
 }
 
 void SensorCore::activate(bool enable) { activateByType(mSensorData.type, enable); }
@@ -40,19 +94,30 @@ void SensorCore::activateByType(BoschSensorType type, bool enable) {
   if (isEnabled != mIsEnabled) {
     mIsEnabled = isEnabled;
     setPowerMode(isEnabled);
-    updateSamplingRate();
+    if (mTemperatureSampler) mTemperatureSampler->setEnabled(isEnabled);
   }
+
+  // The consumer is switched first so that the device rate accounts for it
+  auto consumer = mConsumers.find(type);
+  if (consumer != mConsumers.end()) setConsumerEnabled(consumer->second, enable);
+  updateSamplingRate();
 }
 
 void SensorCore::batch(int64_t samplingPeriodNs, int64_t maxReportLatencyNs) {
   batchByType(mSensorData.type, samplingPeriodNs, maxReportLatencyNs);
 }
 
-void SensorCore::batchByType(BoschSensorType type, int64_t samplingPeriodNs, int64_t) {
+void SensorCore::batchByType(BoschSensorType type, int64_t samplingPeriodNs, int64_t maxReportLatencyNs) {
   mSamplingPeriods[type] = samplingPeriodNs;
+  mReportLatencies[type] = maxReportLatencyNs;
   updateSamplingRate();
 }
 
+/*
+ * The chip runs at the fastest rate of all enabled types, and of the other
+ * sensors sharing the device. Every type is read through its own consumer at
+ * its own rate, which the reader decimates to.
+ */
 void SensorCore::updateSamplingRate() {
   int64_t usedSamplingPeriod = mSensorData.maxDelayUs * 1000;
 
@@ -62,37 +127,70 @@ void SensorCore::updateSamplingRate() {
     }
   }
 
-  setSamplingRate(usedSamplingPeriod);
+  for (const auto& [type, consumer] : mConsumers) mReader->setSamplingPeriod(consumer, getSamplingPeriod(type));
+  const int64_t devicePeriodNs = (mConsumer >= 0) ? mReader->getSamplingPeriod() : 0;
+  if (devicePeriodNs > 0) usedSamplingPeriod = std::min(usedSamplingPeriod, devicePeriodNs);
+
+  const int64_t hardwarePeriodNs = setSamplingRate(usedSamplingPeriod);
+  if ((mHardwarePeriodNs.exchange(hardwarePeriodNs) != hardwarePeriodNs) && (hardwarePeriodNs > 0)) {
+    ALOGD("%s runs at %.2f Hz", mSensorData.sensorName.c_str(), 1e9f / hardwarePeriodNs);
+  }
+
+  if (mConsumer < 0) return;
+  mReader->setHardwarePeriod(hardwarePeriodNs);
+  for (const auto& [type, consumer] : mConsumers) {
+    mReader->setWatermark(consumer, getWatermark(type, hardwarePeriodNs));
+  }
 }
 
-bool SensorCore::readSensorTemperature(float* temperature) {
-  if (mSensorData.temperatureSysfsRaw.empty()) return false;
+float SensorCore::getHardwareRateHz() const {
+  const int64_t hardwarePeriodNs = mHardwarePeriodNs.load();
+  return (mIsEnabled && (hardwarePeriodNs > 0)) ? 1e9f / hardwarePeriodNs : 0.0f;
+}
 
-  std::string data;
-  bosch::hwctl::ReadHandler fileHandler(mDevice, mSensorData.temperatureSysfsRaw);
+int64_t SensorCore::getSamplingPeriod(BoschSensorType type) {
+  const auto samplingPeriod = mSamplingPeriods.find(type);
+  return (samplingPeriod != mSamplingPeriods.end()) ? samplingPeriod->second : mSensorData.maxDelayUs * 1000;
+}
 
-  if (0 == fileHandler.read(data)) {
-    *temperature = (::atof(data.c_str()) + mSensorData.temperatureOffset) * mSensorData.temperatureScale;
-    return true;
-  } else {
-    ALOGE("Sensor readSensorTemperature failed");
-    return false;
-  }
+/*
+ * Number of samples the device may collect at the given period before the
+ * type has to be read to meet its report latency.
+ */
+size_t SensorCore::getWatermark(BoschSensorType type, int64_t samplingPeriodNs) {
+  if ((samplingPeriodNs <= 0) || (mSensorData.fifoMaxEventCount == 0)) return 1;
+
+  const auto reportLatency = mReportLatencies.find(type);
+  if (reportLatency == mReportLatencies.end()) return 1;
+
+  return std::clamp<int64_t>(reportLatency->second / samplingPeriodNs, 1, mSensorData.fifoMaxEventCount);
 }
 
-std::vector<SensorValues> SensorCore::readSensorValues() {
-  std::vector<SensorValues> sensorValues{};
-  readPollingData(sensorValues);
-  return sensorValues;
+/*
+ * Returns the latest value of the background sampler, the attribute is not
+ * read here.
+ */
+bool SensorCore::readSensorTemperature(float* temperature) {
+  int raw = 0;
+  if (!mTemperatureSampler || !mTemperatureSampler->getRaw(raw)) return false;
+
+  *temperature = (raw + mSensorData.temperatureOffset) * mSensorData.temperatureScale;
+  return true;
 }
 
-void SensorCore::readPollingData(std::vector<SensorValues>& values) {
-  SensorValues value{};
-  value.timestamp = ::android::elapsedRealtimeNano();
-  const int status = mFileHandler.read(value.data, mSensorData.resolution);
-  if (status != 0) {
-    ALOGE("Sensor readPollingData failed");
-    return;
+size_t SensorCore::readSensorValues(SensorValues* values, size_t capacity) {
+  return readSensorValues(mConsumer, values, capacity);
+}
+
+size_t SensorCore::readSensorValues(int consumer, SensorValues* values, size_t capacity) {
+  size_t count = 0;
+  if ((consumer < 0) || (mReader->read(consumer, values, capacity, count) != 0)) {
+    ALOGE("Sensor readSensorValues failed");
+    return 0;
   }
-  values.push_back(value);
+
+  // Samples from before the chip has settled are dropped
+  const auto end =
+    std::remove_if(values, values + count, [this](const SensorValues& value) { return !isSettled(value.timestamp); });
+  return end - values;
 }
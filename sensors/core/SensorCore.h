@@ -17,11 +17,15 @@
 #ifndef ANDROID_HARDWARE_BOSCH_SENSOR_CORE_H
 #define ANDROID_HARDWARE_BOSCH_SENSOR_CORE_H
 
+#include <atomic>
 #include <cmath>
 #include <map>
+#include <memory>
 
+#include "DeviceReader.h"
 #include "FileHandler.h"
 #include "ISensorHal.h"
+#include "TemperatureSampler.h"
 
 namespace bosch {
 namespace sensors {
@@ -32,38 +36,65 @@ constexpr float degreeToRad(float degree) { return degree * M_PI / 180.0f; }
 class SensorCore : public ISensorHal {
 public:
   SensorCore() = default;
-  ~SensorCore() override = default;
+  ~SensorCore() override;
 
-  std::vector<SensorValues> readSensorValues() override;
+  size_t readSensorValues(SensorValues* values, size_t capacity) override;
+  size_t readSensorValues(int consumer, SensorValues* values, size_t capacity);
   bool readSensorTemperature(float* temperature) override;
   void activate(bool enable) override;
   void batch(int64_t samplingPeriodNs, int64_t maxReportLatencyNs) override;
   const SensorData& getSensorData() const override { return mSensorData; }
+  float getHardwareRateHz() const override;
+  float getClockSkewPpm() const override { return mReader ? mReader->getClockSkewPpm() : 0.0f; }
+  bool setDataReadyTask(int taskId) override { return setConsumerDataReadyTask(mConsumer, taskId); }
 
+  virtual void setInstance(uint32_t instance, int32_t handle) { setSensorInstance(mSensorData, instance, handle); }
   void setDevice(const std::string& device);
+  void setTimestampEstimator(const std::shared_ptr<TimestampEstimator>& timestampEstimator);
   void setAvailable(bool available) { mAvailable = available; }
   bool isAvailable() const { return mAvailable; }
+  bool isBuffered() const { return mReader && mReader->isBuffered(); }
 
   void activateByType(BoschSensorType type, bool enable);
   void batchByType(BoschSensorType type, int64_t samplingPeriodNs, int64_t maxReportLatencyNs);
 
+  int addConsumer(BoschSensorType type);
+  void setConsumerEnabled(int consumer, bool enable);
+  bool setConsumerDataReadyTask(int consumer, int taskId);
+
 protected:
   virtual void setPowerMode(bool enable) { (void)enable; };
-  virtual void setSamplingRate(int64_t samplingPeriodNs) { (void)samplingPeriodNs; };
+  // Programs the rate the period needs and returns the period the chip runs at
+  virtual int64_t setSamplingRate(int64_t samplingPeriodNs) { return samplingPeriodNs; };
+  // Whether the chip output was valid at the given time after power up
+  virtual bool isSettled(int64_t timestampNs) const {
+    (void)timestampNs;
+    return true;
+  };
 
   std::string mDevice{};
   SensorData mSensorData{};
 
 private:
   void updateSamplingRate();
-  void readPollingData(std::vector<SensorValues>& values);
+  int64_t getSamplingPeriod(BoschSensorType type);
+  size_t getWatermark(BoschSensorType type, int64_t samplingPeriodNs);
 
   bool mAvailable{false};
   bool mIsEnabled{false};
   std::map<BoschSensorType, bool> mEnableState{};
   std::map<BoschSensorType, int64_t> mSamplingPeriods{};
+  std::map<BoschSensorType, int64_t> mReportLatencies{};
+
+  // Read by the data path for the sampling statistics
+  std::atomic<int64_t> mHardwarePeriodNs{0};
 
-  bosch::hwctl::RawSysfsHandler mFileHandler;
+  std::shared_ptr<DeviceReader> mReader{};
+  std::shared_ptr<TimestampEstimator> mTimestampEstimator{};
+  std::shared_ptr<TemperatureSampler> mTemperatureSampler{};
+  int mConsumer{-1};
+  // Consumer of each logical type, the sensor's own type is mConsumer
+  std::map<BoschSensorType, int> mConsumers{};
 };
 
 }  // namespace sensors
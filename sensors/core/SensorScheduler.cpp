@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SensorScheduler.h"
+
+#include <errno.h>
+#include <log/log.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <utils/SystemClock.h>
+
+#include <algorithm>
+
+using namespace bosch::sensors;
+
+static constexpr int MAX_EPOLL_EVENTS = 8;
+
+SensorScheduler::SensorScheduler() {
+  mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+  mTimerFd = timerfd_create(CLOCK_BOOTTIME, TFD_CLOEXEC | TFD_NONBLOCK);
+  mEventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if ((mEpollFd < 0) || (mTimerFd < 0) || (mEventFd < 0)) {
+    ALOGE("SensorScheduler creating file descriptors failed: %d", errno);
+  }
+
+  for (const int fd : {mTimerFd, mEventFd}) {
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &event) != 0) ALOGE("SensorScheduler epoll_ctl failed: %d", errno);
+  }
+
+  mThread = std::thread(&SensorScheduler::run, this);
+}
+
+SensorScheduler::~SensorScheduler() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStopThread = true;
+  }
+  wakeUp();
+  mThread.join();
+
+  for (const int fd : {mEpollFd, mTimerFd, mEventFd}) {
+    if (fd >= 0) close(fd);
+  }
+}
+
+int SensorScheduler::add(Task task) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  const int id = mNextId++;
+  mTasks[id] = {std::move(task), NO_DEADLINE, NO_DEADLINE};
+  return id;
+}
+
+void SensorScheduler::remove(int id) {
+  std::unique_lock<std::mutex> lock(mMutex);
+
+  // The task may capture an object that is about to be destroyed, wait until
+  // it has returned unless it removes itself
+  if (std::this_thread::get_id() != mThread.get_id()) {
+    mRunningCV.wait(lock, [&] { return mRunningId != id; });
+  }
+  mTasks.erase(id);
+}
+
+/*
+ * Replaces the deadline of a task. A deadline requested while the task is
+ * running is combined with the one the task returns.
+ */
+void SensorScheduler::schedule(int id, int64_t deadlineNs) {
+  std::unique_lock<std::mutex> lock(mMutex);
+  auto it = mTasks.find(id);
+  if (it == mTasks.end()) return;
+
+  if (mRunningId == id) {
+    it->second.requestedNs = std::min(it->second.requestedNs, deadlineNs);
+    return;
+  }
+
+  it->second.deadlineNs = deadlineNs;
+  if (deadlineNs == NO_DEADLINE) return;
+
+  const bool isEarliest = mDeadlines.empty() || (deadlineNs < mDeadlines.top().deadlineNs);
+  mDeadlines.push({deadlineNs, id});
+  lock.unlock();
+
+  if (isEarliest) wakeUp();
+}
+
+int SensorScheduler::watch(int id, int fd) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  epoll_event event{};
+  event.events = EPOLLIN;
+  event.data.fd = fd;
+  if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+    ALOGE("SensorScheduler watch failed: %d", errno);
+    return -1;
+  }
+  mWatches[fd] = id;
+  return 0;
+}
+
+/*
+ * Must be called before the descriptor is closed, an event that is already
+ * pending is dropped.
+ */
+void SensorScheduler::unwatch(int fd) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (mWatches.erase(fd) == 0) return;
+  if (epoll_ctl(mEpollFd, EPOLL_CTL_DEL, fd, nullptr) != 0) ALOGE("SensorScheduler unwatch failed: %d", errno);
+}
+
+void SensorScheduler::run() {
+  std::unique_lock<std::mutex> lock(mMutex);
+
+  while (!mStopThread) {
+    // Entries of removed or rescheduled tasks are dropped lazily
+    while (!mDeadlines.empty()) {
+      const auto it = mTasks.find(mDeadlines.top().id);
+      if ((it != mTasks.end()) && (it->second.deadlineNs == mDeadlines.top().deadlineNs)) break;
+      mDeadlines.pop();
+    }
+
+    const int64_t nowNs = ::android::elapsedRealtimeNano();
+    if (!mDeadlines.empty() && (mDeadlines.top().deadlineNs <= nowNs)) {
+      const int id = mDeadlines.top().id;
+      mDeadlines.pop();
+
+      auto& state = mTasks[id];
+      state.deadlineNs = NO_DEADLINE;
+      state.requestedNs = NO_DEADLINE;
+      mRunningId = id;
+
+      lock.unlock();
+      int64_t deadlineNs = state.task(nowNs);
+      lock.lock();
+
+      mRunningId = -1;
+      mRunningCV.notify_all();
+
+      auto it = mTasks.find(id);
+      if (it == mTasks.end()) continue;
+      deadlineNs = std::min(deadlineNs, it->second.requestedNs);
+      it->second.deadlineNs = deadlineNs;
+      if (deadlineNs != NO_DEADLINE) mDeadlines.push({deadlineNs, id});
+      continue;
+    }
+
+    armTimer(mDeadlines.empty() ? NO_DEADLINE : mDeadlines.top().deadlineNs);
+    lock.unlock();
+
+    epoll_event events[MAX_EPOLL_EVENTS];
+    const int count = epoll_wait(mEpollFd, events, MAX_EPOLL_EVENTS, -1);
+    if ((count < 0) && (errno != EINTR)) {
+      ALOGE("SensorScheduler epoll_wait failed: %d", errno);
+      usleep(1000);
+    }
+
+    lock.lock();
+    for (int i = 0; i < count; i++) {
+      const int fd = events[i].data.fd;
+      if ((fd == mTimerFd) || (fd == mEventFd)) {
+        uint64_t value = 0;
+        (void)::read(fd, &value, sizeof(value));
+        continue;
+      }
+
+      // The watching task is due now, the data is read by the task itself
+      const auto watch = mWatches.find(fd);
+      if (watch == mWatches.end()) continue;
+      auto task = mTasks.find(watch->second);
+      if ((task == mTasks.end()) || (task->second.deadlineNs == 0)) continue;
+      task->second.deadlineNs = 0;
+      mDeadlines.push({0, watch->second});
+    }
+  }
+}
+
+void SensorScheduler::wakeUp() {
+  const uint64_t value = 1;
+  (void)::write(mEventFd, &value, sizeof(value));
+}
+
+void SensorScheduler::armTimer(int64_t deadlineNs) {
+  itimerspec spec{};
+  if (deadlineNs != NO_DEADLINE) {
+    // A zero expiration would disarm the timer
+    deadlineNs = std::max<int64_t>(deadlineNs, 1);
+    spec.it_value.tv_sec = deadlineNs / 1000000000;
+    spec.it_value.tv_nsec = deadlineNs % 1000000000;
+  }
+  if (timerfd_settime(mTimerFd, TFD_TIMER_ABSTIME, &spec, nullptr) != 0) {
+    ALOGE("SensorScheduler timerfd_settime failed: %d", errno);
+  }
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_BOSCH_SENSOR_SCHEDULER_H
+#define ANDROID_HARDWARE_BOSCH_SENSOR_SCHEDULER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace bosch {
+namespace sensors {
+
+constexpr int64_t NO_DEADLINE = std::numeric_limits<int64_t>::max();
+
+/*
+ * Runs the sampling tasks of all sensors on one thread. Deadlines are
+ * absolute CLOCK_BOOTTIME times, the same clock as elapsedRealtimeNano(), and
+ * are kept in a min-heap. The thread sleeps on a timerfd armed for the
+ * earliest deadline.
+ *
+ * A task is called with the current time and returns its next deadline, or
+ * NO_DEADLINE to stay idle until it is scheduled again. A task can also watch
+ * a file descriptor, it is then run as soon as the descriptor is readable and
+ * must consume the data, the descriptor is level triggered.
+ */
+class SensorScheduler {
+public:
+  using Task = std::function<int64_t(int64_t nowNs)>;
+
+  static SensorScheduler& getInstance() {
+    static SensorScheduler instance;
+    return instance;
+  }
+
+  ~SensorScheduler();
+
+  int add(Task task);
+  void remove(int id);
+  void schedule(int id, int64_t deadlineNs);
+  int watch(int id, int fd);
+  void unwatch(int fd);
+
+private:
+  SensorScheduler();
+
+  struct Entry {
+    int64_t deadlineNs;
+    int id;
+    bool operator>(const Entry& other) const { return deadlineNs > other.deadlineNs; }
+  };
+
+  struct TaskState {
+    Task task;
+    int64_t deadlineNs;
+    int64_t requestedNs;
+  };
+
+  void run();
+  void wakeUp();
+  void armTimer(int64_t deadlineNs);
+
+  int mEpollFd{-1};
+  int mTimerFd{-1};
+  int mEventFd{-1};
+
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> mDeadlines{};
+  std::map<int, TaskState> mTasks{};
+  std::map<int, int> mWatches{};
+  int mNextId{0};
+  int mRunningId{-1};
+  bool mStopThread{false};
+  std::mutex mMutex;
+  std::condition_variable mRunningCV;
+  std::thread mThread;
+};
+
+}  // namespace sensors
+}  // namespace bosch
+
+#endif  // ANDROID_HARDWARE_BOSCH_SENSOR_SCHEDULER_H
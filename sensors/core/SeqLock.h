@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_BOSCH_SEQ_LOCK_H
+#define ANDROID_HARDWARE_BOSCH_SEQ_LOCK_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace bosch {
+namespace sensors {
+
+/*
+ * Publishes a snapshot of a small trivially copyable value from one writer to
+ * any number of readers without blocking either side. Readers retry while a
+ * store is in progress. Concurrent stores must be serialized by the caller.
+ */
+template <typename T>
+class SeqLock {
+  static_assert(std::is_trivially_copyable<T>::value, "SeqLock requires a trivially copyable type");
+
+public:
+  SeqLock() { store(T{}); }
+
+  void store(const T& value) {
+    std::array<uint64_t, WORDS> words{};
+    std::memcpy(words.data(), &value, sizeof(T));
+
+    const uint32_t sequence = mSequence.load(std::memory_order_relaxed);
+    mSequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < WORDS; i++) mWords[i].store(words[i], std::memory_order_relaxed);
+    mSequence.store(sequence + 2, std::memory_order_release);
+  }
+
+  T load() const {
+    std::array<uint64_t, WORDS> words{};
+    uint32_t before = 0;
+    uint32_t after = 0;
+    do {
+      before = mSequence.load(std::memory_order_acquire);
+      for (size_t i = 0; i < WORDS; i++) words[i] = mWords[i].load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = mSequence.load(std::memory_order_relaxed);
+    } while ((before & 1) || (before != after));
+
+    T value;
+    std::memcpy(&value, words.data(), sizeof(T));
+    return value;
+  }
+
+private:
+  static constexpr size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+  std::atomic<uint32_t> mSequence{0};
+  std::array<std::atomic<uint64_t>, WORDS> mWords{};
+};
+
+}  // namespace sensors
+}  // namespace bosch
+
+#endif  // ANDROID_HARDWARE_BOSCH_SEQ_LOCK_H
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TemperatureSampler.h"
+
+#include <log/log.h>
+#include <utils/SystemClock.h>
+
+#include <map>
+
+#include "SensorScheduler.h"
+
+using namespace bosch::sensors;
+
+std::shared_ptr<TemperatureSampler> TemperatureSampler::getInstance(const std::string& device,
+                                                                    const std::string& attribute) {
+  static std::mutex instancesMutex;
+  static std::map<std::string, std::weak_ptr<TemperatureSampler>> instances;
+
+  std::lock_guard<std::mutex> lock(instancesMutex);
+  auto sampler = instances[device + attribute].lock();
+  if (!sampler) {
+    sampler = std::make_shared<TemperatureSampler>(device, attribute);
+    instances[device + attribute] = sampler;
+  }
+  return sampler;
+}
+
+TemperatureSampler::TemperatureSampler(const std::string& device, const std::string& attribute) {
+  mHandler.addFile(device, attribute);
+  if (mHandler.getFd(0) < 0) ALOGE("TemperatureSampler cannot open %s%s", device.c_str(), attribute.c_str());
+
+  mTaskId = SensorScheduler::getInstance().add([this](int64_t nowNs) { return onTimer(nowNs); });
+}
+
+TemperatureSampler::~TemperatureSampler() { SensorScheduler::getInstance().remove(mTaskId); }
+
+void TemperatureSampler::setEnabled(bool enable) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  mUsers += enable ? 1 : -1;
+  if (mUsers < 0) mUsers = 0;
+
+  // The first sample is taken right here, before the sensor being enabled
+  // sends its additional info report, so that the report has a fresh value
+  if (enable && (mUsers == 1)) {
+    sampleLocked();
+    SensorScheduler::getInstance().schedule(mTaskId, ::android::elapsedRealtimeNano() + SAMPLING_PERIOD_NS);
+  }
+}
+
+bool TemperatureSampler::getRaw(int& raw) const {
+  const Sample sample = mSample.load();
+  if (!sample.isValid) return false;
+  raw = sample.raw;
+  return true;
+}
+
+int64_t TemperatureSampler::onTimer(int64_t nowNs) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (mUsers == 0) return NO_DEADLINE;
+
+  sampleLocked();
+  return nowNs + SAMPLING_PERIOD_NS;
+}
+
+void TemperatureSampler::sampleLocked() {
+  int raw = 0;
+  const bool isFailing = (mHandler.readRaw(0, raw) != 0);
+  if (!isFailing) mSample.store({raw, true});
+  if (isFailing && !mIsFailing) ALOGE("TemperatureSampler read failed");
+  mIsFailing = isFailing;
+}
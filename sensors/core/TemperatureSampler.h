@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_BOSCH_TEMPERATURE_SAMPLER_H
+#define ANDROID_HARDWARE_BOSCH_TEMPERATURE_SAMPLER_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "FileHandler.h"
+#include "SeqLock.h"
+
+namespace bosch {
+namespace sensors {
+
+/*
+ * Samples the temperature attribute of a device at a low rate on the
+ * scheduler thread while any sensor of the device is enabled. The attribute
+ * stays open and the latest raw value is published through a SeqLock, so
+ * reading it never touches the file or blocks.
+ *
+ * The last value is kept when sampling stops and is replaced by the first
+ * sample of the next run.
+ */
+class TemperatureSampler {
+public:
+  static std::shared_ptr<TemperatureSampler> getInstance(const std::string& device, const std::string& attribute);
+
+  TemperatureSampler(const std::string& device, const std::string& attribute);
+  ~TemperatureSampler();
+
+  TemperatureSampler(const TemperatureSampler&) = delete;
+  TemperatureSampler& operator=(const TemperatureSampler&) = delete;
+
+  // Reference counted, sampling runs while at least one user is enabled
+  void setEnabled(bool enable);
+  bool getRaw(int& raw) const;
+
+private:
+  static constexpr int64_t SAMPLING_PERIOD_NS = 1000000000;
+
+  struct Sample {
+    int32_t raw;
+    bool isValid;
+  };
+
+  int64_t onTimer(int64_t nowNs);
+  void sampleLocked();
+
+  std::mutex mMutex;
+  bosch::hwctl::RawSysfsHandler mHandler{};
+  SeqLock<Sample> mSample{};
+  bool mIsFailing{false};
+
+  int mUsers{0};
+  int mTaskId{-1};
+};
+
+}  // namespace sensors
+}  // namespace bosch
+
+#endif  // ANDROID_HARDWARE_BOSCH_TEMPERATURE_SAMPLER_H
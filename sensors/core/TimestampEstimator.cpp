@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TimestampEstimator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace bosch::sensors;
+
+int TimestampEstimator::addStream() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  const int id = mNextStream++;
+  mStreams[id] = Stream{};
+  return id;
+}
+
+void TimestampEstimator::removeStream(int stream) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  mStreams.erase(stream);
+  updateSkew();
+}
+
+void TimestampEstimator::setSamplingPeriod(int stream, int64_t samplingPeriodNs) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  auto it = mStreams.find(stream);
+  if ((it == mStreams.end()) || (it->second.samplingPeriodNs == samplingPeriodNs)) return;
+
+  it->second.samplingPeriodNs = samplingPeriodNs;
+  resetLocked(it->second);
+}
+
+void TimestampEstimator::reset(int stream) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  auto it = mStreams.find(stream);
+  if (it != mStreams.end()) resetLocked(it->second);
+}
+
+// The last timestamp is kept, the stream stays monotonic across a restart
+void TimestampEstimator::resetLocked(Stream& stream) {
+  stream.nextIndex = 0;
+  stream.windowStart = 0;
+  stream.windowSize = 0;
+  stream.hasPending = false;
+  stream.hasLine = false;
+  stream.isLocked = false;
+  updateSkew();
+}
+
+void TimestampEstimator::update(int stream, std::vector<int64_t>& timestamps) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  auto it = mStreams.find(stream);
+  if (it == mStreams.end()) return;
+  auto& state = it->second;
+
+  const uint64_t first = state.nextIndex;
+  state.nextIndex += timestamps.size();
+
+  // The line is only refitted when the window changes, so that the spacing
+  // stays even in between
+  if (state.samplingPeriodNs > 0) {
+    bool isChanged = false;
+    for (size_t i = 0; i < timestamps.size(); i++) {
+      if (timestamps[i] > 0) isChanged |= addObservation(state, first + i, timestamps[i]);
+    }
+    if (isChanged) fit(state, first);
+  }
+
+  if (state.hasLine) {
+    // A sample can not be taken after it arrived. An arrival before the line
+    // moves the line back to it, spread over the samples since the last fixed
+    // one, so that no single spacing takes up the whole step.
+    uint64_t fromIndex = first;
+    int64_t fromNs = getLineTimestamp(state, first - 1);
+    if (std::abs(state.lastTimestampNs - fromNs) < state.samplingPeriodNs) fromNs = state.lastTimestampNs;
+    for (size_t i = 0; i < timestamps.size(); i++) {
+      const int64_t arrivalNs = timestamps[i];
+      if ((arrivalNs <= 0) || (getLineTimestamp(state, first + i) <= arrivalNs)) continue;
+
+      const uint64_t count = first + i + 1 - fromIndex;
+      for (uint64_t index = fromIndex; index <= first + i; index++) {
+        timestamps[index - first] = fromNs + (arrivalNs - fromNs) * static_cast<int64_t>(index + 1 - fromIndex) /
+                                               static_cast<int64_t>(count);
+      }
+      state.lineIndex = first + i;
+      state.lineTimestampNs = arrivalNs;
+      fromIndex = first + i + 1;
+      fromNs = arrivalNs;
+    }
+    for (uint64_t index = fromIndex; index < state.nextIndex; index++) {
+      timestamps[index - first] = getLineTimestamp(state, index);
+    }
+  } else {
+    // Without a rate a sample gets the arrival time of the next one seen
+    int64_t next = 0;
+    for (size_t i = timestamps.size(); i-- > 0;) {
+      if (timestamps[i] > 0) next = timestamps[i];
+      timestamps[i] = next;
+    }
+  }
+
+  for (auto& timestamp : timestamps) {
+    timestamp = std::max(timestamp, state.lastTimestampNs + 1);
+    state.lastTimestampNs = timestamp;
+  }
+}
+
+float TimestampEstimator::getSkewPpm() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return static_cast<float>(mSkew * 1e6);
+}
+
+/*
+ * Of the arrivals within one observation interval the earliest one relative
+ * to the current line is kept. An arrival far off the line means that samples
+ * were lost or counted twice, the line is then built up anew.
+ */
+bool TimestampEstimator::addObservation(Stream& stream, uint64_t index, int64_t timestampNs) {
+  if (stream.hasLine) {
+    const int64_t residual = timestampNs - getLineTimestamp(stream, index);
+    if (std::abs(residual) > RESYNC_PERIODS * stream.samplingPeriodNs) {
+      stream.windowStart = 0;
+      stream.windowSize = 0;
+      stream.hasPending = false;
+      stream.hasLine = false;
+      stream.isLocked = false;
+    }
+  }
+
+  const Observation observation{index, timestampNs};
+  if (!stream.hasPending || !stream.hasLine ||
+      (timestampNs - getLineTimestamp(stream, index) <
+       stream.pending.timestampNs - getLineTimestamp(stream, stream.pending.index))) {
+    stream.pending = observation;
+    stream.hasPending = true;
+  }
+
+  const uint64_t spacing = getObservationSpacing(stream);
+  const auto& last = stream.window[(stream.windowStart + stream.windowSize + WINDOW_LENGTH - 1) % WINDOW_LENGTH];
+  if ((stream.windowSize > 0) && (index < last.index + spacing)) return false;
+
+  if (stream.windowSize < WINDOW_LENGTH) {
+    stream.window[(stream.windowStart + stream.windowSize++) % WINDOW_LENGTH] = stream.pending;
+  } else {
+    stream.window[stream.windowStart] = stream.pending;
+    stream.windowStart = (stream.windowStart + 1) % WINDOW_LENGTH;
+  }
+  stream.hasPending = false;
+  return true;
+}
+
+/*
+ * Fits a line to the window. The first fit and a fit after a resync are taken
+ * as they are. Otherwise the line continues from the timestamp of the next
+ * sample and takes up the phase error to the fit until the next refit, with
+ * the period at most MAX_SLEW off the fitted one.
+ */
+void TimestampEstimator::fit(Stream& stream, uint64_t nextIndex) {
+  if (stream.windowSize == 0) return;
+
+  const Observation& reference = stream.window[stream.windowStart];
+  auto forEachObservation = [&](const auto& function) {
+    for (size_t i = 0; i < stream.windowSize; i++) {
+      const auto& observation = stream.window[(stream.windowStart + i) % WINDOW_LENGTH];
+      function(static_cast<double>(observation.index - reference.index),
+               static_cast<double>(observation.timestampNs - reference.timestampNs));
+    }
+  };
+
+  // An implausible slope, e.g. from a burst of late arrivals, is not used
+  double periodNs = stream.samplingPeriodNs * (1.0 + mSkew);
+  stream.isLocked = false;
+  if (stream.windowSize >= MIN_FIT_OBSERVATIONS) {
+    double meanX = 0.0;
+    double meanY = 0.0;
+    forEachObservation([&](double x, double y) {
+      meanX += x;
+      meanY += y;
+    });
+    meanX /= stream.windowSize;
+    meanY /= stream.windowSize;
+
+    double sxx = 0.0;
+    double sxy = 0.0;
+    forEachObservation([&](double x, double y) {
+      sxx += (x - meanX) * (x - meanX);
+      sxy += (x - meanX) * (y - meanY);
+    });
+
+    const double slope = (sxx > 0.0) ? sxy / sxx : 0.0;
+    const double skew = slope / stream.samplingPeriodNs - 1.0;
+    if ((sxx > 0.0) && (std::fabs(skew) <= MAX_SKEW)) {
+      periodNs = slope;
+      stream.skew = skew;
+      stream.isLocked = true;
+    }
+  }
+
+  double offsetNs = std::numeric_limits<double>::max();
+  forEachObservation([&](double x, double y) { offsetNs = std::min(offsetNs, y - periodNs * x); });
+  const int64_t fitTimestampNs = reference.timestampNs + std::llround(offsetNs);
+
+  if (!stream.hasLine) {
+    stream.lineIndex = reference.index;
+    stream.lineTimestampNs = fitTimestampNs;
+    stream.periodNs = periodNs;
+    stream.hasLine = true;
+    updateSkew();
+    return;
+  }
+
+  const int64_t timestampNs = getLineTimestamp(stream, nextIndex);
+  const double samples = static_cast<double>(nextIndex) - static_cast<double>(reference.index);
+  const double errorNs = fitTimestampNs + samples * periodNs - timestampNs;
+  const double maxSlewNs = MAX_SLEW * stream.samplingPeriodNs;
+  const double slewNs = std::clamp(errorNs / getObservationSpacing(stream), -maxSlewNs, maxSlewNs);
+
+  stream.lineIndex = nextIndex;
+  stream.lineTimestampNs = timestampNs;
+  stream.periodNs = periodNs + slewNs;
+  updateSkew();
+}
+
+// Without a locked stream the last estimate is kept for the next start
+void TimestampEstimator::updateSkew() {
+  double skew = 0.0;
+  size_t locked = 0;
+  for (const auto& [_, stream] : mStreams) {
+    if (!stream.isLocked) continue;
+    skew += stream.skew;
+    locked++;
+  }
+  if (locked > 0) mSkew = skew / locked;
+}
+
+int64_t TimestampEstimator::getLineTimestamp(const Stream& stream, uint64_t index) const {
+  const int64_t samples = static_cast<int64_t>(index - stream.lineIndex);
+  return stream.lineTimestampNs + std::llround(samples * stream.periodNs);
+}
+
+uint64_t TimestampEstimator::getObservationSpacing(const Stream& stream) {
+  return std::max<int64_t>(OBSERVATION_INTERVAL_NS / stream.samplingPeriodNs, 1);
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_BOSCH_TIMESTAMP_ESTIMATOR_H
+#define ANDROID_HARDWARE_BOSCH_TIMESTAMP_ESTIMATOR_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace bosch {
+namespace sensors {
+
+/*
+ * Locks onto the sample clock of a chip. Every stream of the chip reports
+ * the arrival times of its samples, which are late by a varying latency,
+ * and gets back evenly spaced timestamps on a line fitted to them.
+ *
+ * The period of the line is a least squares fit over the last half minute of
+ * arrivals and follows the drift of the chip oscillator. Its phase is the
+ * lower envelope of the arrivals, as a sample can not arrive before it was
+ * taken. Of the arrivals within one observation interval only the earliest is
+ * kept for the fit.
+ *
+ * A refit does not move the timestamps onto the new line at once, that would
+ * step them by the jitter of the envelope. The timestamps continue where they
+ * are and slew their phase towards the new line until the next refit, the
+ * spacing of the samples differs by at most MAX_SLEW from the fitted period.
+ *
+ * The streams of one chip can share an estimator. Each stream has a line of
+ * its own, the clock skew of the streams that are locked is averaged and
+ * used by a stream until it has locked itself.
+ */
+class TimestampEstimator {
+public:
+  int addStream();
+  void removeStream(int stream);
+  void setSamplingPeriod(int stream, int64_t samplingPeriodNs);
+  void reset(int stream);
+
+  // Replaces the arrival times of consecutive samples of the stream by their
+  // estimated capture times. A sample without arrival time, e.g. in the middle
+  // of a batch, is 0.
+  void update(int stream, std::vector<int64_t>& timestamps);
+
+  // Deviation of the chip clock from the nominal rate, positive when slower
+  float getSkewPpm();
+
+private:
+  static constexpr size_t WINDOW_LENGTH = 64;
+  static constexpr size_t MIN_FIT_OBSERVATIONS = 8;
+  static constexpr int64_t OBSERVATION_INTERVAL_NS = 500000000;
+  static constexpr int64_t RESYNC_PERIODS = 8;
+  static constexpr double MAX_SKEW = 0.05;
+  static constexpr double MAX_SLEW = 0.001;
+
+  struct Observation {
+    uint64_t index;
+    int64_t timestampNs;
+  };
+
+  struct Stream {
+    int64_t samplingPeriodNs{0};
+    uint64_t nextIndex{0};
+    int64_t lastTimestampNs{0};
+
+    std::array<Observation, WINDOW_LENGTH> window{};
+    size_t windowStart{0};
+    size_t windowSize{0};
+    Observation pending{};
+    bool hasPending{false};
+
+    bool hasLine{false};
+    uint64_t lineIndex{0};
+    int64_t lineTimestampNs{0};
+    double periodNs{0.0};
+    double skew{0.0};
+    bool isLocked{false};
+  };
+
+  void resetLocked(Stream& stream);
+  bool addObservation(Stream& stream, uint64_t index, int64_t timestampNs);
+  void fit(Stream& stream, uint64_t nextIndex);
+  void updateSkew();
+  int64_t getLineTimestamp(const Stream& stream, uint64_t index) const;
+  static uint64_t getObservationSpacing(const Stream& stream);
+
+  std::map<int, Stream> mStreams{};
+  int mNextStream{0};
+  double mSkew{0.0};
+  std::mutex mMutex;
+};
+
+}  // namespace sensors
+}  // namespace bosch
+
+#endif  // ANDROID_HARDWARE_BOSCH_TIMESTAMP_ESTIMATOR_H
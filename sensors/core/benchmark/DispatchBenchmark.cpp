@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "HandleTable.h"
+
+/*
+ * Per event dispatch cost of the HAL front ends: the wake-up flag of the
+ * sensor is looked up and the event is offered to every direct channel, which
+ * decimates it to its rate. The sensors use the handles SensorList hands out,
+ * 32 per chip instance. The argument is the number of chip instances.
+ */
+
+namespace {
+
+constexpr int32_t HANDLES_PER_INSTANCE = 32;
+constexpr int32_t SENSORS_PER_INSTANCE = 6;
+constexpr int64_t SAMPLING_PERIOD_NS = 2500000;
+constexpr int64_t CHANNEL_RATE_NS = 5000000;
+constexpr int CHANNELS = 2;
+constexpr int EVENTS_PER_BATCH = 64;
+
+std::vector<int32_t> sensorHandles(int instances) {
+  std::vector<int32_t> handles;
+  for (int32_t instance = 0; instance < instances; instance++) {
+    for (int32_t sensor = 0; sensor < SENSORS_PER_INSTANCE; sensor++) {
+      handles.push_back(instance * HANDLES_PER_INSTANCE + sensor + 1);
+    }
+  }
+  return handles;
+}
+
+// The events of a batch come from all sensors in turn
+std::vector<int32_t> eventHandles(const std::vector<int32_t>& handles) {
+  std::vector<int32_t> events;
+  for (int i = 0; i < EVENTS_PER_BATCH; i++) events.push_back(handles[i % handles.size()]);
+  return events;
+}
+
+struct MapChannel {
+  std::vector<int32_t> sensorHandles;
+  std::map<int32_t, int64_t> rateNs;
+  std::map<int32_t, int32_t> sampleCount;
+};
+
+struct TableChannel {
+  bosch::sensors::HandleTable<int64_t> rateNs;
+  bosch::sensors::HandleTable<int32_t> sampleCount;
+};
+
+}  // namespace
+
+static void BM_DispatchMap(benchmark::State& state) {
+  const auto handles = sensorHandles(state.range(0));
+  const auto events = eventHandles(handles);
+
+  std::map<int32_t, bool> isWakeUp;
+  std::vector<MapChannel> channels(CHANNELS);
+  for (const int32_t handle : handles) {
+    isWakeUp[handle] = (handle % 2) == 0;
+    channels[handle % CHANNELS].sensorHandles.push_back(handle);
+    channels[handle % CHANNELS].rateNs[handle] = CHANNEL_RATE_NS;
+  }
+
+  size_t numWakeUpEvents = 0;
+  size_t numWritten = 0;
+  for (auto _ : state) {
+    for (const int32_t handle : events) {
+      numWakeUpEvents += isWakeUp.find(handle)->second;
+      for (auto& channel : channels) {
+        if (std::find(channel.sensorHandles.begin(), channel.sensorHandles.end(), handle) ==
+            channel.sensorHandles.end()) {
+          continue;
+        }
+        if (channel.rateNs[handle] == 0) continue;
+        channel.sampleCount[handle]++;
+        if (SAMPLING_PERIOD_NS * channel.sampleCount[handle] < channel.rateNs[handle]) continue;
+        numWritten++;
+        channel.sampleCount[handle] = 0;
+      }
+    }
+    benchmark::DoNotOptimize(numWakeUpEvents);
+    benchmark::DoNotOptimize(numWritten);
+  }
+  state.SetItemsProcessed(state.iterations() * events.size());
+}
+BENCHMARK(BM_DispatchMap)->Arg(1)->Arg(2)->Arg(8);
+
+static void BM_DispatchHandleTable(benchmark::State& state) {
+  const auto handles = sensorHandles(state.range(0));
+  const auto events = eventHandles(handles);
+
+  bosch::sensors::HandleTable<uint8_t> isWakeUp;
+  std::vector<TableChannel> channels(CHANNELS);
+  for (const int32_t handle : handles) {
+    isWakeUp.set(handle, (handle % 2) == 0);
+    channels[handle % CHANNELS].rateNs.set(handle, CHANNEL_RATE_NS);
+    channels[handle % CHANNELS].sampleCount.set(handle, 0);
+  }
+
+  size_t numWakeUpEvents = 0;
+  size_t numWritten = 0;
+  for (auto _ : state) {
+    for (const int32_t handle : events) {
+      numWakeUpEvents += isWakeUp.get(handle);
+      for (auto& channel : channels) {
+        const int64_t rateNs = channel.rateNs.get(handle);
+        if (rateNs == 0) continue;
+        int32_t& count = channel.sampleCount[handle];
+        if (SAMPLING_PERIOD_NS * ++count < rateNs) continue;
+        numWritten++;
+        count = 0;
+      }
+    }
+    benchmark::DoNotOptimize(numWakeUpEvents);
+    benchmark::DoNotOptimize(numWritten);
+  }
+  state.SetItemsProcessed(state.iterations() * events.size());
+}
+BENCHMARK(BM_DispatchHandleTable)->Arg(1)->Arg(2)->Arg(8);
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "DecimationFilter.h"
+
+using bosch::sensors::DECIMATION_CIC;
+using bosch::sensors::DECIMATION_FIR;
+using bosch::sensors::DECIMATION_NONE;
+using bosch::sensors::DecimationFilter;
+
+namespace {
+
+constexpr double AMPLITUDE = 10000.0;
+constexpr int64_t INPUT_PERIOD_NS = 1000000;
+
+/*
+ * Gain in dB of a tone at the given frequency, relative to the output rate,
+ * after decimation. Aliased tones show up at another frequency, so the gain
+ * is taken from the amplitude of whatever comes out once the filter has
+ * settled.
+ */
+double measureGainDb(DecimationFilter& filter, double outputFrequency) {
+  const size_t factor = filter.getFactor();
+  const double inputFrequency = outputFrequency / factor;
+  std::vector<float> outputs;
+  for (size_t n = 0; n < factor * 400; n++) {
+    const int64_t input = std::lround(AMPLITUDE * std::sin(2.0 * M_PI * inputFrequency * n + 0.3));
+    float output = 0.0f;
+    int64_t timestamp = 0;
+    if (filter.process(&input, n * INPUT_PERIOD_NS, &output, &timestamp)) outputs.push_back(output);
+  }
+
+  const auto settled = outputs.begin() + outputs.size() / 2;
+  const auto [min, max] = std::minmax_element(settled, outputs.end());
+  return 20.0 * std::log10((*max - *min) / 2.0 / AMPLITUDE);
+}
+
+}  // namespace
+
+TEST(DecimationFilterTest, SplitsLargeFirFactors) {
+  EXPECT_EQ(16u, DecimationFilter::getSupportedFactor(DECIMATION_FIR, 16));
+  EXPECT_EQ(31u, DecimationFilter::getSupportedFactor(DECIMATION_FIR, 31));
+  EXPECT_EQ(50u, DecimationFilter::getSupportedFactor(DECIMATION_FIR, 50));
+  EXPECT_EQ(36u, DecimationFilter::getSupportedFactor(DECIMATION_FIR, 37));
+  EXPECT_EQ(510u, DecimationFilter::getSupportedFactor(DECIMATION_FIR, 512));
+  EXPECT_EQ(37u, DecimationFilter::getSupportedFactor(DECIMATION_CIC, 37));
+  EXPECT_EQ(37u, DecimationFilter::getSupportedFactor(DECIMATION_NONE, 37));
+  EXPECT_EQ(1u, DecimationFilter::getSupportedFactor(DECIMATION_FIR, 0));
+}
+
+TEST(DecimationFilterTest, FirPassesLowFrequencies) {
+  for (const size_t factor : {2, 8, 31, 50, 200, 512}) {
+    SCOPED_TRACE(factor);
+    DecimationFilter filter;
+    filter.configure(DECIMATION_FIR, factor, 1);
+    EXPECT_NEAR(0.0, measureGainDb(filter, 0.1), 0.5);
+  }
+}
+
+TEST(DecimationFilterTest, FirRejectsAliasingFrequencies) {
+  for (const size_t factor : {4, 16, 31, 50, 200, 512}) {
+    DecimationFilter filter;
+    filter.configure(DECIMATION_FIR, factor, 1);
+    for (const double frequency : {1.1, 1.37, 2.6, 7.3, 0.45 * factor}) {
+      if (frequency >= 0.5 * factor) continue;
+      SCOPED_TRACE(::testing::Message() << "factor " << factor << " frequency " << frequency);
+      filter.reset();
+      EXPECT_LT(measureGainDb(filter, frequency), -40.0);
+    }
+  }
+}
+
+TEST(DecimationFilterTest, CicRejectsAliasingFrequencies) {
+  for (const size_t factor : {4, 16, 50, 200}) {
+    DecimationFilter filter;
+    filter.configure(DECIMATION_CIC, factor, 1);
+    for (const double frequency : {1.1, 2.05, 3.02}) {
+      SCOPED_TRACE(::testing::Message() << "factor " << factor << " frequency " << frequency);
+      filter.reset();
+      EXPECT_LT(measureGainDb(filter, frequency), -40.0);
+    }
+  }
+}
+
+TEST(DecimationFilterTest, KeepsConstantInput) {
+  DecimationFilter filter;
+  filter.configure(DECIMATION_FIR, 200, 1);
+  const int64_t input = -1234;
+  size_t outputs = 0;
+  for (size_t n = 0; n < 1000; n++) {
+    float output = 0.0f;
+    int64_t timestamp = 0;
+    if (!filter.process(&input, n * INPUT_PERIOD_NS, &output, &timestamp)) continue;
+    EXPECT_NEAR(-1234.0f, output, 0.1f);
+    outputs++;
+  }
+  EXPECT_EQ(1000u / filter.getFactor(), outputs);
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "TimestampEstimator.h"
+
+using bosch::sensors::TimestampEstimator;
+
+namespace {
+
+constexpr int64_t SAMPLING_PERIOD_NS = 5000000;
+constexpr int64_t START_NS = 1000000000;
+
+/*
+ * A chip whose clock runs off by skewPpm. Its samples are read in batches and
+ * arrive late by a random latency, as with a FIFO watermark. Only the last
+ * sample of a batch has an arrival time, the others are 0.
+ */
+class FakeChip {
+public:
+  FakeChip(double skewPpm, size_t batchLength)
+    : mPeriodNs(SAMPLING_PERIOD_NS * (1.0 + skewPpm * 1e-6)), mBatchLength(batchLength) {
+    mStream = mEstimator.addStream();
+    mEstimator.setSamplingPeriod(mStream, SAMPLING_PERIOD_NS);
+  }
+
+  // Runs for the duration and returns the capture times and the estimates
+  void run(int64_t durationNs, std::vector<int64_t>& captures, std::vector<int64_t>& timestamps) {
+    std::uniform_int_distribution<int64_t> latencyNs(100000, 3000000);
+    std::vector<int64_t> batch(mBatchLength);
+    while (getCapture(mIndex) < START_NS + durationNs) {
+      for (size_t i = 0; i < mBatchLength; i++) {
+        captures.push_back(getCapture(mIndex + i));
+        batch[i] = 0;
+      }
+      mIndex += mBatchLength;
+      batch.back() = captures.back() + latencyNs(mRandom);
+
+      mEstimator.update(mStream, batch);
+      timestamps.insert(timestamps.end(), batch.begin(), batch.end());
+    }
+  }
+
+  float getSkewPpm() { return mEstimator.getSkewPpm(); }
+
+private:
+  int64_t getCapture(uint64_t index) const { return START_NS + static_cast<int64_t>(index * mPeriodNs); }
+
+  TimestampEstimator mEstimator;
+  int mStream;
+  const double mPeriodNs;
+  const size_t mBatchLength;
+  uint64_t mIndex{0};
+  std::mt19937 mRandom{42};
+};
+
+}  // namespace
+
+TEST(TimestampEstimatorTest, StaysMonotonic) {
+  for (const size_t batchLength : {1, 10, 40}) {
+    FakeChip chip(300.0, batchLength);
+    std::vector<int64_t> captures;
+    std::vector<int64_t> timestamps;
+    chip.run(60000000000, captures, timestamps);
+
+    for (size_t i = 1; i < timestamps.size(); i++) {
+      ASSERT_GT(timestamps[i], timestamps[i - 1]) << "batch " << batchLength << " sample " << i;
+    }
+  }
+}
+
+TEST(TimestampEstimatorTest, SpacesSamplesEvenlyOnceLocked) {
+  for (const double skewPpm : {-2000.0, 0.0, 300.0}) {
+    FakeChip chip(skewPpm, 10);
+    std::vector<int64_t> captures;
+    std::vector<int64_t> timestamps;
+    chip.run(60000000000, captures, timestamps);
+
+    // Refits must neither step the timestamps nor stretch single samples
+    const int64_t periodNs = captures[1] - captures[0];
+    const size_t settled = 10000000000 / SAMPLING_PERIOD_NS;
+    int64_t maxDeviationNs = 0;
+    for (size_t i = settled; i < timestamps.size(); i++) {
+      maxDeviationNs = std::max(maxDeviationNs, std::abs((timestamps[i] - timestamps[i - 1]) - periodNs));
+    }
+    EXPECT_LT(maxDeviationNs, SAMPLING_PERIOD_NS / 500) << "skew " << skewPpm;
+    EXPECT_NEAR(skewPpm, chip.getSkewPpm(), 20.0);
+  }
+}
+
+TEST(TimestampEstimatorTest, FollowsCaptureTimes) {
+  FakeChip chip(300.0, 10);
+  std::vector<int64_t> captures;
+  std::vector<int64_t> timestamps;
+  chip.run(60000000000, captures, timestamps);
+
+  // A sample can not be stamped before it was taken, the shortest latency is
+  // what the estimate may be late by
+  const size_t settled = 10000000000 / SAMPLING_PERIOD_NS;
+  for (size_t i = settled; i < timestamps.size(); i++) {
+    ASSERT_LT(std::abs(timestamps[i] - captures[i]), 500000) << i;
+  }
+}
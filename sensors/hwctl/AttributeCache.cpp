@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "AttributeCache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace bosch::hwctl {
+
+namespace {
+
+std::mutex instancesMutex;
+std::map<std::string, std::shared_ptr<AttributeCache>> instances;
+
+}  // namespace
+
+std::shared_ptr<AttributeCache> AttributeCache::getInstance(const std::string& path) {
+  std::lock_guard<std::mutex> lock(instancesMutex);
+  auto& cache = instances[path];
+  if (!cache) cache = std::make_shared<AttributeCache>(path);
+  return cache;
+}
+
+void AttributeCache::invalidateInstance(const std::string& path) {
+  std::shared_ptr<AttributeCache> cache{};
+  {
+    std::lock_guard<std::mutex> lock(instancesMutex);
+    const auto it = instances.find(path);
+    if (it == instances.end()) return;
+    cache = it->second;
+  }
+  cache->invalidate();
+}
+
+AttributeCache::AttributeCache(const std::string& path) : mPath(path) {}
+
+AttributeCache::~AttributeCache() {
+  for (const auto& [_, attribute] : mAttributes) {
+    if (attribute.fd >= 0) close(attribute.fd);
+  }
+}
+
+int AttributeCache::write(const std::string& attribute, const std::string& value) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return writeLocked(attribute, value);
+}
+
+/*
+ * The driver may have changed the attributes, e.g. across a suspend, or the
+ * device was removed. The attributes are closed, the next write of every
+ * attribute opens it and goes to the device again.
+ */
+void AttributeCache::invalidate() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  for (const auto& [_, attribute] : mAttributes) {
+    if (attribute.fd >= 0) close(attribute.fd);
+  }
+  mAttributes.clear();
+}
+
+int AttributeCache::writeLocked(const std::string& name, const std::string& value) {
+  auto it = mAttributes.find(name);
+  if (it == mAttributes.end()) {
+    const int fd = open((mPath + name).c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    it = mAttributes.emplace(name, Attribute{fd, {}, false}).first;
+  }
+
+  Attribute& attribute = it->second;
+  if (attribute.isValid && (attribute.value == value)) return 0;
+
+  // Every write of a sysfs attribute is stored as a whole, the offset is ignored
+  ssize_t count = pwrite(attribute.fd, value.data(), value.size(), 0);
+  if ((count < 0) && ((errno == ENODEV) || (errno == EBADF)) && (reopenLocked(name, attribute) == 0)) {
+    count = pwrite(attribute.fd, value.data(), value.size(), 0);
+  }
+  attribute.isValid = (count == static_cast<ssize_t>(value.size()));
+  if (!attribute.isValid) return -1;
+
+  attribute.value = value;
+  return 0;
+}
+
+/*
+ * The attribute of a removed device stays open but fails every write, the
+ * device may be back under the same path by now.
+ */
+int AttributeCache::reopenLocked(const std::string& name, Attribute& attribute) {
+  if (attribute.fd >= 0) close(attribute.fd);
+  attribute.fd = open((mPath + name).c_str(), O_WRONLY | O_CLOEXEC);
+  return (attribute.fd < 0) ? -1 : 0;
+}
+
+AttributeCache::Transaction& AttributeCache::Transaction::set(const std::string& attribute, const std::string& value) {
+  mWrites.emplace_back(attribute, value);
+  return *this;
+}
+
+int AttributeCache::Transaction::commit() {
+  std::lock_guard<std::mutex> lock(mCache.mMutex);
+
+  int status = 0;
+  for (const auto& [attribute, value] : mWrites) {
+    if (mCache.writeLocked(attribute, value) != 0) status = -1;
+  }
+  mWrites.clear();
+  return status;
+}
+
+}  // namespace bosch::hwctl
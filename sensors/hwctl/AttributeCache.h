@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bosch::hwctl {
+
+/*
+ * Configuration attributes of one device. The attributes stay open and the
+ * last value written to each of them is remembered, writing the same value
+ * again is skipped. A failed write forgets the value so that it is retried.
+ *
+ * An attribute whose device went away is opened again once, so a device that
+ * comes back under the same path is configured through its new attributes.
+ */
+class AttributeCache {
+public:
+  static std::shared_ptr<AttributeCache> getInstance(const std::string& path);
+  // Invalidates the cache of a device that was removed, if there is one
+  static void invalidateInstance(const std::string& path);
+
+  explicit AttributeCache(const std::string& path);
+  ~AttributeCache();
+
+  AttributeCache(const AttributeCache&) = delete;
+  AttributeCache& operator=(const AttributeCache&) = delete;
+
+  int write(const std::string& attribute, const std::string& value);
+  void invalidate();
+
+  /*
+   * Collects attribute writes and applies them in the given order in one
+   * pass, no other write to the device can come in between.
+   */
+  class Transaction {
+  public:
+    explicit Transaction(AttributeCache& cache) : mCache(cache) {}
+
+    Transaction& set(const std::string& attribute, const std::string& value);
+    int commit();
+
+  private:
+    AttributeCache& mCache;
+    std::vector<std::pair<std::string, std::string>> mWrites{};
+  };
+
+private:
+  struct Attribute {
+    int fd;
+    std::string value;
+    bool isValid;
+  };
+
+  int writeLocked(const std::string& attribute, const std::string& value);
+  int reopenLocked(const std::string& name, Attribute& attribute);
+
+  const std::string mPath;
+  std::map<std::string, Attribute> mAttributes{};
+  std::mutex mMutex;
+};
+
+}  // namespace bosch::hwctl
@@ -16,9 +16,13 @@
 
 #include "FileHandler.h"
 
-#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
 
-#include <regex>
+#include <climits>
+#include <cstdint>
+
+#include "IioDeviceIndex.h"
 
 namespace bosch::hwctl {
 
@@ -61,58 +65,80 @@ int WriteHandler::write(const std::string& content) {
   return 0;
 }
 
+RawSysfsHandler::~RawSysfsHandler() {
+  for (const int fd : mFds) {
+    if (fd >= 0) close(fd);
+  }
+}
+
 void RawSysfsHandler::init(const std::string& path, const std::array<std::string, 3>& files) {
   for (const auto& file : files) {
     if (file.empty()) break;
-    mFileHandlers.push_back(std::make_unique<ReadHandler>(path, file));
+    addFile(path, file);
   }
 }
 
-int RawSysfsHandler::read(std::vector<float>& results, float resolution) {
-  for (auto& handler : mFileHandlers) {
-    std::string content;
-    const int status = handler->read(content);
+size_t RawSysfsHandler::addFile(const std::string& path, const std::string& file) {
+  // A missing attribute keeps its index and fails on read
+  mFds.push_back(open((path + file).c_str(), O_RDONLY | O_CLOEXEC));
+  return mFds.size() - 1;
+}
+
+int RawSysfsHandler::read(std::array<float, 3>& results, float resolution) {
+  if (mFds.size() > results.size()) return -1;
+
+  for (size_t i = 0; i < mFds.size(); i++) {
+    int value = 0;
+    const int status = readRaw(i, value);
     if (status != 0) return status;
-    if (!isValidInteger(content)) return -1;
 
-    results.push_back(std::stoi(content) * resolution);
+    results[i] = value * resolution;
   }
 
   return 0;
 }
 
-bool RawSysfsHandler::isValidInteger(const std::string& s) const {
-  static const std::regex number_regex(R"(^\s*[-+]?(?:\d+(?:\.\d*)?|\.\d+)(?:[eE][-+]?\d+)?\s*$)");
-  return std::regex_match(s, number_regex);
+int RawSysfsHandler::readRaw(size_t index, int& value) {
+  if ((index >= mFds.size()) || (mFds[index] < 0)) return -1;
+
+  // Sysfs regenerates the content on every read from offset 0
+  char buffer[32];
+  const ssize_t length = pread(mFds[index], buffer, sizeof(buffer), 0);
+  if ((length <= 0) || (length == sizeof(buffer))) return -1;
+
+  return parseInteger(buffer, buffer + length, value) ? 0 : -1;
 }
 
-bool isSensorAvailable(const std::string& driverName, std::string& device) {
-  const std::string iioPath = "/sys/bus/iio/devices/";
-  const std::regex pattern("iio:device\\d+");
-  bool sensorFound = false;
-  std::string name = {};
-
-  DIR* dir = opendir(iioPath.c_str());
-  if (dir == NULL) {
-    return false;
-  }
+static bool isSpace(char c) { return (c == ' ') || (c == '\n') || (c == '\t') || (c == '\r'); }
+
+bool parseInteger(const char* begin, const char* end, int& value) {
+  while ((begin != end) && isSpace(*begin)) begin++;
+  while ((end != begin) && isSpace(*(end - 1))) end--;
+  if (begin == end) return false;
+
+  const bool isNegative = (*begin == '-');
+  if ((*begin == '-') || (*begin == '+')) begin++;
+  if (begin == end) return false;
 
-  for (dirent* entry = readdir(dir); entry != NULL; entry = readdir(dir)) {
-    if (std::regex_match(entry->d_name, pattern)) {
-      const std::string name_path = std::string(entry->d_name) + "/name";
-      ReadHandler fileHandler(iioPath, name_path);
-      if (0 == fileHandler.read(name)) {
-        if (name.compare(0, driverName.size(), driverName) == 0) {
-          device = iioPath + std::string(entry->d_name) + "/";
-          sensorFound = true;
-          break;
-        }
-      }
-    }
+  // The magnitude of INT_MIN is one more than INT_MAX
+  const int64_t limit = isNegative ? -static_cast<int64_t>(INT_MIN) : INT_MAX;
+  int64_t result = 0;
+  for (; begin != end; begin++) {
+    if ((*begin < '0') || (*begin > '9')) return false;
+    result = result * 10 + (*begin - '0');
+    if (result > limit) return false;
   }
 
-  closedir(dir);
-  return sensorFound;
+  value = static_cast<int>(isNegative ? -result : result);
+  return true;
+}
+
+bool isSensorAvailable(const std::string& driverName, std::string& device) {
+  const std::vector<std::string> devices = IioDeviceIndex::getInstance().find(driverName);
+  if (devices.empty()) return false;
+
+  device = devices.front();
+  return true;
 }
 
 }  // namespace bosch::hwctl
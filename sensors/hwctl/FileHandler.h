@@ -50,17 +50,34 @@ private:
   std::mutex mSysfsMutex;
 };
 
+/*
+ * Reads raw channel values on the sampling path. The attributes stay open and
+ * are read with pread() into a stack buffer, so a read does not allocate.
+ */
 class RawSysfsHandler {
 public:
+  RawSysfsHandler() = default;
+  ~RawSysfsHandler();
+
+  RawSysfsHandler(const RawSysfsHandler&) = delete;
+  RawSysfsHandler& operator=(const RawSysfsHandler&) = delete;
+
   void init(const std::string& path, const std::array<std::string, 3>& files);
-  int read(std::vector<float>& results, float resolution);
+  size_t addFile(const std::string& path, const std::string& file);
+  int read(std::array<float, 3>& results, float resolution);
+  int readRaw(size_t index, int& value);
+  int getFd(size_t index) const { return (index < mFds.size()) ? mFds[index] : -1; }
 
 private:
-  bool isValidInteger(const std::string& s) const;
-
-  std::vector<std::unique_ptr<ReadHandler>> mFileHandlers{};
+  std::vector<int> mFds{};
 };
 
+/*
+ * Parses a decimal integer as printed by the kernel, optionally surrounded by
+ * whitespace. Returns false for anything else or if the value overflows.
+ */
+bool parseInteger(const char* begin, const char* end, int& value);
+
 bool isSensorAvailable(const std::string& driverName, std::string& device);
 
 }  // namespace bosch::hwctl
@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "IioBuffer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "FileHandler.h"
+
+namespace bosch::hwctl {
+
+static const std::string SCAN_ELEMENTS_DIR = "scan_elements/";
+static const std::string BUFFER_ENABLE = "buffer/enable";
+static const std::string BUFFER_LENGTH = "buffer/length";
+static const std::string BUFFER_WATERMARK = "buffer/watermark";
+static const std::string BUFFER_HWFIFO_WATERMARK_MAX = "buffer/hwfifo_watermark_max";
+static const std::string TIMESTAMP_CHANNEL = "in_timestamp";
+static const std::string TIMESTAMP_CLOCK = "current_timestamp_clock";
+
+IioBuffer::IioBuffer(const std::string& path, const std::string& chardev) : mPath(path), mChardev(chardev) {}
+
+IioBuffer::~IioBuffer() { disable(); }
+
+bool IioBuffer::isAvailable() const {
+  return (access((mPath + BUFFER_ENABLE).c_str(), W_OK) == 0) &&
+         (access((mPath + SCAN_ELEMENTS_DIR).c_str(), R_OK) == 0) && (access(mChardev.c_str(), R_OK) == 0);
+}
+
+int IioBuffer::addChannel(const std::string& channel) {
+  for (size_t slot = 0; slot < mChannels.size(); slot++) {
+    if (mChannels[slot].name == channel) return slot;
+  }
+  if (mChannels.size() >= IIO_MAX_CHANNELS) return -1;
+
+  IioScanElement element{};
+  element.name = channel;
+  if (readScanElement(element) != 0) return -1;
+
+  const size_t length = mReadBuffer.size() / std::max<size_t>(mScanSize, 1);
+  mChannels.push_back(element);
+  updateLayout();
+
+  // Scan elements can only be changed while the buffer is disabled
+  if (isEnabled() && (restart(length) != 0)) return -1;
+
+  return mChannels.size() - 1;
+}
+
+int IioBuffer::addTimestamp() {
+  if (hasTimestamp()) return 0;
+
+  // The kernel defaults to CLOCK_REALTIME, timestamps are only usable if the
+  // device can be switched to the clock of elapsedRealtimeNano()
+  if (access((mPath + TIMESTAMP_CLOCK).c_str(), W_OK) != 0) return -1;
+  if (WriteHandler(mPath, TIMESTAMP_CLOCK).write("boottime") != 0) return -1;
+
+  const int slot = addChannel(TIMESTAMP_CHANNEL);
+  if (slot < 0) return -1;
+
+  mTimestampSlot = slot;
+  return 0;
+}
+
+/*
+ * The watermark is the number of scans the kernel collects before a reader is
+ * woken up. Drivers with a hardware FIFO derive their FIFO watermark from it.
+ */
+int IioBuffer::setWatermark(size_t watermark) {
+  watermark = std::max<size_t>(watermark, 1);
+  if (watermark == mWatermark) return 0;
+  if (access((mPath + BUFFER_WATERMARK).c_str(), W_OK) != 0) return -1;
+
+  mWatermark = watermark;
+  if (!isEnabled()) return 0;
+
+  // The watermark can only be changed while the buffer is disabled
+  return restart(mReadBuffer.size() / mScanSize);
+}
+
+int IioBuffer::getHwFifoLength() const {
+  std::string content;
+  int length = 0;
+  if (ReadHandler(mPath, BUFFER_HWFIFO_WATERMARK_MAX).read(content) != 0) return -1;
+  if (std::sscanf(content.c_str(), "%d", &length) != 1) return -1;
+  return length;
+}
+
+int IioBuffer::enable(size_t length) {
+  if (mChannels.empty() || (length == 0)) return -1;
+  if (isEnabled()) return 0;
+
+  if (configure(length) != 0) return -1;
+
+  mFd = ::open(mChardev.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+  if (mFd < 0) return -1;
+
+  if (WriteHandler(mPath, BUFFER_ENABLE).write("1") != 0) {
+    disable();
+    return -1;
+  }
+
+  mReadBuffer.assign(length * mScanSize, 0);
+  mPendingBytes = 0;
+  return 0;
+}
+
+/*
+ * Applies a changed configuration to an enabled buffer. The character device
+ * stays open, so a descriptor the caller watches remains valid. The scans
+ * queued in the kernel are discarded.
+ */
+int IioBuffer::restart(size_t length) {
+  if (configure(length) != 0) return -1;
+  if (WriteHandler(mPath, BUFFER_ENABLE).write("1") != 0) return -1;
+
+  mReadBuffer.assign(length * mScanSize, 0);
+  mPendingBytes = 0;
+  return 0;
+}
+
+// Leaves the buffer disabled with the scan elements, length and watermark set
+int IioBuffer::configure(size_t length) {
+  if (WriteHandler(mPath, BUFFER_ENABLE).write("0") != 0) return -1;
+  for (const auto& element : mChannels) {
+    if (writeChannelEnable(element, true) != 0) return -1;
+  }
+  if (WriteHandler(mPath, BUFFER_LENGTH).write(std::to_string(length)) != 0) return -1;
+  if (access((mPath + BUFFER_WATERMARK).c_str(), W_OK) == 0) {
+    WriteHandler(mPath, BUFFER_WATERMARK).write(std::to_string(std::min(mWatermark, length)));
+  }
+  return 0;
+}
+
+int IioBuffer::disable() {
+  if (!isEnabled()) return 0;
+
+  const int status = WriteHandler(mPath, BUFFER_ENABLE).write("0");
+  ::close(mFd);
+  mFd = -1;
+  mPendingBytes = 0;
+  return status;
+}
+
+int IioBuffer::read(std::vector<IioScan>& scans) {
+  if (!isEnabled()) return -1;
+
+  while (mPendingBytes < mReadBuffer.size()) {
+    const ssize_t count = ::read(mFd, mReadBuffer.data() + mPendingBytes, mReadBuffer.size() - mPendingBytes);
+    if (count > 0) {
+      mPendingBytes += count;
+    } else if ((count < 0) && (errno == EINTR)) {
+      continue;
+    } else if ((count < 0) && (errno != EAGAIN)) {
+      return -1;
+    } else {
+      break;
+    }
+  }
+
+  size_t offset = 0;
+  for (; offset + mScanSize <= mPendingBytes; offset += mScanSize) {
+    scans.emplace_back();
+    decode(mReadBuffer.data() + offset, scans.back());
+  }
+
+  // Keep an incomplete trailing scan for the next read
+  mPendingBytes -= offset;
+  if ((mPendingBytes > 0) && (offset > 0)) {
+    std::memmove(mReadBuffer.data(), mReadBuffer.data() + offset, mPendingBytes);
+  }
+
+  return 0;
+}
+
+int IioBuffer::readScanElement(IioScanElement& element) const {
+  std::string content;
+
+  if (ReadHandler(mPath, SCAN_ELEMENTS_DIR + element.name + "_index").read(content) != 0) return -1;
+  if (std::sscanf(content.c_str(), "%u", &element.index) != 1) return -1;
+
+  if (ReadHandler(mPath, SCAN_ELEMENTS_DIR + element.name + "_type").read(content) != 0) return -1;
+
+  char endianness = 0;
+  char sign = 0;
+  if (std::sscanf(content.c_str(), "%ce:%c%u/%u>>%u", &endianness, &sign, &element.realBits, &element.storageBits,
+                  &element.shift) != 5) {
+    return -1;
+  }
+  if ((element.storageBits == 0) || (element.storageBits > 64) || (element.storageBits % 8 != 0) ||
+      (element.realBits == 0) || (element.realBits > element.storageBits)) {
+    return -1;
+  }
+
+  element.isBigEndian = (endianness == 'b');
+  element.isSigned = (sign == 's');
+  return 0;
+}
+
+int IioBuffer::writeChannelEnable(const IioScanElement& element, bool enable) const {
+  return WriteHandler(mPath, SCAN_ELEMENTS_DIR + element.name + "_en").write(enable ? "1" : "0");
+}
+
+void IioBuffer::updateLayout() {
+  std::vector<IioScanElement*> ordered{};
+  for (auto& element : mChannels) ordered.push_back(&element);
+  std::sort(ordered.begin(), ordered.end(), [](const auto* a, const auto* b) { return a->index < b->index; });
+
+  // Every element is naturally aligned to its storage size and the scan is
+  // padded to the alignment of its largest element
+  size_t offset = 0;
+  size_t maxBytes = 1;
+  for (auto* element : ordered) {
+    const size_t bytes = element->storageBits / 8;
+    offset = (offset + bytes - 1) / bytes * bytes;
+    element->offset = offset;
+    offset += bytes;
+    maxBytes = std::max(maxBytes, bytes);
+  }
+  mScanSize = (offset + maxBytes - 1) / maxBytes * maxBytes;
+}
+
+void IioBuffer::decode(const uint8_t* data, IioScan& scan) const {
+  for (size_t slot = 0; slot < mChannels.size(); slot++) {
+    const auto& element = mChannels[slot];
+    const size_t bytes = element.storageBits / 8;
+
+    uint64_t raw = 0;
+    for (size_t i = 0; i < bytes; i++) {
+      const size_t byte = element.isBigEndian ? i : (bytes - 1 - i);
+      raw = (raw << 8) | data[element.offset + byte];
+    }
+
+    raw >>= element.shift;
+    if (element.realBits < 64) {
+      raw &= (uint64_t{1} << element.realBits) - 1;
+      if (element.isSigned && (raw & (uint64_t{1} << (element.realBits - 1)))) {
+        raw |= ~((uint64_t{1} << element.realBits) - 1);
+      }
+    }
+    scan.values[slot] = static_cast<int64_t>(raw);
+  }
+  scan.timestamp = hasTimestamp() ? scan.values[mTimestampSlot] : 0;
+}
+
+std::string getCharDevice(const std::string& path) {
+  std::string name = path;
+  while (!name.empty() && (name.back() == '/')) name.pop_back();
+  return "/dev/" + name.substr(name.find_last_of('/') + 1);
+}
+
+bool isCharDeviceReady(const std::string& path) {
+  if (access((path + BUFFER_ENABLE).c_str(), F_OK) != 0) return true;
+  return access(getCharDevice(path).c_str(), R_OK) == 0;
+}
+
+}  // namespace bosch::hwctl
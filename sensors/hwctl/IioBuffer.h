@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace bosch::hwctl {
+
+constexpr size_t IIO_MAX_CHANNELS = 8;
+
+struct IioScanElement {
+  std::string name;
+  uint32_t index;
+  bool isSigned;
+  bool isBigEndian;
+  uint32_t realBits;
+  uint32_t storageBits;
+  uint32_t shift;
+  size_t offset;
+};
+
+/*
+ * One decoded scan of the IIO buffer. Values are stored in the order in which
+ * the channels were added to the buffer, not in scan index order. The
+ * timestamp is the kernel capture time in CLOCK_BOOTTIME, or 0 if the device
+ * has no timestamp channel.
+ */
+struct IioScan {
+  std::array<int64_t, IIO_MAX_CHANNELS> values;
+  int64_t timestamp;
+};
+
+/*
+ * Buffered access to an IIO device: enables scan elements, configures the
+ * kernel buffer and reads packed scans in bulk from the character device.
+ */
+class IioBuffer {
+public:
+  IioBuffer(const std::string& path, const std::string& chardev);
+  ~IioBuffer();
+
+  IioBuffer(const IioBuffer&) = delete;
+  IioBuffer& operator=(const IioBuffer&) = delete;
+
+  bool isAvailable() const;
+  bool isEnabled() const { return mFd >= 0; }
+  int getFd() const { return mFd; }
+  bool hasTimestamp() const { return mTimestampSlot >= 0; }
+  size_t getWatermark() const { return mWatermark; }
+
+  int addChannel(const std::string& channel);
+  int addTimestamp();
+  int setWatermark(size_t watermark);
+  int getHwFifoLength() const;
+  int enable(size_t length);
+  int disable();
+  int read(std::vector<IioScan>& scans);
+
+private:
+  int restart(size_t length);
+  int configure(size_t length);
+  int readScanElement(IioScanElement& element) const;
+  int writeChannelEnable(const IioScanElement& element, bool enable) const;
+  void updateLayout();
+  void decode(const uint8_t* data, IioScan& scan) const;
+
+  const std::string mPath;
+  const std::string mChardev;
+
+  std::vector<IioScanElement> mChannels{};
+  int mTimestampSlot{-1};
+  size_t mScanSize{0};
+  size_t mWatermark{1};
+  int mFd{-1};
+  std::vector<uint8_t> mReadBuffer{};
+  size_t mPendingBytes{0};
+};
+
+std::string getCharDevice(const std::string& path);
+
+// A device without a buffer needs no character device, one with a buffer is
+// ready once ueventd has created the node and made it readable
+bool isCharDeviceReady(const std::string& path);
+
+}  // namespace bosch::hwctl
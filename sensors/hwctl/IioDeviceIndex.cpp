@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "IioDeviceIndex.h"
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+#include "FileHandler.h"
+
+namespace bosch::hwctl {
+
+static const std::string DEVICE_PREFIX = "iio:device";
+
+IioDeviceIndex::IioDeviceIndex(const std::string& iioPath) : mIioPath(iioPath) {}
+
+std::vector<std::string> IioDeviceIndex::find(const std::string& driverName) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  scanLocked();
+
+  std::vector<std::string> devices{};
+  for (const auto& [name, device] : mDevices) {
+    if (name.compare(0, driverName.size(), driverName) == 0) devices.push_back(device);
+  }
+  return devices;
+}
+
+std::string IioDeviceIndex::add(const std::string& entry) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  scanLocked();
+
+  const std::string device = getDevicePath(entry);
+  auto sameDevice = [&](const auto& indexed) { return indexed.second == device; };
+  if (std::any_of(mDevices.begin(), mDevices.end(), sameDevice)) return {};
+
+  std::string name;
+  ReadHandler(mIioPath, entry + "/name").read(name);
+  while (!name.empty() && (name.back() == '\n')) name.pop_back();
+  if (name.empty()) return {};
+
+  const int number = getDeviceNumber(entry);
+  auto position = std::find_if(mDevices.begin(), mDevices.end(), [&](const auto& indexed) {
+    return getDeviceNumber(indexed.second.substr(mIioPath.size())) > number;
+  });
+  mDevices.emplace(position, name, device);
+  return device;
+}
+
+std::string IioDeviceIndex::remove(const std::string& entry) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  scanLocked();
+
+  const std::string device = getDevicePath(entry);
+  auto position =
+    std::find_if(mDevices.begin(), mDevices.end(), [&](const auto& indexed) { return indexed.second == device; });
+  if (position == mDevices.end()) return {};
+  mDevices.erase(position);
+  return device;
+}
+
+void IioDeviceIndex::findChanges(std::vector<std::string>& added, std::vector<std::string>& removed) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  scanLocked();
+
+  const std::vector<std::string> entries = listEntries();
+  for (const auto& entry : entries) {
+    const std::string device = getDevicePath(entry);
+    auto sameDevice = [&](const auto& indexed) { return indexed.second == device; };
+    if (std::none_of(mDevices.begin(), mDevices.end(), sameDevice)) added.push_back(entry);
+  }
+  for (const auto& [_, device] : mDevices) {
+    const std::string entry = device.substr(mIioPath.size(), device.size() - mIioPath.size() - 1);
+    if (std::find(entries.begin(), entries.end(), entry) == entries.end()) removed.push_back(entry);
+  }
+}
+
+size_t IioDeviceIndex::getDeviceCount() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  scanLocked();
+  return mDevices.size();
+}
+
+int64_t IioDeviceIndex::getScanTimeNs() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  scanLocked();
+  return mScanTimeNs;
+}
+
+/*
+ * Reading a name may wake up the driver, so the names are read by a few
+ * threads in parallel.
+ */
+void IioDeviceIndex::scanLocked() {
+  if (mScanned) return;
+  mScanned = true;
+
+  const auto start = std::chrono::steady_clock::now();
+
+  const std::vector<std::string> entries = listEntries();
+  std::vector<std::string> names(entries.size());
+  std::atomic<size_t> next{0};
+  auto readNames = [&]() {
+    for (size_t i = next++; i < entries.size(); i = next++) {
+      ReadHandler(mIioPath, entries[i] + "/name").read(names[i]);
+      while (!names[i].empty() && (names[i].back() == '\n')) names[i].pop_back();
+    }
+  };
+
+  std::vector<std::thread> threads{};
+  const size_t threadCount = std::min(MAX_SCAN_THREADS, entries.size());
+  for (size_t i = 1; i < threadCount; i++) threads.emplace_back(readNames);
+  readNames();
+  for (auto& thread : threads) thread.join();
+
+  for (size_t i = 0; i < entries.size(); i++) {
+    if (!names[i].empty()) mDevices.emplace_back(names[i], mIioPath + entries[i] + "/");
+  }
+
+  mScanTimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::vector<std::string> IioDeviceIndex::listEntries() const {
+  std::vector<std::string> entries{};
+  DIR* dir = opendir(mIioPath.c_str());
+  if (dir != nullptr) {
+    for (dirent* entry = readdir(dir); entry != nullptr; entry = readdir(dir)) {
+      if (DEVICE_PREFIX.compare(0, DEVICE_PREFIX.size(), entry->d_name, DEVICE_PREFIX.size()) == 0) {
+        entries.push_back(entry->d_name);
+      }
+    }
+    closedir(dir);
+  }
+
+  // Device numbers give a stable order, readdir does not
+  std::sort(entries.begin(), entries.end(),
+            [](const std::string& a, const std::string& b) { return getDeviceNumber(a) < getDeviceNumber(b); });
+  return entries;
+}
+
+int IioDeviceIndex::getDeviceNumber(const std::string& entry) {
+  return std::atoi(entry.c_str() + std::min(DEVICE_PREFIX.size(), entry.size()));
+}
+
+}  // namespace bosch::hwctl
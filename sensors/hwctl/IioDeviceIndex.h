@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace bosch::hwctl {
+
+/*
+ * Index of the IIO devices by name. The bus is scanned once and every sensor
+ * resolves its driver against the index instead of walking the bus again.
+ * Devices that appear or disappear later are added and removed one by one.
+ */
+class IioDeviceIndex {
+public:
+  static IioDeviceIndex& getInstance() {
+    static IioDeviceIndex instance("/sys/bus/iio/devices/");
+    return instance;
+  }
+
+  explicit IioDeviceIndex(const std::string& iioPath);
+
+  // Device paths of all devices whose name starts with the driver name, in
+  // the order of the device numbers
+  std::vector<std::string> find(const std::string& driverName);
+
+  // Entries are directories on the bus, e.g. iio:device3. Both return the
+  // device path, or an empty string if the index is unchanged.
+  std::string add(const std::string& entry);
+  std::string remove(const std::string& entry);
+
+  // Entries on the bus that the index lacks, and indexed entries that are
+  // gone from the bus, e.g. after uevents were lost. The index is unchanged.
+  void findChanges(std::vector<std::string>& added, std::vector<std::string>& removed);
+
+  std::string getDevicePath(const std::string& entry) const { return mIioPath + entry + "/"; }
+  size_t getDeviceCount();
+  int64_t getScanTimeNs();
+
+private:
+  static constexpr size_t MAX_SCAN_THREADS = 4;
+
+  void scanLocked();
+  std::vector<std::string> listEntries() const;
+  static int getDeviceNumber(const std::string& entry);
+
+  const std::string mIioPath;
+  bool mScanned{false};
+  // Names and paths in the order of the device numbers
+  std::vector<std::pair<std::string, std::string>> mDevices{};
+  int64_t mScanTimeNs{0};
+  std::mutex mMutex;
+};
+
+}  // namespace bosch::hwctl
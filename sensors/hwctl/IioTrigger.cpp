@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "IioTrigger.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "FileHandler.h"
+
+namespace bosch::hwctl {
+
+static const std::string CURRENT_TRIGGER = "trigger/current_trigger";
+static const std::string SAMPLING_FREQUENCY = "sampling_frequency";
+static const std::string DEVICE_PREFIX = "iio:device";
+static const std::string TRIGGER_PREFIX = "trigger";
+
+static std::string readAttribute(const std::string& path, const std::string& file) {
+  std::string content;
+  if (ReadHandler(path, file).read(content) != 0) return {};
+  while (!content.empty() && ((content.back() == '\n') || (content.back() == ' '))) content.pop_back();
+  return content;
+}
+
+IioTrigger::IioTrigger(const std::string& path, const std::string& hrtimerPath)
+  : mPath(path), mHrtimerPath(hrtimerPath) {
+  // Triggers are listed next to the devices, e.g. /sys/bus/iio/devices/trigger0
+  std::string device = path;
+  while (!device.empty() && (device.back() == '/')) device.pop_back();
+  const size_t separator = device.find_last_of('/');
+  mTriggersPath = device.substr(0, separator + 1);
+
+  const std::string deviceDir = device.substr(separator + 1);
+  if (deviceDir.compare(0, DEVICE_PREFIX.size(), DEVICE_PREFIX) == 0) mDeviceId = deviceDir.substr(DEVICE_PREFIX.size());
+  mDeviceName = readAttribute(mPath, "name");
+}
+
+IioTrigger::~IioTrigger() { detach(); }
+
+bool IioTrigger::isAvailable() const { return access((mPath + CURRENT_TRIGGER).c_str(), W_OK) == 0; }
+
+int IioTrigger::attach() {
+  if (isAttached()) return 0;
+  if (!isAvailable()) return -1;
+  if (!readAttribute(mPath, CURRENT_TRIGGER).empty()) return 0;
+
+  mTriggerName = findDataReadyTrigger();
+  if (mTriggerName.empty() && (createHrtimer() != 0)) return -1;
+
+  if (WriteHandler(mPath, CURRENT_TRIGGER).write(mTriggerName) != 0) {
+    detach();
+    return -1;
+  }
+  return 0;
+}
+
+int IioTrigger::detach() {
+  if (!isAttached()) return 0;
+
+  // A bare newline clears the trigger, an empty write would not reach the driver
+  int status = WriteHandler(mPath, CURRENT_TRIGGER).write("\n");
+  if (mIsHrtimer && (rmdir((mHrtimerPath + mTriggerName).c_str()) != 0)) status = -1;
+
+  mTriggerName.clear();
+  mTriggerPath.clear();
+  mIsHrtimer = false;
+  return status;
+}
+
+int IioTrigger::setSamplingPeriod(int64_t samplingPeriodNs) {
+  // A data-ready trigger follows the output data rate of the device
+  if (!mIsHrtimer || (samplingPeriodNs <= 0)) return 0;
+
+  // Kernels before 6.7 only parse an integer frequency, it is rounded up so
+  // that the trigger is never slower than requested
+  const int64_t frequencyHz = (1000000000 + samplingPeriodNs - 1) / samplingPeriodNs;
+  return WriteHandler(mTriggerPath, SAMPLING_FREQUENCY).write(std::to_string(frequencyHz));
+}
+
+/*
+ * Drivers name their data-ready trigger after the device, "<name>-dev<id>".
+ */
+std::string IioTrigger::findDataReadyTrigger() const {
+  if (mDeviceName.empty() || mDeviceId.empty()) return {};
+
+  const std::string name = mDeviceName + "-dev" + mDeviceId;
+  return findTrigger(name).empty() ? std::string{} : name;
+}
+
+std::string IioTrigger::findTrigger(const std::string& name) const {
+  DIR* dir = opendir(mTriggersPath.c_str());
+  if (dir == nullptr) return {};
+
+  std::string triggerPath{};
+  for (dirent* entry = readdir(dir); entry != nullptr; entry = readdir(dir)) {
+    if (TRIGGER_PREFIX.compare(0, TRIGGER_PREFIX.size(), entry->d_name, TRIGGER_PREFIX.size()) != 0) continue;
+
+    const std::string path = mTriggersPath + entry->d_name + "/";
+    if (readAttribute(path, "name") == name) {
+      triggerPath = path;
+      break;
+    }
+  }
+
+  closedir(dir);
+  return triggerPath;
+}
+
+int IioTrigger::createHrtimer() {
+  if (mDeviceId.empty()) return -1;
+
+  // The trigger is named after the configfs directory
+  const std::string name = "bosch-hrtimer-dev" + mDeviceId;
+  if ((mkdir((mHrtimerPath + name).c_str(), 0755) != 0) && (errno != EEXIST)) return -1;
+
+  mTriggerName = name;
+  mIsHrtimer = true;
+  mTriggerPath = findTrigger(name);
+  if (mTriggerPath.empty()) {
+    detach();
+    return -1;
+  }
+  return 0;
+}
+
+}  // namespace bosch::hwctl
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace bosch::hwctl {
+
+/*
+ * Trigger that paces the buffered capture of an IIO device. The data-ready
+ * trigger of the device is preferred, if it has none an hrtimer trigger is
+ * created through configfs and runs at the sampling rate of the device.
+ *
+ * A trigger that was already selected by someone else is left untouched.
+ * Triggers can only be changed while the buffer is disabled.
+ */
+class IioTrigger {
+public:
+  explicit IioTrigger(const std::string& path, const std::string& hrtimerPath = "/config/iio/triggers/hrtimer/");
+  ~IioTrigger();
+
+  IioTrigger(const IioTrigger&) = delete;
+  IioTrigger& operator=(const IioTrigger&) = delete;
+
+  bool isAvailable() const;
+  bool isAttached() const { return !mTriggerName.empty(); }
+  bool isHrtimer() const { return mIsHrtimer; }
+  const std::string& getName() const { return mTriggerName; }
+
+  int attach();
+  int detach();
+  int setSamplingPeriod(int64_t samplingPeriodNs);
+
+private:
+  std::string findDataReadyTrigger() const;
+  std::string findTrigger(const std::string& name) const;
+  int createHrtimer();
+
+  const std::string mPath;
+  const std::string mHrtimerPath;
+  std::string mTriggersPath{};
+  std::string mDeviceName{};
+  std::string mDeviceId{};
+
+  std::string mTriggerName{};
+  std::string mTriggerPath{};
+  bool mIsHrtimer{false};
+};
+
+}  // namespace bosch::hwctl
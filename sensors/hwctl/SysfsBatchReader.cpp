@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SysfsBatchReader.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "FileHandler.h"
+
+namespace bosch::hwctl {
+
+SysfsBatchReader::SysfsBatchReader(bool useUring) {
+  if (useUring && !setupUring()) closeUring();
+}
+
+SysfsBatchReader::~SysfsBatchReader() { closeUring(); }
+
+bool SysfsBatchReader::setupUring() {
+  io_uring_params params{};
+  mRingFd = syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+  if ((mRingFd < 0) || !isReadSupported()) return false;
+
+  mSqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  mCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  const bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (singleMmap) mSqRingSize = mCqRingSize = std::max(mSqRingSize, mCqRingSize);
+
+  void* sqRing = mmap(nullptr, mSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd,
+                      IORING_OFF_SQ_RING);
+  if (sqRing == MAP_FAILED) return false;
+  mSqRing = sqRing;
+
+  if (singleMmap) {
+    mCqRing = mSqRing;
+  } else {
+    void* cqRing = mmap(nullptr, mCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd,
+                        IORING_OFF_CQ_RING);
+    if (cqRing == MAP_FAILED) return false;
+    mCqRing = cqRing;
+  }
+
+  mSqesSize = params.sq_entries * sizeof(io_uring_sqe);
+  void* sqes = mmap(nullptr, mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) return false;
+  mSqes = static_cast<io_uring_sqe*>(sqes);
+
+  char* sq = static_cast<char*>(mSqRing);
+  char* cq = static_cast<char*>(mCqRing);
+  mSqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  mSqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  mSqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  mCqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  mCqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  mCqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  mCqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+  mEntries = params.sq_entries;
+  return true;
+}
+
+/*
+ * IORING_OP_READ came after io_uring itself, a kernel without it fails every
+ * read with EINVAL. The probe is as old as the opcode, a kernel that cannot
+ * probe lacks it as well.
+ */
+bool SysfsBatchReader::isReadSupported() const {
+  alignas(io_uring_probe) std::array<uint8_t, sizeof(io_uring_probe) + PROBE_OPS * sizeof(io_uring_probe_op)> buffer{};
+  auto* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+  if (syscall(__NR_io_uring_register, mRingFd, IORING_REGISTER_PROBE, probe, PROBE_OPS) < 0) return false;
+
+  return (IORING_OP_READ < probe->ops_len) && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+}
+
+void SysfsBatchReader::closeUring() {
+  if (mSqes != nullptr) munmap(mSqes, mSqesSize);
+  if ((mCqRing != nullptr) && (mCqRing != mSqRing)) munmap(mCqRing, mCqRingSize);
+  if (mSqRing != nullptr) munmap(mSqRing, mSqRingSize);
+  if (mRingFd >= 0) close(mRingFd);
+
+  mSqes = nullptr;
+  mCqRing = nullptr;
+  mSqRing = nullptr;
+  mRingFd = -1;
+}
+
+void SysfsBatchReader::read(std::vector<SysfsRead>& reads) {
+  if (mBuffers.size() < std::min<size_t>(reads.size(), RING_ENTRIES)) {
+    mBuffers.resize(std::min<size_t>(reads.size(), RING_ENTRIES));
+  }
+
+  for (size_t offset = 0; offset < reads.size(); offset += RING_ENTRIES) {
+    const size_t count = std::min<size_t>(reads.size() - offset, RING_ENTRIES);
+    if (isUring() && (readUring(&reads[offset], count) == 0)) continue;
+
+    // The ring itself failed, e.g. because the sepolicy denies io_uring_enter
+    closeUring();
+    readSequential(&reads[offset], count);
+  }
+}
+
+int SysfsBatchReader::readUring(SysfsRead* reads, size_t count) {
+  unsigned tail = *mSqTail;
+  for (size_t i = 0; i < count; i++) {
+    const unsigned index = tail & *mSqMask;
+    io_uring_sqe* sqe = &mSqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = reads[i].fd;
+    sqe->addr = reinterpret_cast<uint64_t>(mBuffers[i].data());
+    sqe->len = VALUE_LENGTH;
+    sqe->off = 0;
+    sqe->user_data = i;
+    mSqArray[index] = index;
+    tail++;
+  }
+  __atomic_store_n(mSqTail, tail, __ATOMIC_RELEASE);
+
+  size_t submitted = count;
+  size_t completed = 0;
+  while (completed < count) {
+    const int ret = syscall(__NR_io_uring_enter, mRingFd, submitted, count - completed, IORING_ENTER_GETEVENTS,
+                            nullptr, 0);
+    if ((ret < 0) && (errno != EINTR)) return -1;
+    if (ret > 0) submitted -= std::min<size_t>(ret, submitted);
+
+    unsigned head = *mCqHead;
+    const unsigned cqTail = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE);
+    for (; head != cqTail; head++) {
+      // An error only fails the read of its own attribute
+      const io_uring_cqe& cqe = mCqes[head & *mCqMask];
+      parse(reads[cqe.user_data], cqe.user_data, cqe.res);
+      completed++;
+    }
+    __atomic_store_n(mCqHead, head, __ATOMIC_RELEASE);
+  }
+  return 0;
+}
+
+void SysfsBatchReader::readSequential(SysfsRead* reads, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    const ssize_t length = pread(reads[i].fd, mBuffers[i].data(), VALUE_LENGTH, 0);
+    parse(reads[i], i, (length < 0) ? -errno : length);
+  }
+}
+
+void SysfsBatchReader::parse(SysfsRead& read, size_t index, int64_t length) {
+  if ((length <= 0) || (length == static_cast<int64_t>(VALUE_LENGTH))) {
+    read.status = -1;
+    return;
+  }
+
+  const char* buffer = mBuffers[index].data();
+  read.status = parseInteger(buffer, buffer + length, read.value) ? 0 : -1;
+}
+
+}  // namespace bosch::hwctl
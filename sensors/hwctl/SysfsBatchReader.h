@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace bosch::hwctl {
+
+struct SysfsRead {
+  int fd;
+  int value;
+  int status;
+};
+
+/*
+ * Reads a batch of raw integer attributes at once. With io_uring all reads
+ * are submitted and completed in one system call, otherwise they fall back to
+ * sequential pread(). io_uring is only used if the kernel supports
+ * IORING_OP_READ, which is probed once at setup. A read that fails only fails
+ * its attribute, the fallback is permanent once the ring itself failed, for
+ * example because the sepolicy denies it.
+ */
+class SysfsBatchReader {
+public:
+  explicit SysfsBatchReader(bool useUring = true);
+  ~SysfsBatchReader();
+
+  SysfsBatchReader(const SysfsBatchReader&) = delete;
+  SysfsBatchReader& operator=(const SysfsBatchReader&) = delete;
+
+  bool isUring() const { return mRingFd >= 0; }
+
+  // Fills in value and status of each read, 0 on success
+  void read(std::vector<SysfsRead>& reads);
+
+private:
+  static constexpr unsigned RING_ENTRIES = 32;
+  static constexpr size_t VALUE_LENGTH = 32;
+  static constexpr unsigned PROBE_OPS = 256;
+
+  bool setupUring();
+  bool isReadSupported() const;
+  void closeUring();
+  int readUring(SysfsRead* reads, size_t count);
+  void readSequential(SysfsRead* reads, size_t count);
+  void parse(SysfsRead& read, size_t index, int64_t length);
+
+  std::vector<std::array<char, VALUE_LENGTH>> mBuffers{};
+
+  int mRingFd{-1};
+  void* mSqRing{nullptr};
+  void* mCqRing{nullptr};
+  size_t mSqRingSize{0};
+  size_t mCqRingSize{0};
+  io_uring_sqe* mSqes{nullptr};
+  size_t mSqesSize{0};
+
+  unsigned* mSqTail{nullptr};
+  unsigned* mSqMask{nullptr};
+  unsigned* mSqArray{nullptr};
+  unsigned* mCqHead{nullptr};
+  unsigned* mCqTail{nullptr};
+  unsigned* mCqMask{nullptr};
+  io_uring_cqe* mCqes{nullptr};
+  unsigned mEntries{0};
+};
+
+}  // namespace bosch::hwctl
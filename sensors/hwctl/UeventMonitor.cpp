@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "UeventMonitor.h"
+
+#include <errno.h>
+#include <linux/netlink.h>
+#include <log/log.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+
+namespace bosch::hwctl {
+
+static const std::string DEVICE_PREFIX = "iio:device";
+
+UeventMonitor::UeventMonitor() {
+  mFd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT);
+  if (mFd < 0) {
+    ALOGE("UeventMonitor socket failed: %d", errno);
+    return;
+  }
+
+  // Devices may come in bursts, e.g. when a driver module is loaded
+  (void)setsockopt(mFd, SOL_SOCKET, SO_RCVBUF, &RECEIVE_BUFFER_SIZE, sizeof(RECEIVE_BUFFER_SIZE));
+  // The credentials of the sender tell kernel events from forged ones
+  const int passCredentials = 1;
+  (void)setsockopt(mFd, SOL_SOCKET, SO_PASSCRED, &passCredentials, sizeof(passCredentials));
+
+  sockaddr_nl address{};
+  address.nl_family = AF_NETLINK;
+  address.nl_groups = 1;  // Kernel events, not the ones rebroadcast by udev
+  if (bind(mFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+    ALOGE("UeventMonitor bind failed: %d", errno);
+    close(mFd);
+    mFd = -1;
+  }
+}
+
+UeventMonitor::~UeventMonitor() {
+  if (mFd >= 0) close(mFd);
+}
+
+/*
+ * Returns the events of IIO devices, other uevents are dropped. Fails with
+ * errno set, ENOBUFS if the socket overflowed and events were lost.
+ *
+ * Any process can send to the multicast group, only messages that come from
+ * the kernel as root are accepted.
+ */
+int UeventMonitor::read(std::vector<Uevent>& events) {
+  if (mFd < 0) return -1;
+
+  char message[MESSAGE_SIZE];
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(ucred))];
+  while (true) {
+    sockaddr_nl address{};
+    iovec vector{message, sizeof(message)};
+    msghdr header{};
+    header.msg_name = &address;
+    header.msg_namelen = sizeof(address);
+    header.msg_iov = &vector;
+    header.msg_iovlen = 1;
+    header.msg_control = control;
+    header.msg_controllen = sizeof(control);
+
+    const ssize_t length = recvmsg(mFd, &header, 0);
+    if (length < 0) {
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) return 0;
+      if (errno == EINTR) continue;
+      // On ENOBUFS the kernel dropped events, the caller has to resynchronize
+      return -1;
+    }
+
+    const cmsghdr* cmsg = CMSG_FIRSTHDR(&header);
+    if ((cmsg == nullptr) || (cmsg->cmsg_level != SOL_SOCKET) || (cmsg->cmsg_type != SCM_CREDENTIALS)) continue;
+    const auto* credentials = reinterpret_cast<const ucred*>(CMSG_DATA(cmsg));
+    if ((address.nl_pid != 0) || (credentials->uid != 0)) {
+      ALOGW("UeventMonitor dropped a message from pid %u uid %u", address.nl_pid, credentials->uid);
+      continue;
+    }
+    if (header.msg_flags & MSG_TRUNC) continue;
+
+    Uevent event{};
+    if (parse(message, length, event)) events.push_back(event);
+  }
+}
+
+/*
+ * A message consists of a header line and NUL separated KEY=value pairs, e.g.
+ * "add@/devices/.../iio:device3\0ACTION=add\0DEVPATH=...\0SUBSYSTEM=iio\0".
+ */
+bool UeventMonitor::parse(const char* message, size_t length, Uevent& event) {
+  std::string action{};
+  std::string devicePath{};
+  std::string subsystem{};
+  std::string deviceType{};
+
+  const char* end = message + length;
+  for (const char* field = message; field < end; field += strnlen(field, end - field) + 1) {
+    const std::string entry(field, strnlen(field, end - field));
+    const size_t separator = entry.find('=');
+    if (separator == std::string::npos) continue;
+
+    const std::string key = entry.substr(0, separator);
+    const std::string value = entry.substr(separator + 1);
+    if (key == "ACTION") {
+      action = value;
+    } else if (key == "DEVPATH") {
+      devicePath = value;
+    } else if (key == "SUBSYSTEM") {
+      subsystem = value;
+    } else if (key == "DEVTYPE") {
+      deviceType = value;
+    }
+  }
+
+  // Triggers are on the IIO bus as well
+  if ((subsystem != "iio") || (!deviceType.empty() && (deviceType != "iio_device"))) return false;
+
+  const std::string device = devicePath.substr(devicePath.find_last_of('/') + 1);
+  if (device.compare(0, DEVICE_PREFIX.size(), DEVICE_PREFIX) != 0) return false;
+
+  if (action == "add") {
+    event.action = Uevent::ADD;
+  } else if (action == "remove") {
+    event.action = Uevent::REMOVE;
+  } else {
+    return false;
+  }
+  event.device = device;
+  return true;
+}
+
+}  // namespace bosch::hwctl
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace bosch::hwctl {
+
+struct Uevent {
+  enum Action { ADD, REMOVE };
+
+  Action action;
+  // Directory of the device below the IIO bus, e.g. iio:device3
+  std::string device;
+};
+
+/*
+ * Kernel uevents of IIO devices that are added or removed, e.g. by a driver
+ * that probes late. The socket is non-blocking, the owner waits for it to
+ * become readable and then reads all pending events.
+ */
+class UeventMonitor {
+public:
+  UeventMonitor();
+  ~UeventMonitor();
+
+  UeventMonitor(const UeventMonitor&) = delete;
+  UeventMonitor& operator=(const UeventMonitor&) = delete;
+
+  bool isOpen() const { return mFd >= 0; }
+  int getFd() const { return mFd; }
+
+  int read(std::vector<Uevent>& events);
+
+  static bool parse(const char* message, size_t length, Uevent& event);
+
+private:
+  static constexpr size_t MESSAGE_SIZE = 4096;
+  static constexpr int RECEIVE_BUFFER_SIZE = 64 * 1024;
+
+  int mFd{-1};
+};
+
+}  // namespace bosch::hwctl
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <sys/stat.h>
+
+#include <fstream>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "FileHandler.h"
+#include "TempDir.h"
+
+/*
+ * Per-sample cost of reading three raw axes from a fake sysfs tree. The
+ * previous reader, an ifstream per attribute validated by a regex and parsed
+ * by std::stoi into a vector, is kept here as the baseline.
+ */
+
+namespace {
+
+const std::array<std::string, 3> kAxes{"in_accel_x_raw", "in_accel_y_raw", "in_accel_z_raw"};
+
+class FakeSysfsTree {
+public:
+  FakeSysfsTree() {
+    mPath = mDir.path();
+    std::ofstream(mPath + kAxes[0]) << "-1234\n";
+    std::ofstream(mPath + kAxes[1]) << "56\n";
+    std::ofstream(mPath + kAxes[2]) << "4096\n";
+  }
+
+  const std::string& path() const { return mPath; }
+
+private:
+  bosch::hwctl::TempDir mDir{"sysfsbench"};
+  std::string mPath;
+};
+
+class StreamRegexReader {
+public:
+  StreamRegexReader(const std::string& path) {
+    for (const auto& axis : kAxes) mFileHandlers.push_back(std::make_unique<bosch::hwctl::ReadHandler>(path, axis));
+  }
+
+  int read(std::vector<float>& results, float resolution) {
+    static const std::regex number_regex(R"(^\s*[-+]?(?:\d+(?:\.\d*)?|\.\d+)(?:[eE][-+]?\d+)?\s*$)");
+    for (const auto& handler : mFileHandlers) {
+      std::string content;
+      if (handler->read(content) != 0) return -1;
+      if (!std::regex_match(content, number_regex)) return -1;
+      results.push_back(std::stoi(content) * resolution);
+    }
+    return 0;
+  }
+
+private:
+  std::vector<std::unique_ptr<bosch::hwctl::ReadHandler>> mFileHandlers{};
+};
+
+}  // namespace
+
+static void BM_StreamRegexRead(benchmark::State& state) {
+  FakeSysfsTree tree;
+  StreamRegexReader reader(tree.path());
+  for (auto _ : state) {
+    std::vector<float> results;
+    if (reader.read(results, 0.5f) != 0) state.SkipWithError("read failed");
+    benchmark::DoNotOptimize(results);
+  }
+}
+BENCHMARK(BM_StreamRegexRead);
+
+static void BM_RawSysfsRead(benchmark::State& state) {
+  FakeSysfsTree tree;
+  bosch::hwctl::RawSysfsHandler handler;
+  handler.init(tree.path(), kAxes);
+  for (auto _ : state) {
+    std::array<float, 3> results;
+    if (handler.read(results, 0.5f) != 0) state.SkipWithError("read failed");
+    benchmark::DoNotOptimize(results);
+  }
+}
+BENCHMARK(BM_RawSysfsRead);
+
+static void BM_ParseInteger(benchmark::State& state) {
+  const std::string text = "-1234\n";
+  for (auto _ : state) {
+    int value = 0;
+    benchmark::DoNotOptimize(bosch::hwctl::parseInteger(text.data(), text.data() + text.size(), value));
+    benchmark::DoNotOptimize(value);
+  }
+}
+BENCHMARK(BM_ParseInteger);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "FileHandler.h"
+#include "SysfsBatchReader.h"
+#include "TempDir.h"
+
+/*
+ * Cost of polling the three axes of a number of devices, regular files stand
+ * in for the sysfs attributes. The argument is the number of devices.
+ */
+
+namespace {
+
+class FakeDevices {
+public:
+  explicit FakeDevices(int devices) {
+    mPath = mDir.path();
+    for (int i = 0; i < devices * 3; i++) {
+      const std::string file = mPath + "in_raw" + std::to_string(i);
+      std::ofstream(file) << (i * 37 - 512) << "\n";
+      mFds.push_back(open(file.c_str(), O_RDONLY | O_CLOEXEC));
+    }
+  }
+
+  ~FakeDevices() {
+    for (const int fd : mFds) close(fd);
+  }
+
+  std::vector<bosch::hwctl::SysfsRead> reads() const {
+    std::vector<bosch::hwctl::SysfsRead> reads;
+    for (const int fd : mFds) reads.push_back({fd, 0, -1});
+    return reads;
+  }
+
+private:
+  bosch::hwctl::TempDir mDir{"batchbench"};
+  std::string mPath;
+  std::vector<int> mFds;
+};
+
+void runBatch(benchmark::State& state, bool useUring) {
+  FakeDevices devices(state.range(0));
+  bosch::hwctl::SysfsBatchReader reader(useUring);
+  if (useUring && !reader.isUring()) {
+    state.SkipWithError("io_uring not available");
+    return;
+  }
+
+  auto reads = devices.reads();
+  for (auto _ : state) {
+    reader.read(reads);
+    benchmark::DoNotOptimize(reads.data());
+  }
+  state.SetItemsProcessed(state.iterations() * reads.size());
+}
+
+}  // namespace
+
+static void BM_BatchSequential(benchmark::State& state) { runBatch(state, false); }
+BENCHMARK(BM_BatchSequential)->Arg(1)->Arg(2)->Arg(4);
+
+static void BM_BatchUring(benchmark::State& state) { runBatch(state, true); }
+BENCHMARK(BM_BatchUring)->Arg(1)->Arg(2)->Arg(4);
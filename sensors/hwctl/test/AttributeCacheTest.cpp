@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+
+#include "AttributeCache.h"
+#include "TempDir.h"
+
+using bosch::hwctl::AttributeCache;
+
+namespace {
+
+class FakeDevice {
+public:
+  FakeDevice() { mPath = mDir.path(); }
+
+  void writeFile(const std::string& file, const std::string& content) { std::ofstream(mPath + file) << content; }
+
+  std::string readFile(const std::string& file) {
+    std::ifstream stream(mPath + file);
+    return std::string((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+  }
+
+  const std::string& path() const { return mPath; }
+
+private:
+  bosch::hwctl::TempDir mDir{"attrtest"};
+  std::string mPath;
+};
+
+}  // namespace
+
+TEST(AttributeCacheTest, SkipsUnchangedValues) {
+  FakeDevice device;
+  device.writeFile("in_sampling_frequency", "0");
+
+  AttributeCache cache(device.path());
+  ASSERT_EQ(0, cache.write("in_sampling_frequency", "100"));
+  EXPECT_EQ("100", device.readFile("in_sampling_frequency"));
+
+  // A change behind the back of the cache shows whether it wrote again
+  device.writeFile("in_sampling_frequency", "0");
+  ASSERT_EQ(0, cache.write("in_sampling_frequency", "100"));
+  EXPECT_EQ("0", device.readFile("in_sampling_frequency"));
+
+  ASSERT_EQ(0, cache.write("in_sampling_frequency", "200"));
+  EXPECT_EQ("200", device.readFile("in_sampling_frequency"));
+
+  device.writeFile("in_sampling_frequency", "0");
+  cache.invalidate();
+  ASSERT_EQ(0, cache.write("in_sampling_frequency", "200"));
+  EXPECT_EQ("200", device.readFile("in_sampling_frequency"));
+}
+
+TEST(AttributeCacheTest, ReopensAttributesAfterInvalidate) {
+  FakeDevice device;
+  device.writeFile("in_sampling_frequency", "0");
+
+  auto cache = AttributeCache::getInstance(device.path());
+  ASSERT_EQ(0, cache->write("in_sampling_frequency", "100"));
+
+  // A device that comes back under the same path has new attributes
+  ASSERT_EQ(0, unlink((device.path() + "in_sampling_frequency").c_str()));
+  device.writeFile("in_sampling_frequency", "0");
+  AttributeCache::invalidateInstance(device.path());
+  ASSERT_EQ(0, cache->write("in_sampling_frequency", "100"));
+  EXPECT_EQ("100", device.readFile("in_sampling_frequency"));
+}
+
+TEST(AttributeCacheTest, FailsForMissingAttribute) {
+  FakeDevice device;
+  AttributeCache cache(device.path());
+  EXPECT_NE(0, cache.write("in_missing", "1"));
+}
+
+TEST(AttributeCacheTest, CommitsTransactionInOrder) {
+  FakeDevice device;
+  device.writeFile("odr", "");
+  device.writeFile("pwr", "");
+
+  AttributeCache cache(device.path());
+  ASSERT_EQ(0, AttributeCache::Transaction(cache).set("odr", "200Hz").set("pwr", "normal").commit());
+  EXPECT_EQ("200Hz", device.readFile("odr"));
+  EXPECT_EQ("normal", device.readFile("pwr"));
+
+  device.writeFile("odr", "");
+  ASSERT_EQ(0, AttributeCache::Transaction(cache).set("odr", "200Hz").set("pwr", "suspend").commit());
+  EXPECT_EQ("", device.readFile("odr"));
+  EXPECT_EQ("suspend", device.readFile("pwr"));
+
+  // The remaining writes are still applied, unlike sysfs a regular file keeps
+  // the tail of a longer previous value
+  EXPECT_NE(0, AttributeCache::Transaction(cache).set("in_missing", "1").set("pwr", "normal").commit());
+  EXPECT_EQ(0u, device.readFile("pwr").find("normal"));
+}
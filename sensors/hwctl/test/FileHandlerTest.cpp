@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include "FileHandler.h"
+#include "TempDir.h"
+
+using bosch::hwctl::parseInteger;
+using bosch::hwctl::RawSysfsHandler;
+
+namespace {
+
+bool parse(const char* text, int& value) { return parseInteger(text, text + strlen(text), value); }
+
+class FakeSysfsDirectory {
+public:
+  FakeSysfsDirectory() { mPath = mDir.path(); }
+
+  void writeFile(const std::string& file, const std::string& content) { std::ofstream(mPath + file) << content; }
+
+  const std::string& path() const { return mPath; }
+
+private:
+  bosch::hwctl::TempDir mDir{"sysfstest"};
+  std::string mPath;
+};
+
+}  // namespace
+
+TEST(FileHandlerTest, ParsesKernelIntegers) {
+  int value = 0;
+  EXPECT_TRUE(parse("123\n", value));
+  EXPECT_EQ(123, value);
+  EXPECT_TRUE(parse("-4096\n", value));
+  EXPECT_EQ(-4096, value);
+  EXPECT_TRUE(parse(" +7 ", value));
+  EXPECT_EQ(7, value);
+  EXPECT_TRUE(parse("2147483647", value));
+  EXPECT_EQ(INT_MAX, value);
+  EXPECT_TRUE(parse("-2147483648", value));
+  EXPECT_EQ(INT_MIN, value);
+}
+
+TEST(FileHandlerTest, RejectsMalformedIntegers) {
+  int value = 42;
+  for (const char* text : {"", "\n", "-", "+\n", "12a", "1 2", "1.5", "1e3", "0x10", "2147483648", "-2147483649"}) {
+    EXPECT_FALSE(parse(text, value)) << text;
+  }
+  EXPECT_EQ(42, value);
+}
+
+TEST(FileHandlerTest, ReadsRawValuesRepeatedly) {
+  FakeSysfsDirectory sysfs;
+  sysfs.writeFile("in_accel_x_raw", "100\n");
+  sysfs.writeFile("in_accel_y_raw", "-200\n");
+  sysfs.writeFile("in_accel_z_raw", "invalid\n");
+
+  RawSysfsHandler handler;
+  EXPECT_EQ(0u, handler.addFile(sysfs.path(), "in_accel_x_raw"));
+  EXPECT_EQ(1u, handler.addFile(sysfs.path(), "in_accel_y_raw"));
+  EXPECT_EQ(2u, handler.addFile(sysfs.path(), "in_accel_z_raw"));
+  EXPECT_EQ(3u, handler.addFile(sysfs.path(), "in_accel_missing_raw"));
+
+  int value = 0;
+  ASSERT_EQ(0, handler.readRaw(0, value));
+  EXPECT_EQ(100, value);
+  ASSERT_EQ(0, handler.readRaw(1, value));
+  EXPECT_EQ(-200, value);
+  EXPECT_NE(0, handler.readRaw(2, value));
+  EXPECT_NE(0, handler.readRaw(3, value));
+  EXPECT_NE(0, handler.readRaw(4, value));
+
+  // The attribute stays open and is read again from the start
+  sysfs.writeFile("in_accel_x_raw", "5\n");
+  ASSERT_EQ(0, handler.readRaw(0, value));
+  EXPECT_EQ(5, value);
+}
+
+TEST(FileHandlerTest, ScalesRawValues) {
+  FakeSysfsDirectory sysfs;
+  sysfs.writeFile("in_anglvel_x_raw", "2\n");
+  sysfs.writeFile("in_anglvel_y_raw", "-4\n");
+
+  RawSysfsHandler handler;
+  handler.init(sysfs.path(), {"in_anglvel_x_raw", "in_anglvel_y_raw", ""});
+
+  std::array<float, 3> results{};
+  ASSERT_EQ(0, handler.read(results, 0.5f));
+  EXPECT_FLOAT_EQ(1.0f, results[0]);
+  EXPECT_FLOAT_EQ(-2.0f, results[1]);
+}
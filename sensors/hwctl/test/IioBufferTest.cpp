@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "IioBuffer.h"
+#include "TempDir.h"
+
+using bosch::hwctl::IioBuffer;
+using bosch::hwctl::IioScan;
+
+namespace {
+
+/*
+ * A fake IIO device tree in a temporary directory, with a FIFO standing in
+ * for the character device.
+ */
+class FakeIioDevice {
+public:
+  FakeIioDevice() {
+    mRoot = mDir.path();
+    mPath = mRoot + "iio:device0/";
+    mChardev = mRoot + "iio:device0.dev";
+    mkdir(mPath.c_str(), 0755);
+  }
+
+  ~FakeIioDevice() {
+    if (mWriteFd >= 0) close(mWriteFd);
+  }
+
+  void addBuffer() {
+    mkdir((mPath + "buffer").c_str(), 0755);
+    mkdir((mPath + "scan_elements").c_str(), 0755);
+    writeFile("buffer/enable", "0");
+    writeFile("buffer/length", "0");
+    mkfifo(mChardev.c_str(), 0644);
+  }
+
+  void addScanElement(const std::string& name, int index, const std::string& type) {
+    writeFile("scan_elements/" + name + "_en", "0");
+    writeFile("scan_elements/" + name + "_index", std::to_string(index));
+    writeFile("scan_elements/" + name + "_type", type);
+  }
+
+  void writeFile(const std::string& file, const std::string& content) { std::ofstream(mPath + file) << content; }
+
+  std::string readFile(const std::string& file) {
+    std::ifstream stream(mPath + file);
+    return std::string((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+  }
+
+  void push(const std::vector<uint8_t>& data) {
+    if (mWriteFd < 0) mWriteFd = open(mChardev.c_str(), O_WRONLY | O_NONBLOCK);
+    ASSERT_GE(mWriteFd, 0);
+    ASSERT_EQ(static_cast<ssize_t>(data.size()), write(mWriteFd, data.data(), data.size()));
+  }
+
+  const std::string& path() const { return mPath; }
+  const std::string& chardev() const { return mChardev; }
+
+private:
+  bosch::hwctl::TempDir mDir{"iiotest"};
+  std::string mRoot;
+  std::string mPath;
+  std::string mChardev;
+  int mWriteFd{-1};
+};
+
+}  // namespace
+
+TEST(IioBufferTest, NotAvailableWithoutBuffer) {
+  FakeIioDevice device;
+  IioBuffer buffer(device.path(), device.chardev());
+
+  EXPECT_FALSE(buffer.isAvailable());
+  EXPECT_LT(buffer.addChannel("in_accel_x"), 0);
+}
+
+TEST(IioBufferTest, EnablesScanElementsAndBuffer) {
+  FakeIioDevice device;
+  device.addBuffer();
+  device.addScanElement("in_accel_x", 0, "le:s16/16>>0");
+  device.addScanElement("in_accel_y", 1, "le:s16/16>>0");
+
+  IioBuffer buffer(device.path(), device.chardev());
+  ASSERT_TRUE(buffer.isAvailable());
+  EXPECT_EQ(0, buffer.addChannel("in_accel_x"));
+  EXPECT_EQ(1, buffer.addChannel("in_accel_y"));
+  EXPECT_EQ(0, buffer.addChannel("in_accel_x"));
+  EXPECT_LT(buffer.addChannel("in_anglvel_x"), 0);
+
+  ASSERT_EQ(0, buffer.enable(64));
+  EXPECT_EQ("1", device.readFile("scan_elements/in_accel_x_en"));
+  EXPECT_EQ("1", device.readFile("scan_elements/in_accel_y_en"));
+  EXPECT_EQ("64", device.readFile("buffer/length"));
+  EXPECT_EQ("1", device.readFile("buffer/enable"));
+
+  ASSERT_EQ(0, buffer.disable());
+  EXPECT_EQ("0", device.readFile("buffer/enable"));
+}
+
+TEST(IioBufferTest, ReadsPackedScansInBulk) {
+  FakeIioDevice device;
+  device.addBuffer();
+  device.addScanElement("in_accel_x", 0, "le:s16/16>>0");
+  device.addScanElement("in_accel_y", 1, "le:s16/16>>0");
+  device.addScanElement("in_accel_z", 2, "le:s16/16>>0");
+
+  IioBuffer buffer(device.path(), device.chardev());
+  // Added out of scan order, values are reported in the order of addition
+  ASSERT_EQ(0, buffer.addChannel("in_accel_z"));
+  ASSERT_EQ(1, buffer.addChannel("in_accel_x"));
+  ASSERT_EQ(2, buffer.addChannel("in_accel_y"));
+  ASSERT_EQ(0, buffer.enable(16));
+
+  device.push({0x01, 0x00, 0xfe, 0xff, 0x00, 0x10, 0x02, 0x00, 0x03, 0x00, 0x04, 0x00});
+
+  std::vector<IioScan> scans;
+  ASSERT_EQ(0, buffer.read(scans));
+  ASSERT_EQ(2u, scans.size());
+  EXPECT_EQ(4096, scans[0].values[0]);
+  EXPECT_EQ(1, scans[0].values[1]);
+  EXPECT_EQ(-2, scans[0].values[2]);
+  EXPECT_EQ(4, scans[1].values[0]);
+  EXPECT_EQ(2, scans[1].values[1]);
+  EXPECT_EQ(3, scans[1].values[2]);
+
+  scans.clear();
+  ASSERT_EQ(0, buffer.read(scans));
+  EXPECT_TRUE(scans.empty());
+}
+
+TEST(IioBufferTest, KeepsIncompleteScans) {
+  FakeIioDevice device;
+  device.addBuffer();
+  device.addScanElement("in_anglvel_x", 0, "be:s12/16>>4");
+  device.addScanElement("in_anglvel_y", 1, "le:u16/16>>0");
+
+  IioBuffer buffer(device.path(), device.chardev());
+  ASSERT_EQ(0, buffer.addChannel("in_anglvel_x"));
+  ASSERT_EQ(1, buffer.addChannel("in_anglvel_y"));
+  ASSERT_EQ(0, buffer.enable(16));
+
+  std::vector<IioScan> scans;
+  device.push({0xff, 0xf0, 0xff});
+  ASSERT_EQ(0, buffer.read(scans));
+  EXPECT_TRUE(scans.empty());
+
+  device.push({0xff});
+  ASSERT_EQ(0, buffer.read(scans));
+  ASSERT_EQ(1u, scans.size());
+  EXPECT_EQ(-1, scans[0].values[0]);
+  EXPECT_EQ(65535, scans[0].values[1]);
+}
+
+TEST(IioBufferTest, ReadsTimestampChannel) {
+  FakeIioDevice device;
+  device.addBuffer();
+  device.addScanElement("in_accel_x", 0, "le:s16/16>>0");
+  device.addScanElement("in_timestamp", 3, "le:s64/64>>0");
+
+  IioBuffer buffer(device.path(), device.chardev());
+  ASSERT_EQ(0, buffer.addChannel("in_accel_x"));
+  EXPECT_NE(0, buffer.addTimestamp());
+  EXPECT_FALSE(buffer.hasTimestamp());
+
+  device.writeFile("current_timestamp_clock", "realtime");
+  ASSERT_EQ(0, buffer.addTimestamp());
+  EXPECT_TRUE(buffer.hasTimestamp());
+  EXPECT_EQ("boottime", device.readFile("current_timestamp_clock"));
+  ASSERT_EQ(0, buffer.enable(16));
+
+  // The timestamp is aligned to 8 bytes, the scan is 16 bytes long
+  device.push({0x05, 0x00, 0, 0, 0, 0, 0, 0, 0x00, 0xca, 0x9a, 0x3b, 0x00, 0x00, 0x00, 0x00});
+
+  std::vector<IioScan> scans;
+  ASSERT_EQ(0, buffer.read(scans));
+  ASSERT_EQ(1u, scans.size());
+  EXPECT_EQ(5, scans[0].values[0]);
+  EXPECT_EQ(1000000000, scans[0].timestamp);
+}
+
+TEST(IioBufferTest, ProgramsWatermark) {
+  FakeIioDevice device;
+  device.addBuffer();
+  device.addScanElement("in_accel_x", 0, "le:s16/16>>0");
+
+  IioBuffer buffer(device.path(), device.chardev());
+  ASSERT_EQ(0, buffer.addChannel("in_accel_x"));
+  EXPECT_NE(0, buffer.setWatermark(8));
+  EXPECT_LT(buffer.getHwFifoLength(), 0);
+
+  device.writeFile("buffer/watermark", "1");
+  device.writeFile("buffer/hwfifo_watermark_max", "146");
+  EXPECT_EQ(146, buffer.getHwFifoLength());
+  ASSERT_EQ(0, buffer.setWatermark(8));
+  ASSERT_EQ(0, buffer.enable(64));
+  EXPECT_EQ("8", device.readFile("buffer/watermark"));
+
+  // Changing the watermark of an enabled buffer re-enables it on the same
+  // descriptor
+  const int fd = buffer.getFd();
+  ASSERT_EQ(0, buffer.setWatermark(100));
+  EXPECT_TRUE(buffer.isEnabled());
+  EXPECT_EQ(fd, buffer.getFd());
+  EXPECT_EQ("64", device.readFile("buffer/watermark"));
+  EXPECT_EQ("1", device.readFile("buffer/enable"));
+}
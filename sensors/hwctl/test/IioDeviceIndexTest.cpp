@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "IioDeviceIndex.h"
+#include "TempDir.h"
+
+using bosch::hwctl::IioDeviceIndex;
+
+namespace {
+
+class FakeIioBus {
+public:
+  FakeIioBus() { mPath = mDir.path(); }
+
+  void addEntry(const std::string& dir, const std::string& name) {
+    mkdir((mPath + dir).c_str(), 0755);
+    std::ofstream(mPath + dir + "/name") << name << "\n";
+  }
+
+  const std::string& path() const { return mPath; }
+
+private:
+  bosch::hwctl::TempDir mDir{"iioindex"};
+  std::string mPath;
+};
+
+}  // namespace
+
+TEST(IioDeviceIndexTest, FindsDevicesByDriverName) {
+  FakeIioBus bus;
+  bus.addEntry("iio:device10", "smi330");
+  bus.addEntry("iio:device2", "smi330");
+  bus.addEntry("iio:device1", "smi230gyro");
+  bus.addEntry("iio:device0", "smi230acc");
+  bus.addEntry("trigger0", "smi330-dev2");
+
+  IioDeviceIndex index(bus.path());
+  EXPECT_EQ(4u, index.getDeviceCount());
+  EXPECT_GE(index.getScanTimeNs(), 0);
+
+  const auto smi330 = index.find("smi330");
+  ASSERT_EQ(2u, smi330.size());
+  EXPECT_EQ(bus.path() + "iio:device2/", smi330[0]);
+  EXPECT_EQ(bus.path() + "iio:device10/", smi330[1]);
+
+  const auto gyro = index.find("smi230gyro");
+  ASSERT_EQ(1u, gyro.size());
+  EXPECT_EQ(bus.path() + "iio:device1/", gyro[0]);
+
+  EXPECT_TRUE(index.find("smi240").empty());
+}
+
+TEST(IioDeviceIndexTest, ScansOnlyOnce) {
+  FakeIioBus bus;
+  bus.addEntry("iio:device0", "smi230acc");
+
+  IioDeviceIndex index(bus.path());
+  EXPECT_EQ(1u, index.find("smi230acc").size());
+
+  bus.addEntry("iio:device1", "smi230gyro");
+  EXPECT_TRUE(index.find("smi230gyro").empty());
+}
+
+TEST(IioDeviceIndexTest, AddsAndRemovesDevices) {
+  FakeIioBus bus;
+  bus.addEntry("iio:device4", "smi240");
+
+  IioDeviceIndex index(bus.path());
+  EXPECT_EQ(1u, index.find("smi240").size());
+
+  bus.addEntry("iio:device1", "smi240");
+  EXPECT_EQ(bus.path() + "iio:device1/", index.add("iio:device1"));
+  EXPECT_TRUE(index.add("iio:device1").empty());
+  EXPECT_TRUE(index.add("iio:device9").empty());
+
+  auto smi240 = index.find("smi240");
+  ASSERT_EQ(2u, smi240.size());
+  EXPECT_EQ(bus.path() + "iio:device1/", smi240[0]);
+  EXPECT_EQ(bus.path() + "iio:device4/", smi240[1]);
+
+  EXPECT_EQ(bus.path() + "iio:device4/", index.remove("iio:device4"));
+  EXPECT_TRUE(index.remove("iio:device4").empty());
+  smi240 = index.find("smi240");
+  ASSERT_EQ(1u, smi240.size());
+  EXPECT_EQ(bus.path() + "iio:device1/", smi240[0]);
+}
+
+TEST(IioDeviceIndexTest, FindsChangesOfTheBus) {
+  FakeIioBus bus;
+  bus.addEntry("iio:device0", "smi230acc");
+  bus.addEntry("iio:device1", "smi230gyro");
+
+  IioDeviceIndex index(bus.path());
+  EXPECT_EQ(2u, index.getDeviceCount());
+
+  bus.addEntry("iio:device2", "smi330");
+  std::filesystem::remove_all(bus.path() + "iio:device0");
+
+  std::vector<std::string> added{};
+  std::vector<std::string> removed{};
+  index.findChanges(added, removed);
+  EXPECT_EQ(std::vector<std::string>{"iio:device2"}, added);
+  EXPECT_EQ(std::vector<std::string>{"iio:device0"}, removed);
+  EXPECT_EQ(2u, index.getDeviceCount());
+}
+
+TEST(IioDeviceIndexTest, HandlesMissingBus) {
+  IioDeviceIndex index("/tmp/iioindex-does-not-exist/");
+  EXPECT_EQ(0u, index.getDeviceCount());
+  EXPECT_TRUE(index.find("smi330").empty());
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+
+#include <fstream>
+#include <string>
+
+#include "IioTrigger.h"
+#include "TempDir.h"
+
+using bosch::hwctl::IioTrigger;
+
+namespace {
+
+/*
+ * A fake IIO bus in a temporary directory with one device, its triggers and
+ * a directory standing in for the configfs hrtimer group.
+ */
+class FakeIioBus {
+public:
+  FakeIioBus() {
+    mRoot = mDir.path();
+    mPath = mRoot + "iio:device0/";
+    mHrtimerPath = mRoot + "hrtimer/";
+    mkdir(mPath.c_str(), 0755);
+    mkdir(mHrtimerPath.c_str(), 0755);
+    writeFile("iio:device0/name", "smi330\n");
+  }
+
+  void addTriggerSupport() {
+    mkdir((mPath + "trigger").c_str(), 0755);
+    writeFile("iio:device0/trigger/current_trigger", "\n");
+  }
+
+  void addTrigger(const std::string& dir, const std::string& name) {
+    mkdir((mRoot + dir).c_str(), 0755);
+    writeFile(dir + "/name", name + "\n");
+    writeFile(dir + "/sampling_frequency", "0\n");
+  }
+
+  void writeFile(const std::string& file, const std::string& content) { std::ofstream(mRoot + file) << content; }
+
+  std::string readFile(const std::string& file) {
+    std::ifstream stream(mRoot + file);
+    return std::string((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+  }
+
+  bool exists(const std::string& file) const {
+    struct stat st {};
+    return stat((mRoot + file).c_str(), &st) == 0;
+  }
+
+  const std::string& path() const { return mPath; }
+  const std::string& hrtimerPath() const { return mHrtimerPath; }
+
+private:
+  bosch::hwctl::TempDir mDir{"iiotrigger"};
+  std::string mRoot;
+  std::string mPath;
+  std::string mHrtimerPath;
+};
+
+}  // namespace
+
+TEST(IioTriggerTest, NotAvailableWithoutTriggerSupport) {
+  FakeIioBus bus;
+  IioTrigger trigger(bus.path(), bus.hrtimerPath());
+
+  EXPECT_FALSE(trigger.isAvailable());
+  EXPECT_NE(0, trigger.attach());
+  EXPECT_FALSE(trigger.isAttached());
+}
+
+TEST(IioTriggerTest, PrefersDataReadyTrigger) {
+  FakeIioBus bus;
+  bus.addTriggerSupport();
+  bus.addTrigger("trigger0", "smi230acc-dev1");
+  bus.addTrigger("trigger1", "smi330-dev0");
+
+  IioTrigger trigger(bus.path(), bus.hrtimerPath());
+  ASSERT_EQ(0, trigger.attach());
+  EXPECT_TRUE(trigger.isAttached());
+  EXPECT_FALSE(trigger.isHrtimer());
+  EXPECT_EQ("smi330-dev0", bus.readFile("iio:device0/trigger/current_trigger"));
+
+  // The device paces itself, the sampling period does not touch the trigger
+  EXPECT_EQ(0, trigger.setSamplingPeriod(5000000));
+  EXPECT_EQ("0\n", bus.readFile("trigger1/sampling_frequency"));
+
+  ASSERT_EQ(0, trigger.detach());
+  EXPECT_FALSE(trigger.isAttached());
+  EXPECT_EQ("\n", bus.readFile("iio:device0/trigger/current_trigger"));
+}
+
+TEST(IioTriggerTest, CreatesHrtimerTrigger) {
+  FakeIioBus bus;
+  bus.addTriggerSupport();
+  // Stands in for the trigger the kernel registers on mkdir in configfs
+  bus.addTrigger("trigger0", "bosch-hrtimer-dev0");
+
+  IioTrigger trigger(bus.path(), bus.hrtimerPath());
+  ASSERT_EQ(0, trigger.attach());
+  EXPECT_TRUE(trigger.isHrtimer());
+  EXPECT_TRUE(bus.exists("hrtimer/bosch-hrtimer-dev0"));
+  EXPECT_EQ("bosch-hrtimer-dev0", bus.readFile("iio:device0/trigger/current_trigger"));
+
+  ASSERT_EQ(0, trigger.setSamplingPeriod(5000000));
+  EXPECT_EQ("200", bus.readFile("trigger0/sampling_frequency"));
+
+  ASSERT_EQ(0, trigger.detach());
+  EXPECT_FALSE(bus.exists("hrtimer/bosch-hrtimer-dev0"));
+  EXPECT_EQ("\n", bus.readFile("iio:device0/trigger/current_trigger"));
+}
+
+TEST(IioTriggerTest, RoundsHrtimerFrequencyUp) {
+  FakeIioBus bus;
+  bus.addTriggerSupport();
+  bus.addTrigger("trigger0", "bosch-hrtimer-dev0");
+
+  IioTrigger trigger(bus.path(), bus.hrtimerPath());
+  ASSERT_EQ(0, trigger.attach());
+
+  // Older kernels reject a fractional frequency with EINVAL
+  ASSERT_EQ(0, trigger.setSamplingPeriod(3000000));
+  EXPECT_EQ("334", bus.readFile("trigger0/sampling_frequency"));
+  ASSERT_EQ(0, trigger.setSamplingPeriod(1280000000));
+  EXPECT_EQ("1", bus.readFile("trigger0/sampling_frequency"));
+}
+
+TEST(IioTriggerTest, KeepsTriggerSelectedElsewhere) {
+  FakeIioBus bus;
+  bus.addTriggerSupport();
+  bus.addTrigger("trigger0", "smi330-dev0");
+  bus.writeFile("iio:device0/trigger/current_trigger", "external\n");
+
+  IioTrigger trigger(bus.path(), bus.hrtimerPath());
+  ASSERT_EQ(0, trigger.attach());
+  EXPECT_FALSE(trigger.isAttached());
+  ASSERT_EQ(0, trigger.detach());
+  EXPECT_EQ("external\n", bus.readFile("iio:device0/trigger/current_trigger"));
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "SysfsBatchReader.h"
+#include "TempDir.h"
+
+using bosch::hwctl::SysfsBatchReader;
+using bosch::hwctl::SysfsRead;
+
+namespace {
+
+class SysfsBatchReaderTest : public ::testing::TestWithParam<bool> {
+protected:
+  void SetUp() override {
+    mPath = mDir.path();
+  }
+
+  void TearDown() override {
+    for (const int fd : mFds) close(fd);
+  }
+
+  int addFile(const std::string& file, const std::string& content) {
+    std::ofstream(mPath + file) << content;
+    mFds.push_back(open((mPath + file).c_str(), O_RDONLY | O_CLOEXEC));
+    return mFds.back();
+  }
+
+  bosch::hwctl::TempDir mDir{"batchtest"};
+  std::string mPath;
+  std::vector<int> mFds;
+};
+
+}  // namespace
+
+TEST_P(SysfsBatchReaderTest, ReadsAllAttributes) {
+  SysfsBatchReader reader(GetParam());
+
+  // More reads than fit into one submission
+  std::vector<SysfsRead> reads;
+  for (int i = 0; i < 40; i++) {
+    reads.push_back({addFile("in_raw" + std::to_string(i), std::to_string(i - 20) + "\n"), 0, -1});
+  }
+  reads.push_back({addFile("in_invalid_raw", "invalid\n"), 0, -1});
+  reads.push_back({-1, 0, -1});
+
+  // Repeated batches read the attributes from the start again
+  for (int round = 0; round < 2; round++) {
+    reader.read(reads);
+    for (int i = 0; i < 40; i++) {
+      EXPECT_EQ(0, reads[i].status) << i;
+      EXPECT_EQ(i - 20, reads[i].value) << i;
+    }
+    EXPECT_NE(0, reads[40].status);
+    EXPECT_NE(0, reads[41].status);
+  }
+}
+
+TEST_P(SysfsBatchReaderTest, ReadsEmptyBatch) {
+  SysfsBatchReader reader(GetParam());
+  std::vector<SysfsRead> reads;
+  reader.read(reads);
+  EXPECT_TRUE(reads.empty());
+}
+
+TEST(SysfsBatchReaderFallbackTest, UsesSequentialReadsIfRequested) {
+  SysfsBatchReader reader(false);
+  EXPECT_FALSE(reader.isUring());
+}
+
+INSTANTIATE_TEST_SUITE_P(UringAndSequential, SysfsBatchReaderTest, ::testing::Bool());
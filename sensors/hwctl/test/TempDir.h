@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdlib.h>
+
+#include <filesystem>
+#include <string>
+#include <system_error>
+
+namespace bosch::hwctl {
+
+/*
+ * A temporary directory for the fake sysfs trees of the tests and benchmarks.
+ * It is removed with its content when the object goes out of scope.
+ */
+class TempDir {
+public:
+  explicit TempDir(const std::string& prefix) {
+    std::string pattern = "/tmp/" + prefix + "XXXXXX";
+    if (mkdtemp(pattern.data()) != nullptr) mPath = pattern + "/";
+  }
+
+  ~TempDir() {
+    std::error_code error;
+    if (!mPath.empty()) std::filesystem::remove_all(mPath, error);
+  }
+
+  TempDir(const TempDir&) = delete;
+  TempDir& operator=(const TempDir&) = delete;
+
+  // Path of the directory with a trailing slash, empty if it could not be created
+  const std::string& path() const { return mPath; }
+
+private:
+  std::string mPath;
+};
+
+}  // namespace bosch::hwctl
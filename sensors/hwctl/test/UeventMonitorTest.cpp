@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "UeventMonitor.h"
+
+using bosch::hwctl::Uevent;
+using bosch::hwctl::UeventMonitor;
+
+namespace {
+
+bool parse(const std::string& message, Uevent& event) {
+  return UeventMonitor::parse(message.data(), message.size(), event);
+}
+
+std::string makeMessage(const std::string& action, const std::string& devicePath, const std::string& deviceType) {
+  std::string message = action + "@" + devicePath;
+  message += std::string(1, '\0') + "ACTION=" + action;
+  message += std::string(1, '\0') + "DEVPATH=" + devicePath;
+  message += std::string(1, '\0') + "SUBSYSTEM=iio";
+  if (!deviceType.empty()) message += std::string(1, '\0') + "DEVTYPE=" + deviceType;
+  message += std::string(1, '\0') + "SEQNUM=1234";
+  return message + '\0';
+}
+
+}  // namespace
+
+TEST(UeventMonitorTest, ParsesAddedAndRemovedDevices) {
+  Uevent event{};
+  ASSERT_TRUE(parse(makeMessage("add", "/devices/platform/spi0/spi0.1/iio:device3", "iio_device"), event));
+  EXPECT_EQ(Uevent::ADD, event.action);
+  EXPECT_EQ("iio:device3", event.device);
+
+  ASSERT_TRUE(parse(makeMessage("remove", "/devices/platform/spi0/spi0.1/iio:device3", ""), event));
+  EXPECT_EQ(Uevent::REMOVE, event.action);
+  EXPECT_EQ("iio:device3", event.device);
+}
+
+TEST(UeventMonitorTest, IgnoresOtherEvents) {
+  Uevent event{};
+  EXPECT_FALSE(parse(makeMessage("change", "/devices/platform/spi0/spi0.1/iio:device3", "iio_device"), event));
+  EXPECT_FALSE(parse(makeMessage("add", "/devices/iio_sysfs_trigger/trigger0", "iio_trigger"), event));
+
+  std::string other = makeMessage("add", "/devices/virtual/net/lo", "");
+  other.replace(other.find("SUBSYSTEM=iio"), 13, "SUBSYSTEM=net");
+  EXPECT_FALSE(parse(other, event));
+
+  const std::string truncated = "add@/devices/iio:device1";
+  EXPECT_FALSE(parse(truncated, event));
+}
@@ -20,6 +20,7 @@
 #include <android/hardware/sensors/2.0/types.h>
 #include <dlfcn.h>
 
+#include <algorithm>
 #include <cinttypes>
 #include <cmath>
 #include <fstream>
@@ -202,8 +203,7 @@ Return<Result> HalProxy::initializeCommon(std::unique_ptr<EventMessageQueueWrapp
   disableAllSensors();
 
   // Clears the queue if any events were pending write before.
-  mPendingWriteEventsQueue = std::queue<std::pair<std::vector<V2_1::Event>, size_t>>();
-  mSizePendingWriteEventsQueue = 0;
+  mPendingWriteEvents.clear();
 
   // Clears previously connected dynamic sensors
   mDynamicSensors.clear();
@@ -343,12 +343,13 @@ Return<void> HalProxy::debug(const hidl_handle& fd, const hidl_vec<hidl_string>&
   stream << "  Wakelock timeout reset time: " << msFromNs(now - mWakelockTimeoutResetTime) << " ms ago" << std::endl;
   // TODO(b/142969448): Add logging for history of wakelock acquisition per subhal.
   stream << "  Wakelock ref count: " << mWakelockRefCount << std::endl;
-  stream << "  # of events on pending write writes queue: " << mSizePendingWriteEventsQueue << std::endl;
-  stream << " Most events seen on pending write events queue: " << mMostEventsObservedPendingWriteEventsQueue
-         << std::endl;
-  if (!mPendingWriteEventsQueue.empty()) {
-    stream << "  Size of events list on front of pending writes queue: "
-           << mPendingWriteEventsQueue.front().first.size() << std::endl;
+  {
+    std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
+    stream << "  # of events on pending write events ring: " << mPendingWriteEvents.size() << " of "
+           << mPendingWriteEvents.capacity() << std::endl;
+    stream << "  Most events seen on pending write events ring: " << mMostEventsObservedPendingWriteEventsQueue
+           << std::endl;
+    stream << "  # of pending write events dropped: " << mDroppedPendingWriteEvents << std::endl;
   }
   stream << "  # of non-dynamic sensors across all subhals: " << mSensors.size() << std::endl;
   stream << "  # of dynamic sensors across all subhals: " << mDynamicSensors.size() << std::endl;
@@ -405,6 +406,44 @@ Return<void> HalProxy::onDynamicSensorsDisconnected(const hidl_vec<int32_t>& dyn
   return Return<void>();
 }
 
+/*
+ * Events of dynamic sensors are looked up as well. Unknown handles must not
+ * be inserted, the map is read concurrently by the sub-HAL threads. A dynamic
+ * sensor may disconnect at any time, so its info is copied under the lock.
+ */
+SensorInfo HalProxy::getSensorInfo(int32_t sensorHandle) {
+  const auto sensor = mSensors.find(sensorHandle);
+  if (sensor != mSensors.end()) return sensor->second;
+
+  std::lock_guard<std::mutex> lock(mDynamicSensorsMutex);
+  const auto dynamicSensor = mDynamicSensors.find(sensorHandle);
+  return (dynamicSensor != mDynamicSensors.end()) ? dynamicSensor->second : SensorInfo{};
+}
+
+/*
+ * Like getSensorInfo(), without copying the strings of the info for every
+ * event of a dynamic sensor.
+ */
+uint32_t HalProxy::getSensorFlags(int32_t sensorHandle) {
+  const auto sensor = mSensors.find(sensorHandle);
+  if (sensor != mSensors.end()) return sensor->second.flags;
+
+  std::lock_guard<std::mutex> lock(mDynamicSensorsMutex);
+  const auto dynamicSensor = mDynamicSensors.find(sensorHandle);
+  return (dynamicSensor != mDynamicSensors.end()) ? dynamicSensor->second.flags : 0;
+}
+
+bool HalProxy::isWakeUpSensor(int32_t sensorHandle) {
+  const size_t subHalIndex = extractSubHalIndex(sensorHandle);
+  const int32_t handle = clearSubHalIndex(sensorHandle);
+  if (subHalIndex < mStaticSensorKinds.size()) {
+    const auto& kinds = mStaticSensorKinds[subHalIndex];
+    const SensorKind kind = (static_cast<size_t>(handle) < kinds.size()) ? kinds[handle] : SensorKind::UNKNOWN;
+    if (kind != SensorKind::UNKNOWN) return kind == SensorKind::WAKE_UP;
+  }
+  return (getSensorFlags(sensorHandle) & static_cast<uint32_t>(V1_0::SensorFlagBits::WAKE_UP)) != 0;
+}
+
 void HalProxy::initializeSubHalListFromConfigFile(const char* configFileName) {
   std::ifstream subHalConfigStream(configFileName);
   if (!subHalConfigStream) {
@@ -452,6 +491,7 @@ void HalProxy::initializeSubHalListFromConfigFile(const char* configFileName) {
 }
 
 void HalProxy::initializeSensorList() {
+  mStaticSensorKinds.resize(mSubHalList.size());
   for (size_t subHalIndex = 0; subHalIndex < mSubHalList.size(); subHalIndex++) {
     auto result = mSubHalList[subHalIndex]->getSensorsList([&](const auto& list) {
       for (SensorInfo sensor : list) {
@@ -459,6 +499,15 @@ void HalProxy::initializeSensorList() {
           ALOGE("SubHal sensorHandle's first byte was not 0");
         } else {
           ALOGV("Loaded sensor: %s", sensor.name.c_str());
+          if ((sensor.sensorHandle >= 0) && (sensor.sensorHandle <= kMaxFlatSensorHandle)) {
+            auto& kinds = mStaticSensorKinds[subHalIndex];
+            if (kinds.size() <= static_cast<size_t>(sensor.sensorHandle)) {
+              kinds.resize(sensor.sensorHandle + 1, SensorKind::UNKNOWN);
+            }
+            kinds[sensor.sensorHandle] = (sensor.flags & static_cast<uint32_t>(V1_0::SensorFlagBits::WAKE_UP))
+                                           ? SensorKind::WAKE_UP
+                                           : SensorKind::NON_WAKE_UP;
+          }
           sensor.sensorHandle = setSubHalIndex(sensor.sensorHandle, subHalIndex);
           setDirectChannelFlags(&sensor, mSubHalList[subHalIndex]);
           mSensors[sensor.sensorHandle] = sensor;
@@ -529,38 +578,34 @@ void HalProxy::disableAllSensors() {
 void HalProxy::startPendingWritesThread(HalProxy* halProxy) { halProxy->handlePendingWrites(); }
 
 void HalProxy::handlePendingWrites() {
-  // TODO(b/143302327): Find a way to optimize locking strategy maybe using two mutexes instead of
-  // one.
   std::unique_lock<std::mutex> lock(mEventQueueWriteMutex);
   while (mThreadsRun.load()) {
-    mEventQueueWriteCV.wait(lock, [&] { return !mPendingWriteEventsQueue.empty() || !mThreadsRun.load(); });
+    mEventQueueWriteCV.wait(lock, [&] { return !mPendingWriteEvents.empty() || !mThreadsRun.load(); });
     if (mThreadsRun.load()) {
-      std::vector<Event>& pendingWriteEvents = mPendingWriteEventsQueue.front().first;
-      size_t numWakeupEvents = mPendingWriteEventsQueue.front().second;
-      size_t eventQueueSize = mEventQueue->getQuantumCount();
-      size_t numToWrite = std::min(pendingWriteEvents.size(), eventQueueSize);
+      // The oldest events are written straight out of the ring, producers only append behind them.
+      // Whatever fits into the fmq right now is written without waiting for the reader.
+      size_t numToWrite = 0;
+      const size_t availableToWrite = mEventQueue->availableToWrite();
+      const Event* pendingWriteEvents = mPendingWriteEvents.front(
+        availableToWrite > 0 ? availableToWrite : mEventQueue->getQuantumCount(), &numToWrite);
+      const size_t numWakeupEvents = mPendingWriteEvents.countWakeupEvents(numToWrite);
       lock.unlock();
-      if (!mEventQueue->writeBlocking(
-            pendingWriteEvents.data(), numToWrite, static_cast<uint32_t>(EventQueueFlagBits::EVENTS_READ),
-            static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS), kPendingWriteTimeoutNs, mEventQueueFlag)) {
+      bool success = false;
+      if (availableToWrite > 0) {
+        success = mEventQueue->write(pendingWriteEvents, numToWrite);
+        if (success) mEventQueueFlag->wake(static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS));
+      } else {
+        success = mEventQueue->writeBlocking(
+          pendingWriteEvents, numToWrite, static_cast<uint32_t>(EventQueueFlagBits::EVENTS_READ),
+          static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS), kPendingWriteTimeoutNs, mEventQueueFlag);
+      }
+      if (!success) {
         ALOGE("Dropping %zu events after blockingWrite failed.", numToWrite);
-        if (numWakeupEvents > 0) {
-          if (pendingWriteEvents.size() > eventQueueSize) {
-            decrementRefCountAndMaybeReleaseWakelock(countNumWakeupEvents(pendingWriteEvents, eventQueueSize));
-          } else {
-            decrementRefCountAndMaybeReleaseWakelock(numWakeupEvents);
-          }
-        }
+        if (numWakeupEvents > 0) decrementRefCountAndMaybeReleaseWakelock(numWakeupEvents);
       }
       lock.lock();
-      mSizePendingWriteEventsQueue -= numToWrite;
-      if (pendingWriteEvents.size() > eventQueueSize) {
-        // TODO(b/143302327): Check if this erase operation is too inefficient. It will copy
-        // all the events ahead of it down to fill gap off array at front after the erase.
-        pendingWriteEvents.erase(pendingWriteEvents.begin(), pendingWriteEvents.begin() + eventQueueSize);
-      } else {
-        mPendingWriteEventsQueue.pop();
-      }
+      if (!success) mDroppedPendingWriteEvents += numToWrite;
+      mPendingWriteEvents.pop(numToWrite);
     }
   }
 }
@@ -610,31 +655,44 @@ void HalProxy::resetSharedWakelock() {
 
 void HalProxy::postEventsToMessageQueue(const std::vector<Event>& events, size_t numWakeupEvents,
                                         V2_0::implementation::ScopedWakelock wakelock) {
-  size_t numToWrite = 0;
+  size_t numWritten = 0;
   std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
   if (wakelock.isLocked()) {
     incrementRefCountAndMaybeAcquireWakelock(numWakeupEvents);
   }
-  if (mPendingWriteEventsQueue.empty()) {
-    numToWrite = std::min(events.size(), mEventQueue->availableToWrite());
-    if (numToWrite > 0) {
-      if (mEventQueue->write(events.data(), numToWrite)) {
-        // TODO(b/143302327): While loop if mEventQueue->avaiableToWrite > 0 to possibly fit
-        // in more writes immediately
-        mEventQueueFlag->wake(static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS));
-      } else {
-        numToWrite = 0;
-      }
+  if (mPendingWriteEvents.empty()) {
+    // The reader may free space while the events are written, keep filling the fmq as long as it
+    // has room and wake the reader once for all of them.
+    size_t availableToWrite = 0;
+    while ((numWritten < events.size()) && ((availableToWrite = mEventQueue->availableToWrite()) > 0)) {
+      const size_t numToWrite = std::min(events.size() - numWritten, availableToWrite);
+      if (!mEventQueue->write(events.data() + numWritten, numToWrite)) break;
+      numWritten += numToWrite;
+    }
+    if (numWritten > 0) {
+      mEventQueueFlag->wake(static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS));
     }
   }
-  size_t numLeft = events.size() - numToWrite;
-  if (numToWrite < events.size() && mSizePendingWriteEventsQueue + numLeft <= kMaxSizePendingWriteEventsQueue) {
-    std::vector<Event> eventsLeft(events.begin() + numToWrite, events.end());
-    mPendingWriteEventsQueue.push({eventsLeft, numWakeupEvents});
-    mSizePendingWriteEventsQueue += numLeft;
+  if (numWritten < events.size()) {
+    // Looking up the sensor of each event is only needed for a mix of wakeup and other events
+    auto isWakeup = [&](const Event& event) {
+      return (numWakeupEvents == events.size()) || ((numWakeupEvents > 0) && isWakeUpSensor(event.sensorHandle));
+    };
+    const size_t numLeft = events.size() - numWritten;
+    const size_t numPushed = mPendingWriteEvents.push(events.data() + numWritten, numLeft, isWakeup);
+    if (numPushed < numLeft) {
+      const auto dropped = events.begin() + numWritten + numPushed;
+      const size_t numDropped = numLeft - numPushed;
+      ALOGE("Dropping %zu events since the pending write events ring is full.", numDropped);
+      mDroppedPendingWriteEvents += numDropped;
+      const size_t numWakeupDropped = std::count_if(dropped, events.end(), isWakeup);
+      if (wakelock.isLocked() && (numWakeupDropped > 0)) {
+        decrementRefCountAndMaybeReleaseWakelock(numWakeupDropped);
+      }
+    }
     mMostEventsObservedPendingWriteEventsQueue =
-      std::max(mMostEventsObservedPendingWriteEventsQueue, mSizePendingWriteEventsQueue);
-    mEventQueueWriteCV.notify_one();
+      std::max(mMostEventsObservedPendingWriteEventsQueue, mPendingWriteEvents.size());
+    if (numPushed > 0) mEventQueueWriteCV.notify_one();
   }
 }
 
@@ -687,17 +745,6 @@ bool HalProxy::isSubHalIndexValid(int32_t sensorHandle) {
   return extractSubHalIndex(sensorHandle) < mSubHalList.size();
 }
 
-size_t HalProxy::countNumWakeupEvents(const std::vector<Event>& events, size_t n) {
-  size_t numWakeupEvents = 0;
-  for (size_t i = 0; i < n; i++) {
-    int32_t sensorHandle = events[i].sensorHandle;
-    if (mSensors[sensorHandle].flags & static_cast<uint32_t>(V1_0::SensorFlagBits::WAKE_UP)) {
-      numWakeupEvents++;
-    }
-  }
-  return numWakeupEvents;
-}
-
 int32_t HalProxy::clearSubHalIndex(int32_t sensorHandle) { return sensorHandle & (~kSensorHandleSubHalIndexMask); }
 
 bool HalProxy::subHalIndexIsClear(int32_t sensorHandle) { return (sensorHandle & kSensorHandleSubHalIndexMask) == 0; }
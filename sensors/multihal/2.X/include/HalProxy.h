@@ -27,13 +27,13 @@
 #include <condition_variable>
 #include <map>
 #include <mutex>
-#include <queue>
 #include <thread>
 #include <utility>
 
 #include "EventMessageQueueWrapper.h"
 #include "HalProxyCallback.h"
 #include "ISensorsCallbackWrapper.h"
+#include "PendingWriteRing.h"
 #include "SubHalWrapper.h"
 #include "V2_0/ScopedWakelock.h"
 #include "V2_0/SubHal.h"
@@ -122,7 +122,9 @@ public:
   void postEventsToMessageQueue(const std::vector<Event>& events, size_t numWakeupEvents,
                                 V2_0::implementation::ScopedWakelock wakelock) override;
 
-  const SensorInfo& getSensorInfo(int32_t sensorHandle) override { return mSensors[sensorHandle]; }
+  SensorInfo getSensorInfo(int32_t sensorHandle) override;
+
+  bool isWakeUpSensor(int32_t sensorHandle) override;
 
   bool areThreadsRunning() override { return mThreadsRun.load(); }
 
@@ -176,6 +178,20 @@ private:
    */
   std::map<int32_t, SensorInfo> mSensors;
 
+  //! The kind of a sensor in the flat table, unknown for handles that are not static sensors.
+  enum class SensorKind : uint8_t { UNKNOWN, NON_WAKE_UP, WAKE_UP };
+
+  //! The largest sensor handle without the subhal index that is kept in the flat table.
+  static constexpr int32_t kMaxFlatSensorHandle = 1023;
+
+  /**
+   * The kind of each static sensor indexed by the subhal index and then by the sensor handle
+   * without the subhal index, so that the per event lookups do not walk mSensors. It is filled in
+   * once by initializeSensorList() before any events are posted and read without locking. Dynamic
+   * sensors and larger handles are looked up in the maps instead.
+   */
+  std::vector<std::vector<SensorKind>> mStaticSensorKinds;
+
   //! Map of the dynamic sensors that have been added to halproxy.
   std::map<int32_t, SensorInfo> mDynamicSensors;
 
@@ -191,20 +207,20 @@ private:
   //! The bit mask used to get the subhal index from a sensor handle.
   static constexpr int32_t kSensorHandleSubHalIndexMask = 0xFF000000;
 
+  //! The max number of events allowed in the pending write events ring
+  static constexpr size_t kPendingWriteRingCapacity = 16384;
+
   /**
-   * A FIFO queue of pairs of vector of events and the number of wakeup events in that vector
-   * which are waiting to be written to the events fmq in the background thread.
+   * The events which are waiting to be written to the events fmq in the background thread, in
+   * the order they were posted.
    */
-  std::queue<std::pair<std::vector<Event>, size_t>> mPendingWriteEventsQueue;
+  PendingWriteRing mPendingWriteEvents{kPendingWriteRingCapacity};
 
-  //! The most events observed on the pending write events queue for debug purposes.
+  //! The most events observed on the pending write events ring for debug purposes.
   size_t mMostEventsObservedPendingWriteEventsQueue = 0;
 
-  //! The max number of events allowed in the pending write events queue
-  static constexpr size_t kMaxSizePendingWriteEventsQueue = 100000;
-
-  //! The number of events in the pending write events queue
-  size_t mSizePendingWriteEventsQueue = 0;
+  //! The number of events dropped since the ring was full or a blocking write failed.
+  uint64_t mDroppedPendingWriteEvents = 0;
 
   //! The mutex protecting writing to the fmq and the pending events queue
   std::mutex mEventQueueWriteMutex;
@@ -338,23 +354,23 @@ private:
   std::shared_ptr<ISubHalWrapperBase> getSubHalForSensorHandle(int32_t sensorHandle);
 
   /**
-   * Checks that sensorHandle's subhal index byte is within bounds of mSubHalList.
+   * Get the flags of the sensor with that sensorHandle, copied under the lock of the dynamic
+   * sensors.
    *
-   * @param sensorHandle The sensor handle to check.
+   * @param sensorHandle The sensor handle.
    *
-   * @return true if sensorHandles's subhal index byte is valid.
+   * @return The flags of the sensor, 0 for an unknown handle.
    */
-  bool isSubHalIndexValid(int32_t sensorHandle);
+  uint32_t getSensorFlags(int32_t sensorHandle);
 
   /**
-   * Count the number of wakeup events in the first n events of the vector.
+   * Checks that sensorHandle's subhal index byte is within bounds of mSubHalList.
    *
-   * @param events The vector of Event objects.
-   * @param n The end index not inclusive of events to consider.
+   * @param sensorHandle The sensor handle to check.
    *
-   * @return The number of wakeup events of the considered events.
+   * @return true if sensorHandles's subhal index byte is valid.
    */
-  size_t countNumWakeupEvents(const std::vector<Event>& events, size_t n);
+  bool isSubHalIndexValid(int32_t sensorHandle);
 
   /*
    * Clear out the subhal index bytes from a sensorHandle.
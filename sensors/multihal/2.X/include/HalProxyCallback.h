@@ -66,9 +66,20 @@ public:
    *
    * @param sensorHandle The sensor handle.
    *
-   * @return The sensor info object in the mapping.
+   * @return A copy of the sensor info object in the mapping, a dynamic sensor may be
+   *         disconnected at any time.
    */
-  virtual const V2_1::SensorInfo& getSensorInfo(int32_t sensorHandle) = 0;
+  virtual V2_1::SensorInfo getSensorInfo(int32_t sensorHandle) = 0;
+
+  /**
+   * Whether the sensor with that sensorHandle is a wakeup sensor. Called for every event, so it
+   * must not need the map lookup of getSensorInfo() for the common case.
+   *
+   * @param sensorHandle The sensor handle.
+   *
+   * @return True if the sensor is a wakeup sensor.
+   */
+  virtual bool isWakeUpSensor(int32_t sensorHandle) = 0;
 
   virtual bool areThreadsRunning() = 0;
 };
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2023 Robert Bosch GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android/hardware/sensors/2.1/types.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_1 {
+namespace implementation {
+
+/**
+ * Bounded FIFO of the events that did not fit into the event FMQ. The storage is allocated once.
+ * The oldest events are written to the FMQ straight out of it while producers append behind them,
+ * so a partial drain neither copies nor moves any event. Every event carries whether it is a
+ * wakeup event, so that the wakelock can be released for exactly the wakeup events dropped.
+ *
+ * The ring is not synchronized. The producers must hold the write mutex, the writer thread may drop
+ * it while it writes the front run since producers never touch that.
+ */
+class PendingWriteRing {
+public:
+  using Event = ::android::hardware::sensors::V2_1::Event;
+
+  explicit PendingWriteRing(size_t capacity) : mEvents(capacity), mIsWakeup(capacity) {}
+
+  bool empty() const { return mSize == 0; }
+  size_t size() const { return mSize; }
+  size_t capacity() const { return mEvents.size(); }
+
+  /**
+   * Appends as many of the events as fit and returns how many that were. isWakeup(event) tells
+   * whether an event is a wakeup event.
+   */
+  template <typename IsWakeup>
+  size_t push(const Event* events, size_t count, IsWakeup isWakeup) {
+    const size_t numToPush = std::min(count, capacity() - mSize);
+    for (size_t i = 0; i < numToPush; i++) {
+      const size_t index = (mHead + mSize + i) % capacity();
+      mEvents[index] = events[i];
+      mIsWakeup[index] = isWakeup(events[i]);
+    }
+    mSize += numToPush;
+    return numToPush;
+  }
+
+  //! Returns the oldest events that are contiguous in memory, at most maxCount of them.
+  const Event* front(size_t maxCount, size_t* count) const {
+    *count = std::min({mSize, capacity() - mHead, maxCount});
+    return mEvents.data() + mHead;
+  }
+
+  //! The number of wakeup events among the oldest count events.
+  size_t countWakeupEvents(size_t count) const {
+    size_t numWakeupEvents = 0;
+    for (size_t i = 0; i < std::min(count, mSize); i++) numWakeupEvents += mIsWakeup[(mHead + i) % capacity()];
+    return numWakeupEvents;
+  }
+
+  void pop(size_t count) {
+    count = std::min(count, mSize);
+    mHead = (mHead + count) % capacity();
+    mSize -= count;
+  }
+
+  void clear() {
+    mHead = 0;
+    mSize = 0;
+  }
+
+private:
+  std::vector<Event> mEvents;
+  std::vector<uint8_t> mIsWakeup;
+  size_t mHead = 0;
+  size_t mSize = 0;
+};
+
+}  // namespace implementation
+}  // namespace V2_1
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
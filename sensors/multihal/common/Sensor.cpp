@@ -20,6 +20,7 @@
 #include <log/log.h>
 #include <utils/SystemClock.h>
 
+#include <chrono>
 #include <cmath>
 #include <iostream>
 
@@ -116,7 +117,7 @@ Result Sensor::getSensorPlacement(std::vector<AdditionalInfo>& additionalInfoFra
   return Result::OK;
 }
 
-Result Sensor::getSensorTemperature(std::vector<AdditionalInfo>& additionalInfoFrames) {
+Result Sensor::getSensorTemperature(bosch::sensors::Arena<AdditionalInfo>& additionalInfoFrames) {
   AdditionalInfo sensorTemperature;
   sensorTemperature.type = AdditionalInfoType::AINFO_INTERNAL_TEMPERATURE;
   sensorTemperature.serial = 0;
@@ -129,42 +130,43 @@ Result Sensor::getSensorTemperature(std::vector<AdditionalInfo>& additionalInfoF
   return Result::OK;
 }
 
+float gyroUncalibratedFix(const SensorInfo& mSensorInfo);
+
 Sensor::Sensor(ISensorsEventCallback* callback, const SensorInfo& sensorInfo,
                std::shared_ptr<bosch::sensors::ISensorHal> sensor,
                const std::optional<std::vector<Configuration>>& config)
   : mIsEnabled(false),
     mDirectChannelEnabled(false),
     mSensorInfo(sensorInfo),
-    mStopThread(false),
     mCallback(callback),
     mSensor(sensor),
     mConfig(config) {
-  mRunThread = std::thread(startThread, this);
   mSamplingPeriodNs = sensorInfo.minDelay * 1000LL;
+  mReportLatencyNs = 0;
   mDirectChannelRateNs = std::numeric_limits<int64_t>::max();
-  mNextSampleTimeNs = std::numeric_limits<int64_t>::max();
-  mNextDirectChannelNs = std::numeric_limits<int64_t>::max();
-}
-
-Sensor::~Sensor() {
-  // Ensure that lock is unlocked before calling mRunThread.join() or a
-  // deadlock will occur.
-  {
-    std::unique_lock<std::mutex> lock(mRunMutex);
-    mStopThread = true;
-    mIsEnabled = false;
-    mDirectChannelEnabled = false;
-    mWaitCV.notify_all();
+  mValues.resize(bosch::sensors::MAX_READ_VALUES);
+  mGyroUncalibratedOffset = gyroUncalibratedFix(mSensorInfo);
+  // The placement does not change, sendAdditionalInfoReport() reuses the frame
+  getSensorPlacement(mPlacementFrames);
+  mTaskId = bosch::sensors::SensorScheduler::getInstance().add([this](int64_t nowNs) { return onTimer(nowNs); });
+
+  // A sensor woken up by its device when samples are ready is read right
+  // away, the report clock then only guards against a stalled device
+  mIsDataDriven = mSensor->setDataReadyTask(mTaskId);
+  if (mIsDataDriven) {
+    mReportClock.setMode(bosch::sensors::FREE_RUNNING);
+    mReportClock.setTimeoutPeriods(bosch::sensors::DATA_READY_TIMEOUT_PERIODS);
   }
-  mRunThread.join();
 }
 
+Sensor::~Sensor() { bosch::sensors::SensorScheduler::getInstance().remove(mTaskId); }
+
 const SensorInfo& Sensor::getSensorInfo() const { return mSensorInfo; }
 
 void Sensor::batch(int64_t samplingPeriodNs, int64_t maxReportLatencyNs) {
   ALOGD("Sensor batch %s %ld %ld", mSensorInfo.name.c_str(), samplingPeriodNs, maxReportLatencyNs);
 
-  std::unique_lock<std::mutex> lock(mRunMutex);
+  std::unique_lock<std::mutex> lock(mControlMutex);
   samplingPeriodNs = std::clamp(samplingPeriodNs, static_cast<int64_t>(mSensorInfo.minDelay) * 1000,
                                 static_cast<int64_t>(mSensorInfo.maxDelay) * 1000);
 
@@ -172,52 +174,59 @@ void Sensor::batch(int64_t samplingPeriodNs, int64_t maxReportLatencyNs) {
     mSensor->batch(samplingPeriodNs, maxReportLatencyNs);
   }
 
-  if (mSamplingPeriodNs != samplingPeriodNs) {
+  // Events can only be held back as long as they fit into the FIFO
+  maxReportLatencyNs = std::min(maxReportLatencyNs, mSensorInfo.fifoMaxEventCount * samplingPeriodNs);
+
+  if ((mSamplingPeriodNs != samplingPeriodNs) || (mReportLatencyNs != maxReportLatencyNs)) {
     mSamplingPeriodNs = samplingPeriodNs;
-    // Wake up the 'run' thread to check if a new event should be generated now
-    mWaitCV.notify_all();
+    mReportLatencyNs = maxReportLatencyNs;
+    publishConfig();
   }
 }
+/*
+ * Runs on the data path, the frames and events go into arenas and the
+ * placement frame was built by the constructor.
+ */
 void Sensor::sendAdditionalInfoReport() {
-  std::vector<Event> events;
-  std::vector<AdditionalInfo> additionalInfoFrames;
-
-  additionalInfoFrames.push_back({
+  mAdditionalInfoFrames.clear();
+  mAdditionalInfoFrames.push_back({
     .type = AdditionalInfoType::AINFO_BEGIN,
     .serial = 0,
   });
-
-  getSensorPlacement(additionalInfoFrames);
-  getSensorTemperature(additionalInfoFrames);
-
-  additionalInfoFrames.push_back({
+  mAdditionalInfoFrames.append(mPlacementFrames);
+  getSensorTemperature(mAdditionalInfoFrames);
+  mAdditionalInfoFrames.push_back({
     .type = AdditionalInfoType::AINFO_END,
     .serial = 0,
   });
 
-  for (const auto& frame : additionalInfoFrames) {
-    events.emplace_back(Event{
+  mControlEvents.clear();
+  for (const auto& frame : mAdditionalInfoFrames.get()) {
+    mControlEvents.push_back(Event{
       .sensorHandle = mSensorInfo.sensorHandle,
       .sensorType = SensorType::ADDITIONAL_INFO,
       .timestamp = android::elapsedRealtimeNano(),
       .u.additional = frame,
     });
   }
-  if (!events.empty()) {
-    mCallback->postEvents(events, isWakeUpSensor());
-  }
+  mCallback->postEvents(mControlEvents.get(), isWakeUpSensor());
 }
 
 void Sensor::activate(bool enable) {
   ALOGD("Sensor activate %s %d", mSensorInfo.name.c_str(), enable);
 
-  std::unique_lock<std::mutex> lock(mRunMutex);
+  std::unique_lock<std::mutex> lock(mControlMutex);
   if (mIsEnabled != enable) {
+    // The sensor is configured before the data path starts reading it and
+    // after the data path has stopped
+    if (enable) mSensor->activate(true);
     mIsEnabled = enable;
-    mNextSampleTimeNs = mIsEnabled ? 0 : std::numeric_limits<int64_t>::max();
-    mWaitCV.notify_all();
-    mSensor->activate(enable);
-    if (enable) sendAdditionalInfoReport();
+    mReportGeneration++;
+    publishConfig();
+    if (!enable) {
+      waitForReportGeneration(mReportGeneration);
+      mSensor->activate(false);
+    }
   }
 }
 
@@ -230,18 +239,22 @@ Result Sensor::flush() {
     return Result::BAD_VALUE;
   }
 
-  // Note: If a sensor supports batching, write all of the currently batched
-  // events for the sensor to the Event FMQ prior to writing the flush complete
-  // event.
+  // The data path writes all of the currently batched events for the sensor
+  // to the Event FMQ prior to writing the flush complete event.
+  mFlushRequests++;
+  bosch::sensors::SensorScheduler::getInstance().schedule(mTaskId, 0);
+
+  return Result::OK;
+}
+
+void Sensor::postFlushComplete() {
   Event ev;
   ev.sensorHandle = mSensorInfo.sensorHandle;
   ev.sensorType = SensorType::META_DATA;
   ev.u.meta.what = MetaDataEventType::META_DATA_FLUSH_COMPLETE;
-  std::vector<Event> evs{ev};
-  mCallback->postEvents(evs, isWakeUpSensor());
-  sendAdditionalInfoReport();
-
-  return Result::OK;
+  mControlEvents.clear();
+  mControlEvents.push_back(ev);
+  mCallback->postEvents(mControlEvents.get(), isWakeUpSensor());
 }
 
 void Sensor::addDirectChannel(int32_t channelHandle, int64_t samplingPeriodNs) {
@@ -249,14 +262,14 @@ void Sensor::addDirectChannel(int32_t channelHandle, int64_t samplingPeriodNs) {
 
   if (samplingPeriodNs == 0) {
     {
-      std::unique_lock<std::mutex> lock(mRunMutex);
+      std::unique_lock<std::mutex> lock(mControlMutex);
       mDirectChannels[channelHandle] = {false, 0};
     }
     stopDirectChannel(channelHandle);
     return;
   }
 
-  std::unique_lock<std::mutex> lock(mRunMutex);
+  std::unique_lock<std::mutex> lock(mControlMutex);
   mDirectChannels[channelHandle] = {true, samplingPeriodNs};
   updateDirectChannel();
 }
@@ -264,7 +277,7 @@ void Sensor::addDirectChannel(int32_t channelHandle, int64_t samplingPeriodNs) {
 void Sensor::stopDirectChannel(int32_t channelHandle) {
   ALOGD("Sensor stopDirectChannel %s %d", mSensorInfo.name.c_str(), channelHandle);
 
-  std::unique_lock<std::mutex> lock(mRunMutex);
+  std::unique_lock<std::mutex> lock(mControlMutex);
 
   auto itRateNs = mDirectChannels.find(channelHandle);
   if (itRateNs != mDirectChannels.end()) {
@@ -277,7 +290,7 @@ void Sensor::stopDirectChannel(int32_t channelHandle) {
 void Sensor::removeDirectChannel(int32_t channelHandle) {
   ALOGD("Sensor removeDirectChannel %s %d", mSensorInfo.name.c_str(), channelHandle);
 
-  std::unique_lock<std::mutex> lock(mRunMutex);
+  std::unique_lock<std::mutex> lock(mControlMutex);
 
   auto itEnabled = mDirectChannels.find(channelHandle);
   if (itEnabled != mDirectChannels.end()) {
@@ -310,44 +323,160 @@ void Sensor::updateDirectChannel() {
   }
   if (mDirectChannelEnabled != anyChannelEnabled) {
     mDirectChannelEnabled = anyChannelEnabled;
-    mNextDirectChannelNs = mDirectChannelEnabled ? 0 : std::numeric_limits<int64_t>::max();
+    mDirectChannelGeneration++;
     if (!mIsEnabled) {
       mSensor->activate(mDirectChannelEnabled);
     }
   }
 
-  mWaitCV.notify_all();
+  publishConfig();
 }
 
-void Sensor::startThread(Sensor* sensor) { sensor->run(); }
-
-void Sensor::run() {
-  std::unique_lock<std::mutex> runLock(mRunMutex);
+/*
+ * Publishes the configuration to the data path, which picks it up on its next
+ * run. Must be called with mControlMutex held.
+ */
+void Sensor::publishConfig() {
+  bosch::sensors::SamplingConfig config{};
+  // Batched sensors are read once per report latency and deliver the whole
+  // FIFO content at once. Polled sensors are still read every sample and
+  // hold the events back in software instead.
+  const int64_t readPeriodNs = mIsDataDriven ? std::max(mSamplingPeriodNs, mReportLatencyNs) : mSamplingPeriodNs;
+  config.reportPeriodNs = readPeriodNs * bosch::sensors::POLL_TIME_REDUCTION_FACTOR;
+  config.reportLatencyNs = mIsDataDriven ? 0 : mReportLatencyNs;
+  config.directChannelRateNs = mDirectChannelRateNs;
+  config.reportGeneration = mReportGeneration;
+  config.directChannelGeneration = mDirectChannelGeneration;
+  config.isEnabled = mIsEnabled;
+  config.directChannelEnabled = mDirectChannelEnabled;
+  mSamplingConfig.store(config);
+
+  bosch::sensors::SensorScheduler::getInstance().schedule(mTaskId, 0);
+}
 
-  while (!mStopThread) {
-    if (!mIsEnabled && !mDirectChannelEnabled) {
-      mWaitCV.wait(runLock, [&] { return (mIsEnabled || mDirectChannelEnabled || mStopThread); });
+void Sensor::applyConfig(const bosch::sensors::SamplingConfig& config) {
+  if (config.reportGeneration != mAppliedConfig.reportGeneration) {
+    if (mAppliedConfig.isEnabled) {
+      logSamplingStats();
+      mReportClock.stop();
+    }
+    mPendingEvents.clear();
+    if (config.isEnabled) {
+      mReportClock.start();
+      sendAdditionalInfoReport();
+    }
+  }
+  if (config.directChannelGeneration != mAppliedConfig.directChannelGeneration) {
+    if (config.directChannelEnabled) {
+      mDirectChannelClock.start();
     } else {
-      int64_t currentTime = android::elapsedRealtimeNano();
-      std::vector<Event> events = readEvents();
-      if (mDirectChannelEnabled) {
-        if (currentTime >= mNextDirectChannelNs) {
-          mNextDirectChannelNs = currentTime + mDirectChannelRateNs * bosch::sensors::POLL_TIME_REDUCTION_FACTOR;
-          mCallback->writeToDirectBuffer(events, mDirectChannelRateNs);
-        }
-      }
-      if (mIsEnabled) {
-        if (currentTime >= mNextSampleTimeNs) {
-          mNextSampleTimeNs = currentTime + mSamplingPeriodNs * bosch::sensors::POLL_TIME_REDUCTION_FACTOR;
-          mCallback->postEvents(events, isWakeUpSensor());
-        }
-      }
-      currentTime = android::elapsedRealtimeNano();
-      int64_t waitTime = std::min(mNextSampleTimeNs, mNextDirectChannelNs) - currentTime;
-      if (waitTime < 1000000) waitTime = 1000000;
-      mWaitCV.wait_for(runLock, std::chrono::nanoseconds(waitTime));
+      mDirectChannelClock.stop();
+    }
+  }
+
+  mReportClock.setPeriod(config.reportPeriodNs);
+  if (config.directChannelEnabled) {
+    mDirectChannelClock.setPeriod(config.directChannelRateNs * bosch::sensors::POLL_TIME_REDUCTION_FACTOR);
+  }
+  mAppliedConfig = config;
+
+  if (config.reportGeneration != mAppliedReportGeneration) {
+    std::lock_guard<std::mutex> lock(mAppliedMutex);
+    mAppliedReportGeneration = config.reportGeneration;
+    mAppliedCondition.notify_all();
+  }
+}
+
+/*
+ * Waits until the data path has applied the given report generation. Once a
+ * disabled generation is applied the report clock is stopped and the sensor
+ * is not read any more. The wait is bounded so that a stuck scheduler thread
+ * can not block binder calls forever.
+ */
+void Sensor::waitForReportGeneration(uint32_t generation) {
+  std::unique_lock<std::mutex> lock(mAppliedMutex);
+  if (!mAppliedCondition.wait_for(lock, std::chrono::nanoseconds(bosch::sensors::CONFIG_APPLY_TIMEOUT_NS),
+                                  [&] { return mAppliedReportGeneration == generation; })) {
+    ALOGW("Sensor %s: data path did not apply report generation %u", mSensorInfo.name.c_str(), generation);
+  }
+}
+
+/*
+ * Called by the scheduler at the earliest of the report and direct channel
+ * deadlines. How the deadlines advance depends on the sampling mode of the
+ * sensor. Only the scheduler thread touches the clocks and pending events,
+ * so no lock is needed that binder calls could wait for.
+ */
+int64_t Sensor::onTimer(int64_t nowNs) {
+  applyConfig(mSamplingConfig.load());
+
+  const uint32_t flushRequests = mFlushRequests.exchange(0);
+  const bool directChannelDue = mDirectChannelClock.isDue(nowNs);
+  const bool reportDue = mReportClock.isDue(nowNs);
+  const bool isReading = mReportClock.isRunning() || mDirectChannelClock.isRunning();
+  const bool isDataReady = mIsDataDriven && mReportClock.isRunning();
+  if (isReading && (directChannelDue || reportDue || isDataReady || (flushRequests > 0))) {
+    readEvents();
+    const std::vector<Event>& events = mEvents.get();
+    if (directChannelDue) {
+      mDirectChannelClock.advance(nowNs);
+      mCallback->writeToDirectBuffer(events, mAppliedConfig.directChannelRateNs);
+    }
+    if (mReportClock.isRunning()) {
+      if (mPendingEvents.empty()) mBatchDeadlineNs = nowNs + mAppliedConfig.reportLatencyNs;
+      mPendingEvents.append(events);
     }
+    const bool hasNewData = isDataReady && !events.empty();
+    if (reportDue || hasNewData) {
+      mReportClock.advance(nowNs);
+      mSamplingStats.store(mReportClock.getStats());
+    }
+    if (reportDue || hasNewData || (flushRequests > 0)) postPendingEvents(nowNs, flushRequests > 0);
+  }
+
+  for (uint32_t i = 0; i < flushRequests; i++) {
+    postFlushComplete();
+    sendAdditionalInfoReport();
   }
+
+  return std::min(mReportClock.getDeadline(), mDirectChannelClock.getDeadline());
+}
+
+uint64_t Sensor::getArenaRegrowths() const {
+  return mEvents.getRegrowths() + mPendingEvents.getRegrowths() + mControlEvents.getRegrowths() +
+         mAdditionalInfoFrames.getRegrowths();
+}
+
+bosch::sensors::SamplingStats Sensor::getSamplingStats() {
+  auto stats = mSamplingStats.load();
+  stats.hardwareRateHz = mSensor->getHardwareRateHz();
+  stats.clockSkewPpm = mSensor->getClockSkewPpm();
+  stats.arenaRegrowths = getArenaRegrowths();
+  return stats;
+}
+
+void Sensor::logSamplingStats() {
+  const auto stats = mReportClock.getStats();
+  ALOGD("Sensor %s requested %.2f Hz achieved %.2f Hz, %zu ticks %zu skipped, %zu arena regrowths",
+        mSensorInfo.name.c_str(), stats.requestedRateHz, stats.achievedRateHz, static_cast<size_t>(stats.ticks),
+        static_cast<size_t>(stats.skippedTicks),
+        static_cast<size_t>(getArenaRegrowths()));
+}
+
+/*
+ * The software batch of a polled sensor is posted as one burst once the next
+ * read would miss the report latency, once it holds as many events as the
+ * advertised FIFO or on a flush.
+ */
+void Sensor::postPendingEvents(int64_t nowNs, bool isFlush) {
+  if (mPendingEvents.empty()) return;
+  if ((mAppliedConfig.reportLatencyNs > 0) && !isFlush &&
+      (nowNs + mAppliedConfig.reportPeriodNs <= mBatchDeadlineNs) &&
+      (mPendingEvents.size() < mSensorInfo.fifoMaxEventCount)) {
+    return;
+  }
+  mCallback->postEvents(mPendingEvents.get(), isWakeUpSensor());
+  mPendingEvents.clear();
 }
 
 bool Sensor::isWakeUpSensor() { return mSensorInfo.flags & static_cast<uint32_t>(SensorFlagBits::WAKE_UP); }
@@ -372,13 +501,18 @@ float gyroUncalibratedFix(const SensorInfo& mSensorInfo) {
     return 0;
 }
 
-std::vector<Event> Sensor::readEvents() {
-  std::vector<Event> events;
-  const auto& values = mSensor->readSensorValues();
+/*
+ * Converts the samples into mEvents. Both buffers are reused, so a read does
+ * not allocate once they have grown to the largest read.
+ */
+void Sensor::readEvents() {
+  mEvents.clear();
+  const size_t count = mSensor->readSensorValues(mValues.data(), mValues.size());
   const size_t xyzLength = 3;
   static float lastTemperature = 0;
 
-  for (const auto& value : values) {
+  for (size_t i = 0; i < count; i++) {
+    const auto& value = mValues[i];
     Event event{};
     event.sensorHandle = mSensorInfo.sensorHandle;
     event.sensorType = mSensorInfo.type;
@@ -391,18 +525,18 @@ std::vector<Event> Sensor::readEvents() {
         // ALOGD("Temperature: %f, timestamp: %zu", event.u.scalar, static_cast<size_t>(event.timestamp));
       }
     } else if (mSensorInfo.type == SensorType::GYROSCOPE_UNCALIBRATED) {
-      if (value.data.size() == xyzLength) {
-        event.u.uncal.x = value.data[0] + gyroUncalibratedFix(mSensorInfo);
-        event.u.uncal.y = value.data[1] + gyroUncalibratedFix(mSensorInfo);
-        event.u.uncal.z = value.data[2] + gyroUncalibratedFix(mSensorInfo);
+      if (value.size == xyzLength) {
+        event.u.uncal.x = value.data[0] + mGyroUncalibratedOffset;
+        event.u.uncal.y = value.data[1] + mGyroUncalibratedOffset;
+        event.u.uncal.z = value.data[2] + mGyroUncalibratedOffset;
         event.u.uncal.x_bias = 0;
         event.u.uncal.y_bias = 0;
         event.u.uncal.z_bias = 0;
       } else {
-        ALOGE("Read failed: %zu", static_cast<size_t>(value.data.size()));
+        ALOGE("Read failed: %zu", value.size);
       }
     } else if (mSensorInfo.type == SensorType::ACCELEROMETER_UNCALIBRATED) {
-      if (value.data.size() == xyzLength) {
+      if (value.size == xyzLength) {
         event.u.uncal.x = value.data[0];
         event.u.uncal.y = value.data[1];
         event.u.uncal.z = value.data[2];
@@ -410,10 +544,10 @@ std::vector<Event> Sensor::readEvents() {
         event.u.uncal.y_bias = 0;
         event.u.uncal.z_bias = 0;
       } else {
-        ALOGE("Read failed: %zu", static_cast<size_t>(value.data.size()));
+        ALOGE("Read failed: %zu", value.size);
       }
     } else {
-      if (value.data.size() == xyzLength) {
+      if (value.size == xyzLength) {
         event.u.vec3.x = value.data[0];
         event.u.vec3.y = value.data[1];
         event.u.vec3.z = value.data[2];
@@ -421,13 +555,11 @@ std::vector<Event> Sensor::readEvents() {
         // ALOGD("%f, %f, %f, %zu", event.u.vec3.x, event.u.vec3.y, event.u.vec3.z,
         // static_cast<size_t>(event.timestamp));
       } else {
-        ALOGE("Read failed: %zu", static_cast<size_t>(value.data.size()));
+        ALOGE("Read failed: %zu", value.size);
       }
     }
-    events.push_back(event);
+    mEvents.push_back(event);
   }
-
-  return events;
 }
 
 }  // namespace implementation
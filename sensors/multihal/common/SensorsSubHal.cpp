@@ -19,6 +19,9 @@
 
 #include <log/log.h>
 #include <sys/mman.h>
+#include <utils/SystemClock.h>
+
+#include <algorithm>
 
 namespace android {
 namespace hardware {
@@ -28,6 +31,7 @@ namespace subhal {
 namespace implementation {
 
 using ::android::hardware::Void;
+using ::android::hardware::sensors::V1_0::MetaDataEventType;
 using ::android::hardware::sensors::V1_0::OperationMode;
 using ::android::hardware::sensors::V1_0::RateLevel;
 using ::android::hardware::sensors::V1_0::Result;
@@ -79,10 +83,14 @@ ISensorsSubHalBase::ISensorsSubHalBase() : mCallback(nullptr) {}
 
 // Methods from ::android::hardware::sensors::V2_0::ISensors follow.
 Return<void> ISensorsSubHalBase::getSensorsList(V2_1::ISensors::getSensorsList_2_1_cb _hidl_cb) {
+  // Dynamic sensors are only announced through the callback
   std::vector<SensorInfo> sensors;
-  for (const auto& sensor : mSensors) {
-    sensors.push_back(sensor.second->getSensorInfo());
+  for (const auto& sensor : getSensors()) {
+    if (!(sensor->getSensorInfo().flags & V1_0::SensorFlagBits::DYNAMIC_SENSOR)) {
+      sensors.push_back(sensor->getSensorInfo());
+    }
   }
+  sensors.push_back(mDynamicSensorMetaInfo);
 
   _hidl_cb(sensors);
   return Void();
@@ -97,99 +105,211 @@ Return<Result> ISensorsSubHalBase::setOperationMode(OperationMode mode) {
 }
 
 Return<Result> ISensorsSubHalBase::activate(int32_t sensorHandle, bool enabled) {
-  auto sensor = mSensors.find(sensorHandle);
-  if (sensor != mSensors.end()) {
-    sensor->second->activate(enabled);
+  // The meta sensor only reports connections, it has nothing to switch on
+  if (sensorHandle == bosch::sensors::SensorList::DYNAMIC_SENSOR_META_HANDLE) {
+    mDynamicSensorMetaEnabled = enabled;
+    return Result::OK;
+  }
+
+  auto sensor = getSensor(sensorHandle);
+  if (sensor) {
+    sensor->activate(enabled);
     return Result::OK;
   }
   return Result::BAD_VALUE;
 }
 
 Return<Result> ISensorsSubHalBase::batch(int32_t sensorHandle, int64_t samplingPeriodNs, int64_t maxReportLatencyNs) {
-  int64_t usedLatency = maxReportLatencyNs;
-  if (maxReportLatencyNs > 0) {
-    mReportLatencyNs[sensorHandle] = maxReportLatencyNs;
-    for (auto sensor : mSensors) {
-      if (sensor.second->isEnabled()) {
-        auto latency = mReportLatencyNs.find(sensorHandle);
-        if (latency != mReportLatencyNs.end()) {
-          usedLatency = std::min(usedLatency, latency->second);
-        }
-      }
-    }
-  }
+  if (sensorHandle == bosch::sensors::SensorList::DYNAMIC_SENSOR_META_HANDLE) return Result::OK;
 
-  auto sensor = mSensors.find(sensorHandle);
-  if (sensor != mSensors.end()) {
-    sensor->second->batch(samplingPeriodNs, usedLatency);
+  auto sensor = getSensor(sensorHandle);
+  if (sensor) {
+    sensor->batch(samplingPeriodNs, maxReportLatencyNs);
     return Result::OK;
   }
   return Result::BAD_VALUE;
 }
 
+static SensorInfo createSensorInfo(const bosch::sensors::SensorData& data) {
+  SensorInfo sensorInfo{};
+  sensorInfo.sensorHandle = data.handle;
+  sensorInfo.name = data.sensorName;
+  sensorInfo.vendor = data.vendor;
+  sensorInfo.type = static_cast<SensorType>(data.type);
+  sensorInfo.typeAsString = "";
+  sensorInfo.version = 1;
+  sensorInfo.fifoReservedEventCount = data.fifoReservedEventCount;
+  sensorInfo.fifoMaxEventCount = data.fifoMaxEventCount;
+  sensorInfo.requiredPermission = "";
+
+  switch (data.reportMode) {
+    case bosch::sensors::SensorReportingMode::ON_CHANGE:
+      sensorInfo.flags |= V1_0::SensorFlagBits::ON_CHANGE_MODE;
+      break;
+    case bosch::sensors::SensorReportingMode::CONTINUOUS:
+      sensorInfo.flags |= V1_0::SensorFlagBits::CONTINUOUS_MODE;
+      sensorInfo.flags |= V1_0::SensorFlagBits::ADDITIONAL_INFO;
+      sensorInfo.flags |= V1_0::SensorFlagBits::DIRECT_CHANNEL_ASHMEM;
+      sensorInfo.flags |=
+        (static_cast<int32_t>(RateLevel::NORMAL) << static_cast<uint8_t>(V1_0::SensorFlagShift::DIRECT_REPORT));
+      break;
+    case bosch::sensors::SensorReportingMode::ONE_SHOT:
+      sensorInfo.flags |= V1_0::SensorFlagBits::ONE_SHOT_MODE;
+      break;
+    case bosch::sensors::SensorReportingMode::SPECIAL_REPORTING:
+      sensorInfo.flags |= V1_0::SensorFlagBits::SPECIAL_REPORTING_MODE;
+      break;
+    default:
+      ALOGW("Unknown report mode: %d", data.reportMode);
+      break;
+  }
+
+  sensorInfo.minDelay = data.minDelayUs;
+  sensorInfo.maxDelay = data.maxDelayUs;
+  sensorInfo.power = data.power;
+  sensorInfo.maxRange = data.range;
+  sensorInfo.resolution = data.resolution;
+  return sensorInfo;
+}
+
+static Event createDynamicSensorMetaEvent(int32_t sensorHandle, bool connected) {
+  Event event{};
+  event.timestamp = ::android::elapsedRealtimeNano();
+  event.sensorHandle = bosch::sensors::SensorList::DYNAMIC_SENSOR_META_HANDLE;
+  event.sensorType = SensorType::DYNAMIC_SENSOR_META;
+  event.u.dynamic.connected = connected;
+  event.u.dynamic.sensorHandle = sensorHandle;
+  const auto uuid = bosch::sensors::SensorList::getDynamicSensorUuid(sensorHandle);
+  std::copy(uuid.begin(), uuid.end(), event.u.dynamic.uuid.data());
+  return event;
+}
+
 void ISensorsSubHalBase::AddSensors() {
   for (const auto& sensor : mSensorList.getAvailableSensors()) {
-    const auto& data = sensor->getSensorData();
-    SensorInfo sensorInfo{};
-    sensorInfo.sensorHandle = mNextHandle++;
-    sensorInfo.name = data.sensorName;
-    sensorInfo.vendor = data.vendor;
-    sensorInfo.type = static_cast<SensorType>(data.type);
-    sensorInfo.typeAsString = "";
-    sensorInfo.version = 1;
-    sensorInfo.fifoReservedEventCount = 0;
-    sensorInfo.fifoMaxEventCount = 0;
-    sensorInfo.requiredPermission = "";
-
-    switch (data.reportMode) {
-      case bosch::sensors::SensorReportingMode::ON_CHANGE:
-        sensorInfo.flags |= V1_0::SensorFlagBits::ON_CHANGE_MODE;
-        break;
-      case bosch::sensors::SensorReportingMode::CONTINUOUS:
-        sensorInfo.flags |= V1_0::SensorFlagBits::CONTINUOUS_MODE;
-        sensorInfo.flags |= V1_0::SensorFlagBits::ADDITIONAL_INFO;
-        sensorInfo.flags |= V1_0::SensorFlagBits::DIRECT_CHANNEL_ASHMEM;
-        sensorInfo.flags |=
-          (static_cast<int32_t>(RateLevel::NORMAL) << static_cast<uint8_t>(V1_0::SensorFlagShift::DIRECT_REPORT));
-        break;
-      case bosch::sensors::SensorReportingMode::ONE_SHOT:
-        sensorInfo.flags |= V1_0::SensorFlagBits::ONE_SHOT_MODE;
-        break;
-      case bosch::sensors::SensorReportingMode::SPECIAL_REPORTING:
-        sensorInfo.flags |= V1_0::SensorFlagBits::SPECIAL_REPORTING_MODE;
-        break;
-      default:
-        ALOGW("Unknown report mode: %d", data.reportMode);
-        break;
+    addSensor(sensor, false /* isDynamic */);
+  }
+
+  mDynamicSensorMetaInfo = createSensorInfo(bosch::sensors::SensorList::getDynamicSensorMetaData());
+  mSensorList.startHotplugMonitor(
+    [this](const auto& addedSensors, const auto& removedHandles) { onSensorsChanged(addedSensors, removedHandles); });
+}
+
+SensorInfo ISensorsSubHalBase::addSensor(const std::shared_ptr<bosch::sensors::ISensorHal>& sensor, bool isDynamic) {
+  SensorInfo sensorInfo = createSensorInfo(sensor->getSensorData());
+  if (isDynamic) {
+    sensorInfo.flags |= V1_0::SensorFlagBits::DYNAMIC_SENSOR;
+  }
+
+  const auto sensors_config_list = readSensorsConfigFromXml();
+  std::optional<std::vector<Configuration>> sensorconfig = std::nullopt;
+  sensorconfig = getSensorConfiguration(*sensors_config_list, sensorInfo.name, sensorInfo.type);
+  std::shared_ptr<Sensor> halSensor = std::make_shared<Sensor>(this /* callback */, sensorInfo, sensor, sensorconfig);
+  ALOGD("AddSensor[%d] %s", sensorInfo.sensorHandle, sensorInfo.name.c_str());
+
+  std::lock_guard<std::mutex> lock(mSensorsMutex);
+  mSensors[sensorInfo.sensorHandle] = halSensor;
+  return sensorInfo;
+}
+
+/*
+ * Runs on the hotplug monitor thread. Removed sensors are handled first, an
+ * added sensor may take over the handle of a removed one.
+ */
+void ISensorsSubHalBase::onSensorsChanged(const std::vector<std::shared_ptr<bosch::sensors::ISensorHal>>& addedSensors,
+                                          const std::vector<int32_t>& removedHandles) {
+  std::vector<int32_t> disconnected{};
+  for (const int32_t sensorHandle : removedHandles) {
+    std::shared_ptr<Sensor> sensor{};
+    {
+      std::lock_guard<std::mutex> lock(mSensorsMutex);
+      auto it = mSensors.find(sensorHandle);
+      if (it == mSensors.end()) continue;
+      sensor = it->second;
+      mSensors.erase(it);
     }
+    sensor->activate(false);
+    disconnected.push_back(sensorHandle);
+  }
 
-    sensorInfo.minDelay = data.minDelayUs;
-    sensorInfo.maxDelay = data.maxDelayUs;
-    sensorInfo.power = data.power;
-    sensorInfo.maxRange = data.range;
-    sensorInfo.resolution = data.resolution;
+  std::vector<SensorInfo> connected{};
+  for (const auto& sensor : addedSensors) {
+    connected.push_back(addSensor(sensor, true /* isDynamic */));
+  }
+
+  announceDynamicSensors(connected, disconnected);
+}
 
-    const auto sensors_config_list = readSensorsConfigFromXml();
-    std::optional<std::vector<Configuration>> sensorconfig = std::nullopt;
-    sensorconfig = getSensorConfiguration(*sensors_config_list, sensorInfo.name, sensorInfo.type);
-    std::shared_ptr<Sensor> halSensor = std::make_shared<Sensor>(this /* callback */, sensorInfo, sensor, sensorconfig);
-    mSensors[halSensor->getSensorInfo().sensorHandle] = halSensor;
-    ALOGD("AddSensor[%d] %s", halSensor->getSensorInfo().sensorHandle, halSensor->getSensorInfo().name.c_str());
+/*
+ * The framework only takes a dynamic sensor into use with the meta event that
+ * follows the callback. The lock is held across the calls as the proxy
+ * callback can be replaced by initialize().
+ */
+void ISensorsSubHalBase::announceDynamicSensors(const std::vector<SensorInfo>& connected,
+                                                const std::vector<int32_t>& disconnected) {
+  std::lock_guard<std::mutex> lock(mSensorsMutex);
+  if (mCallback == nullptr) {
+    return;
+  }
+
+  std::vector<Event> events{};
+  if (!disconnected.empty()) {
+    mCallback->onDynamicSensorsDisconnected(disconnected);
+    for (const int32_t sensorHandle : disconnected) {
+      events.push_back(createDynamicSensorMetaEvent(sensorHandle, false /* connected */));
+    }
+  }
+  if (!connected.empty()) {
+    mCallback->onDynamicSensorsConnected(connected);
+    for (const auto& sensorInfo : connected) {
+      events.push_back(createDynamicSensorMetaEvent(sensorInfo.sensorHandle, true /* connected */));
+    }
+  }
+  if (!events.empty()) {
+    mCallback->postEvents(events, mCallback->createScopedWakelock(false));
   }
 }
 
-Return<Result> ISensorsSubHalBase::flush(int32_t sensorHandle) {
+std::shared_ptr<Sensor> ISensorsSubHalBase::getSensor(int32_t sensorHandle) {
+  std::lock_guard<std::mutex> lock(mSensorsMutex);
   auto sensor = mSensors.find(sensorHandle);
-  if (sensor != mSensors.end()) {
-    return sensor->second->flush();
+  return (sensor != mSensors.end()) ? sensor->second : nullptr;
+}
+
+std::vector<std::shared_ptr<Sensor>> ISensorsSubHalBase::getSensors() {
+  std::lock_guard<std::mutex> lock(mSensorsMutex);
+  std::vector<std::shared_ptr<Sensor>> sensors{};
+  for (const auto& sensor : mSensors) {
+    sensors.push_back(sensor.second);
+  }
+  return sensors;
+}
+
+/*
+ * The meta sensor has no batched events, a flush of it completes at once as
+ * long as it is activated, like for any other sensor.
+ */
+Return<Result> ISensorsSubHalBase::flush(int32_t sensorHandle) {
+  if (sensorHandle == bosch::sensors::SensorList::DYNAMIC_SENSOR_META_HANDLE) {
+    if (!mDynamicSensorMetaEnabled) return Result::BAD_VALUE;
+    Event event{};
+    event.sensorHandle = sensorHandle;
+    event.sensorType = SensorType::META_DATA;
+    event.u.meta.what = MetaDataEventType::META_DATA_FLUSH_COMPLETE;
+    postEvents({event}, false /* wakeup */);
+    return Result::OK;
+  }
+
+  auto sensor = getSensor(sensorHandle);
+  if (sensor) {
+    return sensor->flush();
   }
   return Result::BAD_VALUE;
 }
 
 Return<Result> ISensorsSubHalBase::injectSensorData(const Event& event) {
-  auto sensor = mSensors.find(event.sensorHandle);
-  if (sensor != mSensors.end()) {
-    return sensor->second->injectEvent(event);
+  auto sensor = getSensor(event.sensorHandle);
+  if (sensor) {
+    return sensor->injectEvent(event);
   }
 
   return Result::BAD_VALUE;
@@ -239,9 +359,9 @@ Return<Result> ISensorsSubHalBase::unregisterDirectChannel(int32_t channelHandle
   auto channelIt = mDirectChannels.find(channelHandle);
   if (channelIt != mDirectChannels.end()) {
     for (auto sensorHandle : channelIt->second->sensorHandles) {
-      auto sensorIt = mSensors.find(sensorHandle);
-      if (sensorIt != mSensors.end()) {
-        sensorIt->second->removeDirectChannel(channelHandle);
+      auto sensor = getSensor(sensorHandle);
+      if (sensor) {
+        sensor->removeDirectChannel(channelHandle);
       }
     }
   }
@@ -263,50 +383,50 @@ Return<void> ISensorsSubHalBase::configDirectReport(int32_t sensorHandle, int32_
 
   if (sensorHandle == -1 && rate == RateLevel::STOP) {
     for (auto sensor : channelIt->second->sensorHandles) {
-      auto sensorIt = mSensors.find(sensor);
-      if (sensorIt != mSensors.end()) {
-        channelIt->second->rateNs[sensor] = 0;
-        sensorIt->second->stopDirectChannel(channelHandle);
+      auto halSensor = getSensor(sensor);
+      if (halSensor) {
+        channelIt->second->setRate(sensor, 0);
+        halSensor->stopDirectChannel(channelHandle);
       }
     }
     _hidl_cb(Result::OK, 0);
     return Void();
   }
 
-  auto sensorIt = mSensors.find(sensorHandle);
-  if (sensorIt == mSensors.end()) {
+  auto sensor = getSensor(sensorHandle);
+  if (!sensor) {
     _hidl_cb(Result::BAD_VALUE, -1);
     return Void();
   }
 
-  if (!(sensorIt->second->getSensorInfo().flags & V1_0::SensorFlagBits::DIRECT_CHANNEL_ASHMEM)) {
+  if (!(sensor->getSensorInfo().flags & V1_0::SensorFlagBits::DIRECT_CHANNEL_ASHMEM)) {
     _hidl_cb(Result::BAD_VALUE, -1);
     return Void();
   }
 
-  const int32_t maxRate = (sensorIt->second->getSensorInfo().flags & V1_0::SensorFlagBits::MASK_DIRECT_REPORT) >>
+  const int32_t maxRate = (sensor->getSensorInfo().flags & V1_0::SensorFlagBits::MASK_DIRECT_REPORT) >>
                           static_cast<uint8_t>(V1_0::SensorFlagShift::DIRECT_REPORT);
 
   switch (rate) {
     case RateLevel::STOP:
-      channelIt->second->rateNs[sensorHandle] = 0;
+      channelIt->second->setRate(sensorHandle, 0);
       break;
     case RateLevel::NORMAL:
-      channelIt->second->rateNs[sensorHandle] = 20000000;
+      channelIt->second->setRate(sensorHandle, 20000000);
       break;
     case RateLevel::FAST:
       if (maxRate < static_cast<int32_t>(RateLevel::FAST)) {
         _hidl_cb(Result::BAD_VALUE, -1);
         return Void();
       }
-      channelIt->second->rateNs[sensorHandle] = 5000000;
+      channelIt->second->setRate(sensorHandle, 5000000);
       break;
     case RateLevel::VERY_FAST:
       if (maxRate < static_cast<int32_t>(RateLevel::VERY_FAST)) {
         _hidl_cb(Result::BAD_VALUE, -1);
         return Void();
       }
-      channelIt->second->rateNs[sensorHandle] = 1250000;
+      channelIt->second->setRate(sensorHandle, 1250000);
       break;
     default:
       _hidl_cb(Result::BAD_VALUE, -1);
@@ -314,7 +434,7 @@ Return<void> ISensorsSubHalBase::configDirectReport(int32_t sensorHandle, int32_
   }
 
   channelIt->second->sensorHandles.push_back(sensorHandle);
-  sensorIt->second->addDirectChannel(channelHandle, channelIt->second->rateNs[sensorHandle]);
+  sensor->addDirectChannel(channelHandle, channelIt->second->rateNs.get(sensorHandle));
 
   _hidl_cb(Result::OK, sensorHandle);
 
@@ -337,13 +457,22 @@ Return<void> ISensorsSubHalBase::debug(const hidl_handle& fd, const hidl_vec<hid
   }
 
   std::ostringstream stream;
+  stream << mSensorList.getStartupInfo() << std::endl;
   stream << "Available sensors:" << std::endl;
-  for (auto sensor : mSensors) {
-    SensorInfo info = sensor.second->getSensorInfo();
+  for (const auto& sensor : getSensors()) {
+    SensorInfo info = sensor->getSensorInfo();
     stream << "Name: " << info.name << std::endl;
     stream << "Min delay: " << info.minDelay << std::endl;
     stream << "Flags: " << info.flags << std::endl;
+    const auto stats = sensor->getSamplingStats();
+    stream << "Requested rate: " << stats.requestedRateHz << " Hz" << std::endl;
+    stream << "Achieved rate: " << stats.achievedRateHz << " Hz" << std::endl;
+    stream << "Hardware rate: " << stats.hardwareRateHz << " Hz" << std::endl;
+    stream << "Clock skew: " << stats.clockSkewPpm << " ppm" << std::endl;
+    stream << "Skipped ticks: " << stats.skippedTicks << std::endl;
+    stream << "Data path arena regrowths: " << stats.arenaRegrowths << std::endl;
   }
+  stream << "Event coalescer arena regrowths: " << mEventCoalescer.getArenaRegrowths() << std::endl;
   stream << std::endl;
 
   fprintf(out, "%s", stream.str().c_str());
@@ -353,24 +482,41 @@ Return<void> ISensorsSubHalBase::debug(const hidl_handle& fd, const hidl_vec<hid
 }
 
 Return<Result> ISensorsSubHalBase::initialize(std::unique_ptr<IHalProxyCallbackWrapperBase>& halProxyCallback) {
-  mCallback = std::move(halProxyCallback);
+  {
+    std::lock_guard<std::mutex> lock(mSensorsMutex);
+    mCallback = std::move(halProxyCallback);
+  }
 
   for (auto& [channelHandle, channel] : mDirectChannels) {
     for (auto sensorHandle : channel->sensorHandles) {
-      auto sensor = mSensors.find(sensorHandle);
-      if (sensor != mSensors.end()) {
-        sensor->second->removeDirectChannel(channelHandle);
+      auto sensor = getSensor(sensorHandle);
+      if (sensor) {
+        sensor->removeDirectChannel(channelHandle);
       }
     }
   }
   mDirectChannels.clear();
+  mDynamicSensorMetaEnabled = false;
 
   setOperationMode(OperationMode::NORMAL);
+
+  // The proxy forgets dynamic sensors when it is initialized again
+  std::vector<SensorInfo> dynamicSensors{};
+  for (const auto& sensor : getSensors()) {
+    if (sensor->getSensorInfo().flags & V1_0::SensorFlagBits::DYNAMIC_SENSOR) {
+      dynamicSensors.push_back(sensor->getSensorInfo());
+    }
+  }
+  announceDynamicSensors(dynamicSensors, {});
   return Result::OK;
 }
 
 void ISensorsSubHalBase::postEvents(const std::vector<Event>& events, bool wakeup) {
-  ScopedWakelock wakelock = mCallback->createScopedWakelock(wakeup);
+  mEventCoalescer.post(events, wakeup);
+}
+
+void ISensorsSubHalBase::writeEvents(const std::vector<Event>& events, size_t wakeUpEvents) {
+  ScopedWakelock wakelock = mCallback->createScopedWakelock(wakeUpEvents > 0);
   mCallback->postEvents(events, std::move(wakelock));
 }
 
@@ -378,21 +524,12 @@ void ISensorsSubHalBase::writeToDirectBuffer(const std::vector<Event>& events, i
   if (mChannelMutex.try_lock()) {
     for (const auto& event : events) {
       for (auto& [channelHandle, channel] : mDirectChannels) {
-        if (std::find(channel->sensorHandles.begin(), channel->sensorHandles.end(), event.sensorHandle) ==
-            channel->sensorHandles.end()) {
-          continue;  // Skip channels that sensorHandle not match
-        }
-        if (channel->rateNs[event.sensorHandle] == 0) {
-          continue;  // Skip channels that are not active
-        }
-        channel->sampleCount[event.sensorHandle]++;
-        if (samplingPeriodNs * channel->sampleCount[event.sensorHandle] < channel->rateNs[event.sensorHandle]) {
-          continue;  // Skip channels that have faster sampling period
+        if (!channel->isSampleDue(event.sensorHandle, samplingPeriodNs)) {
+          continue;  // Skip channels that are not active or have a slower rate
         }
         sensors_event_t ev;
         V2_1::implementation::convertToSensorEvent(event, &ev);
         channel->write(&ev);
-        channel->sampleCount[event.sensorHandle] = 0;
       }
     }
     mChannelMutex.unlock();
@@ -19,9 +19,11 @@
 
 #include <log/log.h>
 
+#include <atomic>
 #include <vector>
 
 #include "DirectChannel.h"
+#include "EventCoalescer.h"
 #include "IHalProxyCallbackWrapper.h"
 #include "Sensor.h"
 #include "SensorList.h"
@@ -82,20 +84,42 @@ public:
 
 protected:
   void AddSensors();
+  SensorInfo addSensor(const std::shared_ptr<bosch::sensors::ISensorHal>& sensor, bool isDynamic);
+
   /**
-   * A map of the report latency in nanoseconds
+   * Connect and disconnect dynamic sensors of devices that are hotplugged
    */
-  std::map<int32_t, int64_t> mReportLatencyNs;
+  void onSensorsChanged(const std::vector<std::shared_ptr<bosch::sensors::ISensorHal>>& addedSensors,
+                        const std::vector<int32_t>& removedHandles);
+  void announceDynamicSensors(const std::vector<SensorInfo>& connected, const std::vector<int32_t>& disconnected);
+
+  std::shared_ptr<Sensor> getSensor(int32_t sensorHandle);
+  std::vector<std::shared_ptr<Sensor>> getSensors();
 
   /**
-   * A map of the available sensors
+   * Writes the events of all sensors collected by the coalescer at once
+   */
+  void writeEvents(const std::vector<Event>& events, size_t wakeUpEvents);
+
+  /**
+   * A map of the available sensors, including the dynamic ones
    */
   std::map<int32_t, std::shared_ptr<Sensor>> mSensors;
 
   /**
-   * The next available sensor handle
+   * Lock to protect the sensor map and the callback, which change on hotplug
+   */
+  std::mutex mSensorsMutex;
+
+  /**
+   * The sensor that reports dynamic sensor connections
+   */
+  SensorInfo mDynamicSensorMetaInfo;
+
+  /**
+   * Whether the framework has activated the meta sensor, it can only be flushed then
    */
-  int32_t mNextHandle = 1;
+  std::atomic_bool mDynamicSensorMetaEnabled{false};
 
   /**
    * Callback used to communicate to the HalProxy when dynamic sensors are
@@ -104,6 +128,12 @@ protected:
    */
   std::unique_ptr<IHalProxyCallbackWrapperBase> mCallback;
 
+  /**
+   * Collects the events of all sensors into one call to the HalProxy
+   */
+  bosch::sensors::EventCoalescer<Event> mEventCoalescer{
+    [this](const std::vector<Event>& events, size_t wakeUpEvents) { writeEvents(events, wakeUpEvents); }};
+
 private:
   /**
    * The current operation mode of the multihal framework. Ensures that all
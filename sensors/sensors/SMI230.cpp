@@ -16,14 +16,79 @@
 
 #include "SMI230.h"
 
-#include <unistd.h>
-
-#include "FileHandler.h"
+#include "AttributeCache.h"
+#include "OdrTable.h"
 
 namespace bosch::sensors {
 
 static constexpr float SMI230_GYRO_VAR = 1.72e-4;  // (rad/s)^2 / Hz
 
+// Start-up time of the accelerometer and gyroscope with margin
+static constexpr std::array<int64_t, Smi230Imu::Index::LENGTH> SMI230_SETTLE_TIME_NS{10000000, 40000000};
+
+// Rates of the units from the slowest
+static constexpr std::array<OdrSetting, 8> SMI230_ACC_ODR{{
+  {80000000, "12.5Hz"},
+  {40000000, "25Hz"},
+  {20000000, "50Hz"},
+  {10000000, "100Hz"},
+  {5000000, "200Hz"},
+  {2500000, "400Hz"},
+  {1250000, "800Hz"},
+  {625000, "1600Hz"},
+}};
+
+// The gyroscope couples rate and filter, the widest bandwidth of each rate is used
+static constexpr std::array<OdrSetting, 5> SMI230_GYRO_ODR{{
+  {10000000, "bw32_odr100"},
+  {5000000, "bw64_odr200"},
+  {2500000, "bw47_odr400"},
+  {1000000, "bw116_odr1000"},
+  {500000, "bw532_odr2000"},
+}};
+
+// Rate of both units until the first batch call
+static constexpr int64_t SMI230_DEFAULT_PERIOD_NS = 5000000;
+
+static const OdrSetting& selectSmi230Odr(Smi230Imu::Index idx, int64_t samplingPeriodNs) {
+  if (idx == Smi230Imu::Index::ACCEL) return SMI230_ACC_ODR[selectOdr(SMI230_ACC_ODR, samplingPeriodNs)];
+  return SMI230_GYRO_ODR[selectOdr(SMI230_GYRO_ODR, samplingPeriodNs)];
+}
+
+/*
+ * Accelerometer and gyroscope are separate IIO devices but share the package,
+ * their power transitions are coalesced like for a single device.
+ */
+Smi230Imu::Smi230Imu()
+  : mPowerState(SMI230_SETTLE_TIME_NS, [this](size_t idx, bool enable) {
+      auto cache = bosch::hwctl::AttributeCache::getInstance(mDevice[idx]);
+      bosch::hwctl::AttributeCache::Transaction(*cache)
+        .set(mSysfsOdr[idx], mOdr[idx].load())
+        .set(mSysfsPowerMode, enable ? "normal" : "suspend")
+        .commit();
+    }) {
+  for (size_t idx = 0; idx < Index::LENGTH; idx++) {
+    mOdr[idx] = selectSmi230Odr(static_cast<Index>(idx), SMI230_DEFAULT_PERIOD_NS).value;
+  }
+}
+
+void Smi230Imu::setPowerMode(Index idx, bool enable, const std::string& device) {
+  mIsEnabled[idx] = enable;
+  mDevice[idx] = device;
+  mPowerState.request(idx, enable);
+}
+
+/*
+ * Accelerometer and gyroscope are separate devices with a rate of their own.
+ * A unit that is off gets the new rate with its next power up.
+ */
+int64_t Smi230Imu::setSamplingRate(Index idx, int64_t samplingPeriodNs, const std::string& device) {
+  const auto& odr = selectSmi230Odr(idx, samplingPeriodNs);
+  mOdr[idx] = odr.value;
+  if (mIsEnabled[idx]) bosch::hwctl::AttributeCache::getInstance(device)->write(mSysfsOdr[idx], odr.value);
+  return odr.periodNs;
+}
+
 Smi230Acc::Smi230Acc() {
   mSensorData.driverName = "smi230acc";
   mSensorData.sensorName = "SMI230 BOSCH Accelerometer Sensor";
@@ -38,14 +103,10 @@ Smi230Acc::Smi230Acc() {
   mSensorData.temperatureScale = 0.001f;
   mSensorData.temperatureOffset = 0;
   mSensorData.reportMode = CONTINUOUS;
+  mSensorData.fifoReservedEventCount = 146;
+  mSensorData.fifoMaxEventCount = 146;
 };
 
-void Smi230Acc::setPowerMode(bool enable) {
-  { bosch::hwctl::WriteHandler handler(mDevice, mSysfsOdr, "200Hz"); }
-  { bosch::hwctl::WriteHandler handler(mDevice, mSysfsPowerMode, enable ? "normal" : "suspend"); }
-  usleep(200000);
-}
-
 Smi230AccUncalibrated::Smi230AccUncalibrated() {
   mSensorData.sensorName = "SMI230 BOSCH Accelerometer Uncalibrated Sensor";
   mSensorData.type = BoschSensorType::ACCEL_UNCALIBRATED;
@@ -62,12 +123,8 @@ Smi230Gyro::Smi230Gyro() {
   mSensorData.range = degreeToRad(2000);
   mSensorData.resolution = degreeToRad(1.0f / 16.38f);
   mSensorData.reportMode = CONTINUOUS;
-}
-
-void Smi230Gyro::setPowerMode(bool enable) {
-  { bosch::hwctl::WriteHandler handler(mDevice, mSysfsOdr, "bw64_odr200"); }
-  { bosch::hwctl::WriteHandler handler(mDevice, mSysfsPowerMode, enable ? "normal" : "suspend"); }
-  usleep(200000);
+  mSensorData.fifoReservedEventCount = 100;
+  mSensorData.fifoMaxEventCount = 100;
 }
 
 Smi230GyroUncalibrated::Smi230GyroUncalibrated() {
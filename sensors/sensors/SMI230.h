@@ -17,22 +17,78 @@
 #ifndef ANDROID_HARDWARE_BOSCH_SENSORS_SMI230_H
 #define ANDROID_HARDWARE_BOSCH_SENSORS_SMI230_H
 
+#include <array>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+
 #include "CompositeSensors.h"
+#include "PowerStateMachine.h"
 #include "SensorCore.h"
 
 namespace bosch {
 namespace sensors {
 
+class Smi230Imu {
+public:
+  Smi230Imu(const Smi230Imu&) = delete;
+  Smi230Imu& operator=(const Smi230Imu&) = delete;
+  ~Smi230Imu() = default;
+
+  // One per chip, the instances are numbered in device order
+  static Smi230Imu& getInstance(uint32_t instance) {
+    static std::mutex instancesMutex;
+    static std::map<uint32_t, std::unique_ptr<Smi230Imu>> instances;
+    std::lock_guard<std::mutex> lock(instancesMutex);
+    auto& imu = instances[instance];
+    if (!imu) imu.reset(new Smi230Imu());
+    return *imu;
+  }
+
+  enum Index { ACCEL, GYRO, LENGTH };
+
+  void setPowerMode(Index idx, bool enable, const std::string& device);
+  int64_t setSamplingRate(Index idx, int64_t samplingPeriodNs, const std::string& device);
+  bool isSettled(Index idx, int64_t timestampNs) const { return mPowerState.isSettled(idx, timestampNs); }
+  const std::shared_ptr<TimestampEstimator>& getTimestampEstimator() const { return mTimestampEstimator; }
+
+private:
+  Smi230Imu();
+
+  const std::string mSysfsPowerMode{"pwr"};
+  const std::array<std::string, Index::LENGTH> mSysfsOdr{"odr", "bw_odr"};
+
+  std::array<bool, Index::LENGTH> mIsEnabled{false, false};
+  std::array<std::string, Index::LENGTH> mDevice{};
+  // Selected rate of each unit, also written on power up by the scheduler thread
+  std::array<std::atomic<const char*>, Index::LENGTH> mOdr{};
+
+  PowerStateMachine mPowerState;
+  // Accelerometer and gyroscope are clocked by the same oscillator
+  std::shared_ptr<TimestampEstimator> mTimestampEstimator{std::make_shared<TimestampEstimator>()};
+};
+
 class Smi230Acc : public SensorCore {
 public:
   Smi230Acc();
   ~Smi230Acc() = default;
 
-  void setPowerMode(bool enable) override;
+  void setInstance(uint32_t instance, int32_t handle) override {
+    SensorCore::setInstance(instance, handle);
+    mImu = &Smi230Imu::getInstance(instance);
+    setTimestampEstimator(mImu->getTimestampEstimator());
+  }
+  void setPowerMode(bool enable) override { mImu->setPowerMode(Smi230Imu::Index::ACCEL, enable, mDevice); };
+  int64_t setSamplingRate(int64_t samplingPeriodNs) override {
+    return mImu->setSamplingRate(Smi230Imu::Index::ACCEL, samplingPeriodNs, mDevice);
+  };
 
-private:
-  const std::string mSysfsPowerMode = "pwr";
-  const std::string mSysfsOdr = "odr";
+protected:
+  bool isSettled(int64_t timestampNs) const override { return mImu->isSettled(Smi230Imu::Index::ACCEL, timestampNs); };
+
+  // Bound by setInstance()
+  Smi230Imu* mImu{nullptr};
 };
 
 class Smi230AccUncalibrated : public Smi230Acc {
@@ -46,11 +102,21 @@ public:
   Smi230Gyro();
   ~Smi230Gyro() = default;
 
-  void setPowerMode(bool enable) override;
+  void setInstance(uint32_t instance, int32_t handle) override {
+    SensorCore::setInstance(instance, handle);
+    mImu = &Smi230Imu::getInstance(instance);
+    setTimestampEstimator(mImu->getTimestampEstimator());
+  }
+  void setPowerMode(bool enable) override { mImu->setPowerMode(Smi230Imu::Index::GYRO, enable, mDevice); };
+  int64_t setSamplingRate(int64_t samplingPeriodNs) override {
+    return mImu->setSamplingRate(Smi230Imu::Index::GYRO, samplingPeriodNs, mDevice);
+  };
 
-private:
-  const std::string mSysfsPowerMode = "pwr";
-  const std::string mSysfsOdr = "bw_odr";
+protected:
+  bool isSettled(int64_t timestampNs) const override { return mImu->isSettled(Smi230Imu::Index::GYRO, timestampNs); };
+
+  // Bound by setInstance()
+  Smi230Imu* mImu{nullptr};
 };
 
 class Smi230GyroUncalibrated : public Smi230Gyro {
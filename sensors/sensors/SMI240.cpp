@@ -16,10 +16,34 @@
 
 #include "SMI240.h"
 
+#include <unistd.h>
+
+#include "AttributeCache.h"
+#include "OdrTable.h"
+
 namespace bosch::sensors {
 
 static constexpr float SMI240_GYRO_VAR = 2.25e-4;  // (rad/s)^2 / Hz
 
+/*
+ * The SMI240 samples internally at a fixed rate and is polled, only its low
+ * pass filter can be chosen. The narrow one is used as long as it is below
+ * the Nyquist rate of the requested period.
+ */
+static constexpr std::array<OdrSetting, 2> SMI240_BANDWIDTH{{
+  {10000000, "50"},
+  {0, "400"},
+}};
+
+static int64_t setSmi240Bandwidth(const std::string& device, const std::string& attribute, int64_t samplingPeriodNs) {
+  // Older drivers have a fixed filter
+  if (access((device + attribute).c_str(), W_OK) == 0) {
+    const auto& bandwidth = SMI240_BANDWIDTH[selectOdr(SMI240_BANDWIDTH, samplingPeriodNs)];
+    bosch::hwctl::AttributeCache::getInstance(device)->write(attribute, bandwidth.value);
+  }
+  return samplingPeriodNs;
+}
+
 Smi240Acc::Smi240Acc() : SensorCore() {
   mSensorData.driverName = "smi240";
   mSensorData.sensorName = "SMI240 BOSCH Accelerometer Sensor";
@@ -36,6 +60,10 @@ Smi240Acc::Smi240Acc() : SensorCore() {
   mSensorData.reportMode = CONTINUOUS;
 }
 
+int64_t Smi240Acc::setSamplingRate(int64_t samplingPeriodNs) {
+  return setSmi240Bandwidth(mDevice, mSysfsBandwidth, samplingPeriodNs);
+}
+
 Smi240AccUncalibrated::Smi240AccUncalibrated() {
   mSensorData.sensorName = "SMI240 BOSCH Accelerometer Uncalibrated Sensor";
   mSensorData.type = BoschSensorType::ACCEL_UNCALIBRATED;
@@ -57,6 +85,10 @@ Smi240Gyro::Smi240Gyro() : SensorCore() {
   mSensorData.reportMode = CONTINUOUS;
 }
 
+int64_t Smi240Gyro::setSamplingRate(int64_t samplingPeriodNs) {
+  return setSmi240Bandwidth(mDevice, mSysfsBandwidth, samplingPeriodNs);
+}
+
 Smi240GyroUncalibrated::Smi240GyroUncalibrated() {
   mSensorData.sensorName = "SMI240 BOSCH Gyroscope Uncalibrated Sensor";
   mSensorData.type = BoschSensorType::GYRO_UNCALIBRATED;
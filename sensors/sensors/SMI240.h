@@ -27,6 +27,11 @@ class Smi240Acc : public SensorCore {
 public:
   Smi240Acc();
   ~Smi240Acc() = default;
+
+  int64_t setSamplingRate(int64_t samplingPeriodNs) override;
+
+private:
+  const std::string mSysfsBandwidth{"in_accel_filter_low_pass_3db_frequency"};
 };
 
 class Smi240AccUncalibrated : public Smi240Acc {
@@ -39,6 +44,11 @@ class Smi240Gyro : public SensorCore {
 public:
   Smi240Gyro();
   ~Smi240Gyro() = default;
+
+  int64_t setSamplingRate(int64_t samplingPeriodNs) override;
+
+private:
+  const std::string mSysfsBandwidth{"in_anglvel_filter_low_pass_3db_frequency"};
 };
 
 class Smi240GyroUncalibrated : public Smi240Gyro {
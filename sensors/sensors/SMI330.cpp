@@ -16,27 +16,53 @@
 
 #include "SMI330.h"
 
-#include <unistd.h>
-
-#include "FileHandler.h"
+#include "AttributeCache.h"
+#include "OdrTable.h"
 
 namespace bosch::sensors {
 
 static constexpr float SMI330_GYRO_VAR = 4.9e-5;  // (rad/s)^2 / Hz
 
+// Start-up time of the accelerometer and gyroscope in normal mode with margin
+static constexpr std::array<int64_t, Smi330Imu::Index::LENGTH> SMI330_SETTLE_TIME_NS{20000000, 50000000};
+
+// Accelerometer and gyroscope share the output data rate
+static constexpr std::array<OdrSetting, 10> SMI330_ODR{{
+  {1280000000, "0.78125"},
+  {640000000, "1.5625"},
+  {320000000, "3.125"},
+  {160000000, "6.25"},
+  {80000000, "12.5"},
+  {40000000, "25"},
+  {20000000, "50"},
+  {10000000, "100"},
+  {5000000, "200"},
+  {2500000, "400"},
+}};
+
+Smi330Imu::Smi330Imu()
+  : mPowerState(SMI330_SETTLE_TIME_NS, [this](size_t idx, bool enable) {
+      bosch::hwctl::AttributeCache::getInstance(mDevice[idx])->write(mSysfsPowerMode[idx], enable ? "3" : "0");
+    }) {}
+
 void Smi330Imu::setPowerMode(Index idx, bool enable, const std::string& device) {
   mIsEnabled[idx] = enable;
+  mDevice[idx] = device;
   updateSamplingRate(device);
-  bosch::hwctl::WriteHandler handler(device, mSysfsPowerMode[idx], enable ? "3" : "0");
-  usleep(200000);
+  mPowerState.request(idx, enable);
 }
 
-void Smi330Imu::setSamplingRate(Index idx, int64_t samplingPeriodNs, const std::string& device) {
+int64_t Smi330Imu::setSamplingRate(Index idx, int64_t samplingPeriodNs, const std::string& device) {
   mSamplingPeriodNs[idx] = samplingPeriodNs;
-  updateSamplingRate(device);
+  const int64_t hardwarePeriodNs = updateSamplingRate(device);
+  return (hardwarePeriodNs > 0) ? hardwarePeriodNs : SMI330_ODR[selectOdr(SMI330_ODR, samplingPeriodNs)].periodNs;
 }
 
-void Smi330Imu::updateSamplingRate(const std::string& device) {
+/*
+ * Returns the period the chip runs at, 0 while both units are off and the
+ * rate is left as it is.
+ */
+int64_t Smi330Imu::updateSamplingRate(const std::string& device) {
   int64_t samplingPeriodNs = 0;
   if (mIsEnabled[Index::ACCEL] && mIsEnabled[Index::GYRO]) {
     samplingPeriodNs = std::min(mSamplingPeriodNs[Index::ACCEL], mSamplingPeriodNs[Index::GYRO]);
@@ -45,17 +71,13 @@ void Smi330Imu::updateSamplingRate(const std::string& device) {
   } else if (mIsEnabled[Index::GYRO]) {
     samplingPeriodNs = mSamplingPeriodNs[Index::GYRO];
   } else {
-    return;
+    return 0;
   }
 
-  int64_t odr = 1e9 / mMaxSamplingRateNs;
-  for (int64_t samplingRate = mMaxSamplingRateNs; samplingRate >= mMinSamplingRateNs; samplingRate /= 2) {
-    if (samplingPeriodNs >= samplingRate) {
-      odr = 1e9 / samplingRate;
-      break;
-    }
-  }
-  bosch::hwctl::WriteHandler handler(device, mSysfsOdr, std::to_string(odr));
+  // Unchanged rates, e.g. on every batch call, are not written again
+  const auto& odr = SMI330_ODR[selectOdr(SMI330_ODR, samplingPeriodNs)];
+  bosch::hwctl::AttributeCache::getInstance(device)->write(mSysfsOdr, odr.value);
+  return odr.periodNs;
 }
 
 Smi330Acc::Smi330Acc() {
@@ -72,6 +94,9 @@ Smi330Acc::Smi330Acc() {
   mSensorData.temperatureScale = 1.0f / 512;
   mSensorData.temperatureOffset = 23.0f * 512;
   mSensorData.reportMode = CONTINUOUS;
+  // The 2 kB FIFO is shared between accelerometer and gyroscope
+  mSensorData.fifoReservedEventCount = 170;
+  mSensorData.fifoMaxEventCount = 340;
 }
 
 Smi330AccUncalibrated::Smi330AccUncalibrated() {
@@ -93,11 +118,13 @@ Smi330Gyro::Smi330Gyro() {
   mSensorData.temperatureScale = 1.0f / 512;
   mSensorData.temperatureOffset = 23.0f * 512;
   mSensorData.reportMode = CONTINUOUS;
+  mSensorData.fifoReservedEventCount = 170;
+  mSensorData.fifoMaxEventCount = 340;
 }
 
 void Smi330Gyro::setScale() {
   // Fixed range of 250 °/s
-  bosch::hwctl::WriteHandler handler(mDevice, mSysfsScale, "0.007629395");
+  bosch::hwctl::AttributeCache::getInstance(mDevice)->write(mSysfsScale, "0.007629395");
 }
 
 Smi330GyroUncalibrated::Smi330GyroUncalibrated() {
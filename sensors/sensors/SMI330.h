@@ -18,8 +18,12 @@
 #define ANDROID_HARDWARE_BOSCH_SENSORS_SMI330_H
 
 #include <array>
+#include <map>
+#include <memory>
+#include <mutex>
 
 #include "CompositeSensors.h"
+#include "PowerStateMachine.h"
 #include "SensorCore.h"
 
 namespace bosch {
@@ -29,30 +33,38 @@ class Smi330Imu {
 public:
   Smi330Imu(const Smi330Imu&) = delete;
   Smi330Imu& operator=(const Smi330Imu&) = delete;
+  ~Smi330Imu() = default;
 
-  static Smi330Imu& getInstance() {
-    static Smi330Imu instance;
-    return instance;
+  // One per chip, the instances are numbered in device order
+  static Smi330Imu& getInstance(uint32_t instance) {
+    static std::mutex instancesMutex;
+    static std::map<uint32_t, std::unique_ptr<Smi330Imu>> instances;
+    std::lock_guard<std::mutex> lock(instancesMutex);
+    auto& imu = instances[instance];
+    if (!imu) imu.reset(new Smi330Imu());
+    return *imu;
   }
 
   enum Index { ACCEL, GYRO, LENGTH };
 
   void setPowerMode(Index idx, bool enable, const std::string& device);
-  void setSamplingRate(Index idx, int64_t samplingPeriodNs, const std::string& device);
+  int64_t setSamplingRate(Index idx, int64_t samplingPeriodNs, const std::string& device);
+  bool isSettled(Index idx, int64_t timestampNs) const { return mPowerState.isSettled(idx, timestampNs); }
 
 private:
-  Smi330Imu() = default;
-  ~Smi330Imu() = default;
+  Smi330Imu();
 
-  void updateSamplingRate(const std::string& device);
+  int64_t updateSamplingRate(const std::string& device);
 
-  const int64_t mMinSamplingRateNs = 2500000;
   const int64_t mMaxSamplingRateNs = 1280000000;
   const std::string mSysfsOdr{"in_sampling_frequency"};
   const std::array<std::string, Index::LENGTH> mSysfsPowerMode{"in_accel_en", "in_anglvel_en"};
 
   std::array<bool, Index::LENGTH> mIsEnabled{false, false};
   std::array<int64_t, Index::LENGTH> mSamplingPeriodNs{mMaxSamplingRateNs, mMaxSamplingRateNs};
+  std::array<std::string, Index::LENGTH> mDevice{};
+
+  PowerStateMachine mPowerState;
 };
 
 class Smi330Acc : public SensorCore {
@@ -60,12 +72,20 @@ public:
   Smi330Acc();
   ~Smi330Acc() = default;
 
-  void setPowerMode(bool enable) override {
-    Smi330Imu::getInstance().setPowerMode(Smi330Imu::Index::ACCEL, enable, mDevice);
-  };
-  void setSamplingRate(int64_t samplingPeriodNs) override {
-    Smi330Imu::getInstance().setSamplingRate(Smi330Imu::Index::ACCEL, samplingPeriodNs, mDevice);
+  void setInstance(uint32_t instance, int32_t handle) override {
+    SensorCore::setInstance(instance, handle);
+    mImu = &Smi330Imu::getInstance(instance);
+  }
+  void setPowerMode(bool enable) override { mImu->setPowerMode(Smi330Imu::Index::ACCEL, enable, mDevice); };
+  int64_t setSamplingRate(int64_t samplingPeriodNs) override {
+    return mImu->setSamplingRate(Smi330Imu::Index::ACCEL, samplingPeriodNs, mDevice);
   };
+
+protected:
+  bool isSettled(int64_t timestampNs) const override { return mImu->isSettled(Smi330Imu::Index::ACCEL, timestampNs); };
+
+  // Bound by setInstance()
+  Smi330Imu* mImu{nullptr};
 };
 
 class Smi330AccUncalibrated : public Smi330Acc {
@@ -79,14 +99,24 @@ public:
   Smi330Gyro();
   ~Smi330Gyro() = default;
 
+  void setInstance(uint32_t instance, int32_t handle) override {
+    SensorCore::setInstance(instance, handle);
+    mImu = &Smi330Imu::getInstance(instance);
+  }
   void setPowerMode(bool enable) override {
     if (enable) setScale();
-    Smi330Imu::getInstance().setPowerMode(Smi330Imu::Index::GYRO, enable, mDevice);
+    mImu->setPowerMode(Smi330Imu::Index::GYRO, enable, mDevice);
   };
-  void setSamplingRate(int64_t samplingPeriodNs) override {
-    Smi330Imu::getInstance().setSamplingRate(Smi330Imu::Index::GYRO, samplingPeriodNs, mDevice);
+  int64_t setSamplingRate(int64_t samplingPeriodNs) override {
+    return mImu->setSamplingRate(Smi330Imu::Index::GYRO, samplingPeriodNs, mDevice);
   };
 
+protected:
+  bool isSettled(int64_t timestampNs) const override { return mImu->isSettled(Smi330Imu::Index::GYRO, timestampNs); };
+
+  // Bound by setInstance()
+  Smi330Imu* mImu{nullptr};
+
 private:
   void setScale();
 
@@ -16,35 +16,225 @@
 
 #include "SensorList.h"
 
-#include "FileHandler.h"
+#include <log/log.h>
+#include <utils/SystemClock.h>
+
+#include <algorithm>
+
+#include "AttributeCache.h"
+#include "IioDeviceIndex.h"
 
 namespace bosch::sensors {
 
+/*
+ * Binding only needs the driver names of a chip, they are taken from one set
+ * of its sensors instead of creating one on every bind.
+ */
+SensorList::SensorList() {
+  for (const auto& factory : mChipFactories) {
+    std::vector<std::string> driverNames{};
+    for (const auto& sensor : factory().sensors) driverNames.push_back(sensor->getSensorData().driverName);
+    mDriverNames.push_back(std::move(driverNames));
+  }
+}
+
 std::vector<std::shared_ptr<ISensorHal>> SensorList::getAvailableSensors() {
-  std::string device{};
-  std::vector<std::shared_ptr<ISensorHal>> availableSensors{};
-
-  for (const auto& sensor : mSensorList) {
-    if (bosch::hwctl::isSensorAvailable(sensor->getSensorData().driverName, device)) {
-      sensor->setAvailable(true);
-      sensor->setDevice(device);
-      availableSensors.push_back(sensor);
+  std::lock_guard<std::mutex> lock(mMutex);
+  const int64_t startNs = ::android::elapsedRealtimeNano();
+  const auto availableSensors = bindDevicesLocked(true /* isStatic */);
+  mStartupTimeNs = ::android::elapsedRealtimeNano() - startNs;
+  return availableSensors;
+};
+
+void SensorList::startHotplugMonitor(HotplugCallback callback) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  mHotplugCallback = std::move(callback);
+  mHotplugMonitor = std::make_unique<HotplugMonitor>([this](const auto& event) { onUevent(event); });
+}
+
+void SensorList::stopHotplugMonitor() {
+  // The monitor thread takes the lock itself
+  std::unique_ptr<HotplugMonitor> monitor{};
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    monitor = std::move(mHotplugMonitor);
+  }
+  monitor.reset();
+}
+
+SensorData SensorList::getDynamicSensorMetaData() {
+  SensorData data{};
+  data.sensorName = "BOSCH Dynamic Sensor Meta";
+  data.type = BoschSensorType::DYNAMIC_SENSOR_META;
+  data.minDelayUs = 0;
+  data.maxDelayUs = 0;
+  data.power = 0.0f;
+  data.range = 1.0f;
+  data.resolution = 1.0f;
+  data.reportMode = SPECIAL_REPORTING;
+  data.handle = DYNAMIC_SENSOR_META_HANDLE;
+  return data;
+}
+
+/*
+ * The UUID identifies a dynamic sensor across connections, it is derived
+ * from the handle and so from the chip type, instance and sensor.
+ */
+std::array<uint8_t, 16> SensorList::getDynamicSensorUuid(int32_t handle) {
+  std::array<uint8_t, 16> uuid{'B', 'o', 's', 'c', 'h', 'I', 'I', 'O', 'S', 'e', 'n', 's'};
+  for (size_t i = 0; i < sizeof(handle); i++) uuid[uuid.size() - 1 - i] = (handle >> (8 * i)) & 0xff;
+  return uuid;
+}
+
+/*
+ * Binds every device of the index that has no sensor yet and returns the
+ * sensors that became available. Devices of one chip are bound in the order
+ * of their device numbers, the n-th accelerometer device belongs to the same
+ * instance as the n-th gyroscope device.
+ */
+std::vector<std::shared_ptr<ISensorHal>> SensorList::bindDevicesLocked(bool isStatic) {
+  auto& index = bosch::hwctl::IioDeviceIndex::getInstance();
+  std::vector<std::shared_ptr<ISensorHal>> addedSensors{};
+
+  for (size_t chipIdx = 0; chipIdx < mChipFactories.size(); chipIdx++) {
+    auto& instances = mInstances[chipIdx];
+    const auto& driverNames = mDriverNames[chipIdx];
+
+    for (size_t i = 0; i < driverNames.size(); i++) {
+      for (const auto& device : index.find(driverNames[i])) {
+        const bool isBound = std::any_of(instances.begin(), instances.end(), [&](const auto& instance) {
+          return instance && (instance->devices[i] == device);
+        });
+        if (isBound) continue;
+
+        ChipInstance* instance = getFreeInstanceLocked(chipIdx, i, isStatic);
+        if (instance == nullptr) {
+          ALOGW("Only %u instances of %s are supported", MAX_INSTANCES, device.c_str());
+          break;
+        }
+        const auto& sensor = instance->chip.sensors[i];
+        sensor->setAvailable(true);
+        sensor->setDevice(device);
+        instance->devices[i] = device;
+        addedSensors.push_back(sensor);
+      }
+    }
+
+    for (const auto& instance : instances) {
+      if (!instance) continue;
+      for (size_t i = 0; i < instance->chip.compositeSensors.size(); i++) {
+        const auto& dependencies = instance->chip.compositeSensors[i]->getDependencyList();
+        if (!instance->isCompositeAdded[i] &&
+            std::all_of(dependencies.begin(), dependencies.end(), [](const auto& dep) { return dep->isAvailable(); })) {
+          instance->isCompositeAdded[i] = true;
+          addedSensors.push_back(instance->chip.compositeSensors[i]);
+        }
+      }
     }
   }
 
-  for (const auto& compositeSensor : mCompositeSensorList) {
-    int dependentSensors = 0;
-    for (const auto& sensor : compositeSensor->getDependencyList()) {
-      if (sensor->isAvailable()) {
-        dependentSensors++;
+  return addedSensors;
+}
+
+/*
+ * Returns the first instance whose sensor is not bound yet, a new instance
+ * takes the lowest free instance number. A hotplugged device only goes into a
+ * dynamic instance, the sensors of a static one could not be disconnected
+ * when it is removed again.
+ */
+SensorList::ChipInstance* SensorList::getFreeInstanceLocked(size_t chipIdx, size_t sensorIdx, bool isStatic) {
+  auto& instances = mInstances[chipIdx];
+  for (const auto& instance : instances) {
+    if (instance && (instance->isStatic == isStatic) && instance->devices[sensorIdx].empty()) return instance.get();
+  }
+
+  auto slot = std::find(instances.begin(), instances.end(), nullptr);
+  if (slot == instances.end()) {
+    if (instances.size() >= MAX_INSTANCES) return nullptr;
+    slot = instances.emplace(instances.end());
+  }
+  const uint32_t number = slot - instances.begin();
+
+  auto instance = std::make_unique<ChipInstance>();
+  instance->chip = mChipFactories[chipIdx]();
+  instance->devices.resize(instance->chip.sensors.size());
+  instance->isCompositeAdded.resize(instance->chip.compositeSensors.size(), false);
+  instance->isStatic = isStatic;
+
+  const int32_t firstHandle =
+    1 + number * HANDLES_PER_INSTANCE +
+    chipIdx * (instance->chip.sensors.size() + instance->chip.compositeSensors.size());
+  int32_t handle = firstHandle;
+  for (const auto& sensor : instance->chip.sensors) sensor->setInstance(number, handle++);
+  for (const auto& compositeSensor : instance->chip.compositeSensors) compositeSensor->setInstance(number, handle++);
+
+  *slot = std::move(instance);
+  return slot->get();
+}
+
+/*
+ * Removes the instances that used the device and returns the handles of
+ * their sensors. Other devices of these instances are bound again later.
+ */
+std::vector<int32_t> SensorList::removeDeviceLocked(const std::string& device) {
+  std::vector<int32_t> removedHandles{};
+
+  for (auto& instances : mInstances) {
+    for (auto& instance : instances) {
+      if (!instance || (std::find(instance->devices.begin(), instance->devices.end(), device) ==
+                        instance->devices.end())) {
+        continue;
+      }
+      if (instance->isStatic) {
+        ALOGW("%s was removed but its sensors are in the static sensor list", device.c_str());
+        continue;
+      }
+
+      for (size_t i = 0; i < instance->chip.sensors.size(); i++) {
+        if (!instance->devices[i].empty()) removedHandles.push_back(instance->chip.sensors[i]->getSensorData().handle);
+      }
+      for (size_t i = 0; i < instance->chip.compositeSensors.size(); i++) {
+        if (instance->isCompositeAdded[i]) {
+          removedHandles.push_back(instance->chip.compositeSensors[i]->getSensorData().handle);
+        }
       }
+      instance.reset();
     }
-    if (dependentSensors == compositeSensor->getDependencyList().size()) {
-      availableSensors.push_back(compositeSensor);
+  }
+
+  return removedHandles;
+}
+
+void SensorList::onUevent(const bosch::hwctl::Uevent& event) {
+  auto& index = bosch::hwctl::IioDeviceIndex::getInstance();
+  std::vector<std::shared_ptr<ISensorHal>> addedSensors{};
+  std::vector<int32_t> removedHandles{};
+  HotplugCallback callback{};
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (event.action == bosch::hwctl::Uevent::ADD) {
+      if (index.add(event.device).empty()) return;
+    } else {
+      const std::string device = index.remove(event.device);
+      if (device.empty()) return;
+      // The open attributes of the device are stale, they fail with ENODEV
+      bosch::hwctl::AttributeCache::invalidateInstance(device);
+      removedHandles = removeDeviceLocked(device);
     }
+    addedSensors = bindDevicesLocked(false /* isStatic */);
+    callback = mHotplugCallback;
   }
 
-  return availableSensors;
-};
+  ALOGI("%s %s: %zu sensors added, %zu removed", event.device.c_str(),
+        (event.action == bosch::hwctl::Uevent::ADD) ? "added" : "removed", addedSensors.size(), removedHandles.size());
+  if (callback && (!addedSensors.empty() || !removedHandles.empty())) callback(addedSensors, removedHandles);
+}
+
+std::string SensorList::getStartupInfo() const {
+  auto& index = bosch::hwctl::IioDeviceIndex::getInstance();
+  return "IIO devices: " + std::to_string(index.getDeviceCount()) + ", scanned in " +
+         std::to_string(index.getScanTimeNs() / 1000) + " us\nSensor setup: " + std::to_string(mStartupTimeNs / 1000) +
+         " us\n";
+}
 
 }  // namespace bosch::sensors
\ No newline at end of file
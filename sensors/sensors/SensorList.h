@@ -17,9 +17,14 @@
 #ifndef ANDROID_HARDWARE_BOSCH_SENSOR_LIST_H
 #define ANDROID_HARDWARE_BOSCH_SENSOR_LIST_H
 
+#include <array>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <string>
 #include <vector>
 
+#include "HotplugMonitor.h"
 #include "SMI230.h"
 #include "SMI240.h"
 #include "SMI330.h"
@@ -28,31 +33,86 @@
 namespace bosch {
 namespace sensors {
 
+/*
+ * Creates the sensors of every supported chip found on the board. Each chip
+ * instance gets its own set of sensors, bound to its own IIO devices, and a
+ * handle that only depends on the chip type, the instance and the sensor.
+ *
+ * Devices that are probed after start-up are reported through the hotplug
+ * callback as dynamic sensors. An instance of dynamic sensors is removed as a
+ * whole once one of its devices disappears, the static ones are kept.
+ */
 class SensorList {
 public:
+  static constexpr uint32_t MAX_INSTANCES = 8;
+  static constexpr int32_t HANDLES_PER_INSTANCE = 32;
+  static constexpr int32_t DYNAMIC_SENSOR_META_HANDLE = MAX_INSTANCES * HANDLES_PER_INSTANCE + 1;
+
+  using HotplugCallback = std::function<void(const std::vector<std::shared_ptr<ISensorHal>>& added,
+                                             const std::vector<int32_t>& removed)>;
+
+  SensorList();
+  ~SensorList() { stopHotplugMonitor(); }
+
   std::vector<std::shared_ptr<ISensorHal>> getAvailableSensors();
+  // Time spent on device discovery and sensor setup, for the debug dump
+  std::string getStartupInfo() const;
+
+  // The callback runs on the monitor thread, removed sensors come first
+  void startHotplugMonitor(HotplugCallback callback);
+  void stopHotplugMonitor();
+
+  static SensorData getDynamicSensorMetaData();
+  static std::array<uint8_t, 16> getDynamicSensorUuid(int32_t handle);
 
 private:
-  std::vector<std::shared_ptr<SensorCore>> mSensorList{std::make_shared<Smi330Acc>(),
-                                                       std::make_shared<Smi330Gyro>(),
-                                                       std::make_shared<Smi240Acc>(),
-                                                       std::make_shared<Smi240Gyro>(),
-                                                       std::make_shared<Smi230Acc>(),
-                                                       std::make_shared<Smi230Gyro>(),
-                                                       std::make_shared<Smi330AccUncalibrated>(),
-                                                       std::make_shared<Smi330GyroUncalibrated>(),
-                                                       std::make_shared<Smi240AccUncalibrated>(),
-                                                       std::make_shared<Smi240GyroUncalibrated>(),
-                                                       std::make_shared<Smi230AccUncalibrated>(),
-                                                       std::make_shared<Smi230GyroUncalibrated>()};
-
-  std::vector<std::shared_ptr<CompositeSensorCore>> mCompositeSensorList{
-    std::make_shared<Smi330Gravity>(mSensorList[0], mSensorList[1]),
-    std::make_shared<Smi330LinearAcc>(mSensorList[0], mSensorList[1]),
-    std::make_shared<Smi240Gravity>(mSensorList[2], mSensorList[3]),
-    std::make_shared<Smi240LinearAcc>(mSensorList[2], mSensorList[3]),
-    std::make_shared<Smi230Gravity>(mSensorList[4], mSensorList[5]),
-    std::make_shared<Smi230LinearAcc>(mSensorList[4], mSensorList[5])};
+  struct ChipSensors {
+    std::vector<std::shared_ptr<SensorCore>> sensors;
+    std::vector<std::shared_ptr<CompositeSensorCore>> compositeSensors;
+  };
+  using ChipFactory = ChipSensors (*)();
+
+  struct ChipInstance {
+    ChipSensors chip;
+    // Device of each sensor, empty while none is bound
+    std::vector<std::string> devices;
+    std::vector<bool> isCompositeAdded;
+    bool isStatic;
+  };
+
+  template <typename Acc, typename Gyro, typename AccUncalibrated, typename GyroUncalibrated, typename GravitySensor,
+            typename LinearAccSensor>
+  static ChipSensors createChipSensors() {
+    ChipSensors chip{};
+    chip.sensors = {std::make_shared<Acc>(), std::make_shared<Gyro>(), std::make_shared<AccUncalibrated>(),
+                    std::make_shared<GyroUncalibrated>()};
+    chip.compositeSensors = {std::make_shared<GravitySensor>(chip.sensors[0], chip.sensors[1]),
+                             std::make_shared<LinearAccSensor>(chip.sensors[0], chip.sensors[1])};
+    return chip;
+  }
+
+  std::vector<std::shared_ptr<ISensorHal>> bindDevicesLocked(bool isStatic);
+  ChipInstance* getFreeInstanceLocked(size_t chipIdx, size_t sensorIdx, bool isStatic);
+  std::vector<int32_t> removeDeviceLocked(const std::string& device);
+  void onUevent(const bosch::hwctl::Uevent& event);
+
+  const std::vector<ChipFactory> mChipFactories{
+    createChipSensors<Smi330Acc, Smi330Gyro, Smi330AccUncalibrated, Smi330GyroUncalibrated, Smi330Gravity,
+                      Smi330LinearAcc>,
+    createChipSensors<Smi240Acc, Smi240Gyro, Smi240AccUncalibrated, Smi240GyroUncalibrated, Smi240Gravity,
+                      Smi240LinearAcc>,
+    createChipSensors<Smi230Acc, Smi230Gyro, Smi230AccUncalibrated, Smi230GyroUncalibrated, Smi230Gravity,
+                      Smi230LinearAcc>};
+
+  // Driver name of each sensor of each chip, as created by its factory
+  std::vector<std::vector<std::string>> mDriverNames{};
+  // Instances of each chip by instance number, removed ones leave a gap
+  std::vector<std::vector<std::unique_ptr<ChipInstance>>> mInstances{mChipFactories.size()};
+  int64_t mStartupTimeNs{0};
+  std::mutex mMutex;
+
+  HotplugCallback mHotplugCallback{};
+  std::unique_ptr<HotplugMonitor> mHotplugMonitor{};
 };
 
 }  // namespace sensors